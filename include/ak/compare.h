@@ -5,6 +5,7 @@
 #ifndef AK_LIB_COMPARE_H_
 #define AK_LIB_COMPARE_H_
 
+#include <compare>
 #include <concepts>
 
 namespace ak {
@@ -14,9 +15,42 @@ concept Comparable = requires(A a, B b) {
   { a < b } -> std::same_as<bool>;
 };
 
+/// whether a <=> b is defined, e.g. by default or for a Varchar, which then takes one comparison where a < b and b < a take two.
+template <typename A, typename B = A>
+concept ThreeWayComparable = requires(const A &a, const B &b) {
+  { a <=> b } -> std::convertible_to<std::partial_ordering>;
+};
+
+template <typename A, typename B = A>
+concept EqualityComparable = requires(const A &a, const B &b) {
+  { a == b } -> std::convertible_to<bool>;
+};
+
+/// @returns how lhs compares to rhs, by a single <=> if it is defined, or by < otherwise. unordered values are equivalent.
+template <typename A, typename B> requires ThreeWayComparable<A, B> || (Comparable<A, B> && Comparable<B, A>)
+auto compare (const A &lhs, const B &rhs) -> std::weak_ordering {
+  if constexpr (ThreeWayComparable<A, B>) {
+    auto res = lhs <=> rhs;
+    if (res < 0) return std::weak_ordering::less;
+    if (res > 0) return std::weak_ordering::greater;
+    return std::weak_ordering::equivalent;
+  } else {
+    if (lhs < rhs) return std::weak_ordering::less;
+    if (rhs < lhs) return std::weak_ordering::greater;
+    return std::weak_ordering::equivalent;
+  }
+}
+
+/// whether neither of lhs and rhs is less than the other, by a single == or <=> if defined. == needs to agree with <.
 template <typename A, typename B> requires Comparable<A, B>
 auto equals (const A &lhs, const B &rhs) -> bool {
-  return !(lhs < rhs || rhs < lhs);
+  if constexpr (EqualityComparable<A, B>) {
+    return lhs == rhs;
+  } else if constexpr (ThreeWayComparable<A, B>) {
+    return (lhs <=> rhs) == 0;
+  } else {
+    return !(lhs < rhs || rhs < lhs);
+  }
 }
 
 } // namespace ak
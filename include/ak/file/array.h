@@ -4,32 +4,57 @@
 #include <string.h>
 
 #include <functional>
+#include <optional>
 
 #include "ak/base.h"
+#include "ak/compare.h"
 
 namespace ak::file {
+/**
+ * how Array and Set check indices and lengths: CHECKED throws OutOfBounds and its subclasses, DEBUG only asserts with AK_DEBUG,
+ * and UNCHECKED trusts the caller, e.g. in the loops of BpTree over its own nodes.
+ */
+enum class CheckPolicy { CHECKED, DEBUG, UNCHECKED };
+
+/// what the non-throwing lookups of Array and Set return for a miss.
+constexpr size_t npos = -1;
+
 /// an array with utility functions and bound checks.
-template <typename T, size_t maxLength>
+template <typename T, size_t maxLength, CheckPolicy checkPolicy = CheckPolicy::CHECKED>
 struct Array {
  private:
-  auto boundsCheck_ (size_t index) -> void {
-    if (index >= length) throw OutOfBounds("Array: overflow or underflow");
+  template <typename E>
+  static auto check_ (bool ok, const char *message) -> void {
+    if constexpr (checkPolicy == CheckPolicy::CHECKED) {
+      if (!ok) throw E(message);
+    } else if constexpr (checkPolicy == CheckPolicy::DEBUG) {
+      AK_ASSERT(ok);
+    }
   }
+  auto boundsCheck_ (size_t index) const -> void { check_<OutOfBounds>(index < length, "Array: overflow or underflow"); }
  public:
   Array () = default;
   size_t length = 0;
   T content[maxLength];
-  auto indexOf (const T &element) -> size_t {
+  /// @returns the index of the first element equal to element, or npos.
+  auto find (const T &element) const -> size_t {
     for (size_t i = 0; i < length; ++i) if (equals(element, content[i])) return i;
-    throw NotFound("Array::indexOf: element not found");
+    return npos;
   }
-  auto includes (const T &element) -> bool {
-    for (size_t i = 0; i < length; ++i) if (equals(element, content[i])) return true;
-    return false;
+  auto indexOf (const T &element) -> size_t {
+    size_t ix = find(element);
+    if (ix == npos) throw NotFound("Array::indexOf: element not found");
+    return ix;
+  }
+  auto includes (const T &element) -> bool { return find(element) != npos; }
+  /// @returns the element at index, or nullopt if index is out of bounds, whatever the check policy.
+  auto get (size_t index) const -> std::optional<T> {
+    if (index >= length) return std::nullopt;
+    return content[index];
   }
   auto insert (const T &element, size_t offset) -> void {
     if (offset != length) boundsCheck_(offset);
-    if (length == maxLength) throw Overflow("Array::insert: overflow");
+    check_<Overflow>(length < maxLength, "Array::insert: overflow");
     if (offset != length) memmove(&content[offset + 1], &content[offset], (length - offset) * sizeof(content[0]));
     content[offset] = element;
     ++length;
@@ -49,22 +74,22 @@ struct Array {
   }
 
   auto operator[] (size_t index) -> T & { boundsCheck_(index); return content[index]; }
-  auto operator[] (size_t index) -> T & { boundsCheck_(index); return content[index]; }
+  auto operator[] (size_t index) const -> const T & { boundsCheck_(index); return content[index]; }
 
   auto pop () -> T {
-    if (length == 0) throw Underflow("Set::pop: underflow");
+    check_<Underflow>(length > 0, "Array::pop: underflow");
     return content[--length];
   }
   auto shift () -> T {
-    if (length == 0) throw Underflow("Set::pop: underflow");
+    check_<Underflow>(length > 0, "Array::shift: underflow");
     T result = content[0];
     removeAt(0);
     return result;
   }
-  auto push (const T &object) -> T { insert(object, length); }
-  auto unshift (const T &object) -> T { insert(object, 0); }
+  auto push (const T &object) -> void { insert(object, length); }
+  auto unshift (const T &object) -> void { insert(object, 0); }
 
-  auto forEach (const std::function<void (const T &element)> &callback) -> T {
+  auto forEach (const std::function<void (const T &element)> &callback) -> void {
     for (size_t i = 0; i < length; ++i) callback(content[i]);
   }
 };
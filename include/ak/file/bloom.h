@@ -0,0 +1,143 @@
+#ifndef AK_LIB_FILE_BLOOM_H_
+#define AK_LIB_FILE_BLOOM_H_
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <numbers>
+
+#include "ak/base.h"
+#include "ak/file/file.h"
+
+namespace ak::file {
+/// spreads the bits of a hash. std::hash is the identity function for integers, which is not good enough for a bloom filter.
+inline auto mixHash (size_t x) -> size_t {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+template <typename T>
+concept Hashable = requires(T a) {
+  { std::hash<T>()(a) } -> std::convertible_to<size_t>;
+};
+
+/**
+ * a persistent blocked bloom filter, with pages of szChunk bytes stored in a File.
+ * each key is hashed to one page and sets numHashes bits inside it, so that an insertion or a lookup touches a single page.
+ * bits can not be cleared; call rebuild() and re-insert the keys after lots of removals or insertions beyond the capacity.
+ *
+ * constraints: KeyType needs to be Hashable.
+ */
+template <typename KeyType, size_t szChunk = kDefaultSzChunk>
+class BloomFilter {
+ public:
+  /// lookup statistics since the filter is opened.
+  struct Stats {
+    size_t lookups = 0;
+    /// lookups answered with a definite miss.
+    size_t negatives = 0;
+    /// lookups answered with a maybe, which turned out to be a miss.
+    size_t falsePositives = 0;
+    [[nodiscard]] auto falsePositiveRate () const -> double {
+      return negatives + falsePositives == 0 ? 0 : (double) falsePositives / (double) (negatives + falsePositives);
+    }
+  };
+ private:
+  static constexpr size_t kBitsPerPage = szChunk * 8;
+  struct Header : public ManagedObject<Header, szChunk> {
+    char _start[0];
+    size_t bitsPerKey;
+    size_t numHashes;
+    size_t numPages;
+    /// pages are never freed, so that they always have ids 1 to numAllocatedPages.
+    size_t numAllocatedPages;
+    size_t numKeys;
+    char _end[0];
+    Header (File<szChunk> &file) : ManagedObject<Header, szChunk>(file) {}
+  };
+  File<szChunk> file_;
+  Stats stats_;
+
+  auto header_ () -> Header { return Header::get(file_, 0); }
+  auto pageOf_ (size_t hash, const Header &header) -> size_t { return 1 + hash % header.numPages; }
+  /// calls callback with the bit positions of the key inside its page.
+  template <typename F>
+  static auto forEachBit_ (size_t hash, const Header &header, const F &callback) -> void {
+    size_t h = mixHash(hash + 0x9e3779b97f4a7c15ULL);
+    size_t h1 = h & 0xffffffffULL, h2 = (h >> 32) | 1;
+    for (size_t i = 0; i < header.numHashes; ++i) callback((h1 + i * h2) % kBitsPerPage);
+  }
+  auto resize_ (Header &header, size_t capacity) -> void {
+    header.numPages = std::max<size_t>(1, (capacity * header.bitsPerKey + kBitsPerPage - 1) / kBitsPerPage);
+    char page[szChunk];
+    memset(page, 0, szChunk);
+    for (; header.numAllocatedPages < header.numPages; ++header.numAllocatedPages) file_.push(page, szChunk);
+    for (size_t i = 1; i <= header.numPages; ++i) file_.set(page, i, szChunk);
+    header.numKeys = 0;
+    header.update();
+  }
+  auto init_ (size_t bitsPerKey, size_t capacity) -> void {
+    Header header(file_);
+    header.bitsPerKey = bitsPerKey;
+    header.numHashes = std::clamp<size_t>(std::lround((double) bitsPerKey * std::numbers::ln2), 1, 30);
+    header.numPages = header.numAllocatedPages = header.numKeys = 0;
+    header.save();
+    AK_ASSERT(header.id() == 0);
+    resize_(header, capacity);
+  }
+ public:
+  BloomFilter () = delete;
+  /// bitsPerKey and capacity (the expected number of keys) are only used when the file is created.
+  BloomFilter (const char *filename, size_t bitsPerKey, size_t capacity) : file_(filename, [&] () { init_(bitsPerKey, capacity); }) {}
+
+  auto insert (const KeyType &key) -> void {
+    Header header = header_();
+    size_t hash = mixHash(std::hash<KeyType>()(key));
+    size_t ixPage = pageOf_(hash, header);
+    char page[szChunk];
+    file_.get(page, ixPage, szChunk);
+    forEachBit_(hash, header, [&page] (size_t bit) { page[bit / 8] |= (char) (1 << (bit % 8)); });
+    file_.set(page, ixPage, szChunk);
+    ++header.numKeys;
+    header.update();
+  }
+  /// @returns false if the key is definitely not inserted.
+  auto mayContain (const KeyType &key) -> bool {
+    Header header = header_();
+    size_t hash = mixHash(std::hash<KeyType>()(key));
+    char page[szChunk];
+    file_.get(page, pageOf_(hash, header), szChunk);
+    bool res = true;
+    forEachBit_(hash, header, [&page, &res] (size_t bit) { res = res && (page[bit / 8] & (1 << (bit % 8))) != 0; });
+    ++stats_.lookups;
+    if (!res) ++stats_.negatives;
+    return res;
+  }
+  /// tells the filter that the last positive lookup turned out to be a miss.
+  auto reportFalsePositive () -> void { ++stats_.falsePositives; }
+  /// clears the filter and resizes it to hold capacity keys. the keys need to be inserted again.
+  auto rebuild (size_t capacity) -> void {
+    Header header = header_();
+    resize_(header, capacity);
+  }
+
+  /// @returns the number of insertions since the last rebuild.
+  auto size () -> size_t { return header_().numKeys; }
+  /// @returns the false positive rate expected from the current fill: (1 - e^(-kn/m))^k.
+  auto estimatedFalsePositiveRate () -> double {
+    Header header = header_();
+    double k = header.numHashes, n = header.numKeys, m = header.numPages * kBitsPerPage;
+    return std::pow(1 - std::exp(-k * n / m), k);
+  }
+  auto stats () const -> const Stats & { return stats_; }
+  auto clearCache () -> void { file_.clearCache(); }
+};
+} // namespace ak::file
+
+#endif
@@ -1,18 +1,34 @@
 #ifndef AK_LIB_FILE_BPTREE_H_
 #define AK_LIB_FILE_BPTREE_H_
 
+#include <stddef.h>
 #include <string.h>
 
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
 #include <compare>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
 #include <optional>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "ak/base.h"
 #include "ak/compare.h"
 #include "ak/file/array.h"
+#include "ak/file/bloom.h"
+#include "ak/file/cell.h"
 #include "ak/file/file.h"
 #include "ak/file/set.h"
+#include "ak/threadpool.h"
 
 #ifdef AK_DEBUG
 #include <iostream>
@@ -20,15 +36,38 @@
 
 namespace ak::file {
 template <typename T>
-concept BptStorable = requires(T a, T b) {
-  Comparable<T>;
-  std::copy_constructible<T>;
-};
+concept BptStorable = Comparable<T> && std::copy_constructible<T>;
+
+/// whether a BpTree supports duplicate keys.
+enum class BptKeyPolicy { DUPLICATE, UNIQUE };
+/**
+ * how a BpTree stores its record nodes, see BpTree. PLAIN, the default, stores them as they are in memory.
+ * the root records the format, with the key policy and the version of the layout of the file, and opening a tree with other ones
+ * throws. the layout itself changed with the subtree counts of index nodes and the write buffer, so files written before are
+ * not readable in any format: recreate them from their data.
+ */
+enum class BptRecordFormat { PLAIN, SLOTTED, PACKED };
+/// the key types of BptRecordFormat::PACKED.
+template <typename T>
+concept BptPackable = std::integral<T> && !std::same_as<T, bool> && sizeof(T) <= sizeof(uint64_t);
 
 /**
  * an implementation of the B+ tree. It stores key and value together in order to support duplicate keys.
  *
- * constraints: KeyType and ValueType need to be comparable.
+ * with BptKeyPolicy::UNIQUE, the tree is a map instead: it orders by key alone, index nodes store only keys (and thus have a greater fanout),
+ * insert overwrites the value of an existing key, and lookups descend a single path.
+ *
+ * constraints: KeyType needs to be comparable. ValueType needs to be comparable unless the keys are unique.
+ *
+ * record nodes are arrays of entries as they are in memory by default, BptRecordFormat::PLAIN. the other formats are opt-in:
+ *
+ * with BptRecordFormat::SLOTTED, for variable-length KeyType or ValueType, see Cell, record nodes are stored as slotted pages: a
+ * directory of cell offsets, then the cells of the entries, each as long as its key and value actually are. record nodes then
+ * split and merge by bytes rather than by entries, and hold several times more short strings than their fixed-size slots would.
+ *
+ * with BptRecordFormat::PACKED, for integral KeyType, record nodes are stored packed: the first key of the node, then the
+ * differences of the others to it, bit-packed as wide as the greatest difference needs. the nodes of dense keys, such as ids or
+ * timestamps, then hold several times more entries, so scans read fewer pages. they split and merge by bits.
  *
  * why default szChunk = 4096: excerpt of `sudo fdisk -l` on my machine:
  *   Disk /dev/nvme1n1: 1.82 TiB, 2000398934016 bytes, 3907029168 sectors
@@ -37,57 +76,230 @@ concept BptStorable = requires(T a, T b) {
  *   Sector size (logical/physical): 512 bytes / 512 bytes
  *   I/O size (minimum/optimal): 512 bytes / 512 bytes
  */
-template <BptStorable KeyType, BptStorable ValueType, size_t szChunk = kDefaultSzChunk>
+template <
+  BptStorable KeyType,
+  std::copy_constructible ValueType,
+  size_t szChunk = kDefaultSzChunk,
+  BptKeyPolicy keyPolicy = BptKeyPolicy::DUPLICATE,
+  BptRecordFormat recordFormat = BptRecordFormat::PLAIN
+> requires (keyPolicy == BptKeyPolicy::UNIQUE || Comparable<ValueType>) && (recordFormat != BptRecordFormat::PACKED || BptPackable<KeyType>)
 class BpTree {
+ public:
+  /// structural counters since the tree is opened. take the difference of two copies to count what happens in between.
+  struct Stats {
+    /// splits of nodes other than the root, which add a sibling.
+    size_t splits = 0;
+    /// splits of the root, which add a level.
+    size_t rootSplits = 0;
+    /// merges of underfull nodes into a sibling.
+    size_t merges = 0;
+    /// moves of entries or children from a sibling to an underfull node, where merging would overflow it.
+    size_t borrows = 0;
+    /// replacements of the root by its only child, which remove a level.
+    size_t collapses = 0;
+    /// the nodes read, whether from the cache or the disk, by all operations. per operation, this is the number of nodes visited.
+    size_t nodesRead = 0;
+  };
+  /// a level of the tree, see analyze.
+  struct LevelShape {
+    size_t nodes = 0;
+    /// the children of index nodes, or the entries of record nodes.
+    size_t length = 0;
+    /// the mean of the fill of the nodes, relative to their maximum.
+    double meanFill = 0;
+    /// fillHistogram[i] counts the nodes filled from i / 10 to (i + 1) / 10 of their maximum, the last bucket including full ones.
+    std::array<size_t, 10> fillHistogram = {};
+  };
+  /// the shape of the tree, see analyze.
+  struct Shape {
+    /// levels.front() is the root, and levels.back() the record nodes, unless the tree is empty.
+    std::vector<LevelShape> levels;
+    /**
+     * the share of record nodes directly followed in the file by the next one in key order, for which scans read on sequentially.
+     * 1 if there are less than two record nodes.
+     */
+    double leafAdjacency = 1;
+    auto height () const -> size_t { return levels.size(); }
+  };
  private:
+  static constexpr bool kUnique = keyPolicy == BptKeyPolicy::UNIQUE;
+  /// the arrays of nodes are only indexed by the tree itself, so their bounds are only checked in debug builds.
+  static constexpr CheckPolicy kCheckPolicy = CheckPolicy::DEBUG;
+  // the parallel scans open the file again for each of their threads, see parallelForEach.
+  std::string filename_;
   File<szChunk> file_;
+  std::optional<BloomFilter<KeyType, szChunk>> bloom_;
+  // see setMinFill.
+  size_t minRecordFill_;
+  size_t minIndexLength_;
+  // see setAppendFill.
+  double appendFill_ = 0.9;
+  Stats stats_;
 
   // data structures
   /// store key and value together to support dupe keys. this is the structure that is actually stored.
   struct Pair {
     KeyType key;
     ValueType value;
-    auto operator< (const Pair &that) const -> bool {
-      if (key < that.key || that.key < key) return key < that.key;
-      return value < that.value;
+    /// one comparison of the keys, and of the values if the keys are equivalent.
+    auto operator<=> (const Pair &that) const -> std::weak_ordering {
+      std::weak_ordering res = compare(key, that.key);
+      if constexpr (!kUnique) {
+        if (res == 0) return compare(value, that.value);
+      }
+      return res;
     }
   };
+  /// the separator of unique trees, which needs no value as keys alone are distinct.
+  struct SplitKey {
+    KeyType key;
+    auto operator<=> (const SplitKey &that) const -> std::weak_ordering { return compare(key, that.key); }
+  };
+  /// what index nodes store in splits.
+  using Separator = std::conditional_t<kUnique, SplitKey, Pair>;
+  static auto separatorOf_ (const Pair &entry) -> Separator {
+    if constexpr (kUnique) {
+      return { .key = entry.key };
+    } else {
+      return entry;
+    }
+  }
+  /// whether entry is ordered before the one target stands for, comparing keys alone in unique trees.
+  static auto precedes_ (const Pair &entry, const Separator &target) -> bool {
+    if constexpr (kUnique) {
+      return entry.key < target.key;
+    } else {
+      return entry < target;
+    }
+  }
+  static auto matches_ (const Pair &entry, const Separator &target) -> bool {
+    if constexpr (kUnique) {
+      return equals(entry.key, target.key);
+    } else {
+      return equals(entry, target);
+    }
+  }
   /// compares a Payload and a KeyType that key alone is greater than all payloads with this key
   class KeyComparator_ {
    public:
-    auto operator() (const Pair &lhs, const KeyType &rhs) const -> bool { return !(rhs < lhs.key); }
-    auto operator() (const KeyType &lhs, const Pair &rhs) const -> bool { return lhs < rhs.key; }
+    template <typename E>
+    auto operator() (const E &lhs, const KeyType &rhs) const -> bool { return !(rhs < lhs.key); }
+    template <typename E>
+    auto operator() (const KeyType &lhs, const E &rhs) const -> bool { return lhs < rhs.key; }
   };
   /// compares a Payload and a KeyType that key alone is less than all payloads with this key
   class KeyComparatorLess_ {
    public:
-    auto operator() (const Pair &lhs, const KeyType &rhs) const -> bool { return lhs.key < rhs; }
-    auto operator() (const KeyType &lhs, const Pair &rhs) const -> bool { return !(rhs.key < lhs); }
+    template <typename E>
+    auto operator() (const E &lhs, const KeyType &rhs) const -> bool { return lhs.key < rhs; }
+    template <typename E>
+    auto operator() (const KeyType &lhs, const E &rhs) const -> bool { return !(rhs.key < lhs); }
   };
 
   using NodeId = unsigned int;
-  // ROOT and INTERMEDIATE nodes are index nodes
-  enum NodeType { ROOT, INTERMEDIATE, RECORD };
+  // ROOT and INTERMEDIATE nodes are index nodes. BUFFER nodes are the pages of the write buffer, see setWriteBuffer.
+  enum NodeType { ROOT, INTERMEDIATE, RECORD, BUFFER };
+  /// a buffered write. empty slots of buffer nodes are NONE.
+  enum MessageType : char { NONE, INSERTION, REMOVAL };
+  struct Message {
+    Pair entry;
+    MessageType type;
+  };
   // if k > kLengthMax, there must be an overflow.
   static constexpr size_t kLengthMax = 18446744073709000000ULL;
+  // opening a file of another layout fails instead of misreading it, see BptRecordFormat. bump the version on changes to it.
+  static constexpr uint32_t kFormatVersion = 1;
+  static constexpr uint32_t kFormat = 0x4250 << 16 | kFormatVersion << 8 | static_cast<uint32_t>(recordFormat) << 1 | kUnique;
+  /// what only the root stores.
+  struct RootHeader {
+    uint32_t format = kFormat;
+    /// the first page of the write buffer, created by the first setWriteBuffer, or 0 if the tree has none.
+    NodeId writeBuffer = 0;
+  };
   struct IndexPayload {
-    static constexpr size_t k = (szChunk - 2 * sizeof(NodeId)) / (sizeof(NodeId) + sizeof(Pair)) / 2 - 1;
+    static constexpr size_t k = (szChunk - 3 * sizeof(size_t)) / (sizeof(NodeId) + sizeof(Separator) + sizeof(size_t)) / 2 - 1;
     static_assert(k >= 2 && k < kLengthMax);
     bool leaf = false;
+    /// only used in the root.
+    RootHeader header;
     /// for leaf nodes, childs are the indices of data nodes.
-    Array<NodeId, 2 * k> children;
-    Set<Pair, 2 * k> splits;
+    Array<NodeId, 2 * k, kCheckPolicy> children;
+    Set<Separator, 2 * k, kCheckPolicy> splits;
+    /// counts[i] is the number of entries in the subtrees of children[0] to children[i], so that an entry is found by its index
+    /// with a binary search.
+    Array<size_t, 2 * k, kCheckPolicy> counts;
   };
+  // slotted record nodes are a header of type, prev, next, the number of entries, their fill and where their cells begin,
+  // then the offsets of the cells, free space, and the cells of the entries, from the end of the page backwards.
+  // cells removed from the page itself may leave holes in between, which the next full encoding of the node drops.
+  using Slot = std::conditional_t<szChunk < (1 << 16), uint16_t, uint32_t>;
+  static constexpr size_t kPrevAt = sizeof(NodeType);
+  static constexpr size_t kNextAt = kPrevAt + sizeof(NodeId);
+  static constexpr size_t kLengthAt = kNextAt + sizeof(NodeId);
+  static constexpr size_t kFillAt = kLengthAt + sizeof(Slot);
+  static constexpr size_t kTopAt = kFillAt + sizeof(Slot);
+  static constexpr size_t kSlottedHeader = kTopAt + sizeof(Slot);
+  static constexpr size_t kSlottedCapacity = szChunk - kSlottedHeader;
+  static constexpr size_t kMinCell = sizeof(Slot) + Cell<KeyType>::kMinSize + Cell<ValueType>::kMinSize;
+  static constexpr size_t kMaxCell = sizeof(Slot) + Cell<KeyType>::kMaxSize + Cell<ValueType>::kMaxSize;
+  static constexpr bool kSlotted = recordFormat == BptRecordFormat::SLOTTED;
+  // splits need an entry to be small compared to a page, so that both halves fit.
+  static_assert(!kSlotted || 4 * kMaxCell <= kSlottedCapacity, "BpTree: entries too large for slotted record nodes");
+  static auto cellSize_ (const Pair &entry) -> size_t {
+    return sizeof(Slot) + Cell<KeyType>::size(entry.key) + Cell<ValueType>::size(entry.value);
+  }
+  // packed record nodes, of integral keys, are a header of type, prev, next, the number of entries, the bit width of their keys
+  // and the first key, the base. the keys follow as their differences to the base, bit-packed at that width, while the values are
+  // stored from the end of the page backwards. keys dense within a node, such as ids and timestamps, then take a few bits each
+  // instead of their full width, and the node holds several times more entries.
+  static constexpr size_t kWidthAt = kFillAt;
+  static constexpr size_t kBaseAt = kWidthAt + sizeof(Slot);
+  static constexpr size_t kPackedHeader = kBaseAt + sizeof(uint64_t);
+  // the fill of packed nodes is in bits. the keys are read a word at a time, which may reach a word past the last key, and
+  // their bytes are rounded up.
+  static constexpr size_t kPackedCapacity = 8 * (szChunk - kPackedHeader - sizeof(uint64_t) - 1);
+  static constexpr bool kPacked = recordFormat == BptRecordFormat::PACKED;
+  /// whether record nodes are stored in a format of their own, and decoded into entries only on demand.
+  static constexpr bool kEncoded = kSlotted || kPacked;
+  /// key - base of packed nodes, where base is not greater than key.
+  static auto deltaOf_ (const KeyType &key, const KeyType &base) -> uint64_t {
+    using Unsigned = std::make_unsigned_t<KeyType>;
+    return static_cast<Unsigned>(static_cast<Unsigned>(key) - static_cast<Unsigned>(base));
+  }
+  static auto keyOf_ (const KeyType &base, uint64_t delta) -> KeyType {
+    using Unsigned = std::make_unsigned_t<KeyType>;
+    return static_cast<KeyType>(static_cast<Unsigned>(static_cast<Unsigned>(base) + delta));
+  }
+  /// the bit width of the keys of a packed node from first to last. widths that a shifted word cannot hold are rounded up to 64.
+  static auto widthOf_ (const KeyType &first, const KeyType &last) -> size_t {
+    size_t res = std::bit_width(deltaOf_(last, first));
+    return res > 56 ? 64 : res;
+  }
+  static auto packedFill_ (size_t length, size_t width) -> size_t { return length * (width + 8 * sizeof(ValueType)); }
   struct RecordPayload {
-    static constexpr size_t l = (szChunk - 3 * sizeof(NodeId)) / sizeof(Pair) / 2 - 1;
+    // encoded record nodes hold as many entries in memory as the smallest cells, or keys all alike, fill a page with.
+    static constexpr size_t l =
+      kSlotted ? kSlottedCapacity / kMinCell / 2 + 1
+      : kPacked ? kPackedCapacity / (8 * sizeof(ValueType)) / 2 + 1
+      : (szChunk - 3 * sizeof(NodeId)) / sizeof(Pair) / 2 - 1;
     static_assert(l >= 2 && l < kLengthMax);
+    using Entries = Set<Pair, 2 * l, kCheckPolicy>;
     NodeId prev = 0;
     NodeId next = 0;
-    Set<Pair, 2 * l> entries;
+    // being sized for the smallest cells, the entries of encoded nodes are kept on the heap, and copied only as far as used.
+    std::conditional_t<kEncoded, Entries *, Entries> entries;
+  };
+  struct BufferPayload {
+    static constexpr size_t m = (szChunk - 2 * sizeof(size_t)) / sizeof(Message);
+    static_assert(m >= 1 && m < kLengthMax);
+    NodeId next = 0;
+    /// the messages, then empty slots. there is no length field, so that adding a message only changes the bytes of its slot.
+    Message messages[m] = {};
   };
   union NodePayload {
     IndexPayload index;
     RecordPayload record;
+    BufferPayload buffer;
     NodePayload () {} // NOLINT
   };
   struct Node : public ManagedObject<Node, szChunk> {
@@ -95,62 +307,557 @@ class BpTree {
     NodeType type;
     NodePayload payload;
     char _end[0];
-    static_assert(sizeof(NodeType) + sizeof(NodePayload) <= szChunk);
+    static_assert(kEncoded || sizeof(NodeType) + sizeof(NodePayload) <= szChunk);
+    static_assert(sizeof(NodeType) + sizeof(IndexPayload) <= szChunk && sizeof(NodeType) + sizeof(BufferPayload) <= szChunk);
 
     // dynamically type-safe accessors
-    auto leaf () -> bool & { AK_ASSERT(type != RECORD); return payload.index.leaf; }
-    auto children () -> Array<NodeId, 2 * IndexPayload::k> & { AK_ASSERT(type != RECORD); return payload.index.children; }
-    auto splits () -> Set<Pair, 2 * IndexPayload::k> & { AK_ASSERT(type != RECORD); return payload.index.splits; }
+    auto isIndex () const -> bool { return type == ROOT || type == INTERMEDIATE; }
+    auto leaf () -> bool & { AK_ASSERT(isIndex()); return payload.index.leaf; }
+    auto header () -> RootHeader & { AK_ASSERT(type == ROOT); return payload.index.header; }
+    auto children () -> Array<NodeId, 2 * IndexPayload::k, kCheckPolicy> & { AK_ASSERT(isIndex()); return payload.index.children; }
+    auto splits () -> Set<Separator, 2 * IndexPayload::k, kCheckPolicy> & { AK_ASSERT(isIndex()); return payload.index.splits; }
+    auto counts () -> Array<size_t, 2 * IndexPayload::k, kCheckPolicy> & { AK_ASSERT(isIndex()); return payload.index.counts; }
+    /// the number of entries in the subtree of the child at ix.
+    auto countAt (size_t ix) -> size_t { return counts()[ix] - countBefore(ix); }
+    /// the number of entries in the subtrees of the children before ix.
+    auto countBefore (size_t ix) -> size_t { return ix == 0 ? 0 : counts()[ix - 1]; }
+    auto setCount (size_t ix, size_t count) -> void { addCount(ix, count - countAt(ix)); }
+    auto addCount (size_t ix, ptrdiff_t delta) -> void {
+      for (size_t i = ix; i < counts().length; ++i) counts()[i] += delta;
+    }
+    auto insertCount (size_t ix, size_t count) -> void {
+      counts().insert(countBefore(ix), ix);
+      addCount(ix, count);
+    }
+    auto removeCount (size_t ix) -> void {
+      const size_t count = countAt(ix);
+      counts().removeAt(ix);
+      addCount(ix, -count);
+    }
+    /// @returns the child the index-th entry of the subtree is in, and makes index relative to that child.
+    auto childOf (size_t &index) -> size_t {
+      auto &counts = this->counts();
+      size_t ix = std::upper_bound(counts.content, counts.content + counts.length, index) - counts.content;
+      index -= countBefore(ix);
+      return ix;
+    }
+    /// turns the running totals of counts into the counts of the children, and back, around moves of children between nodes.
+    auto unaccumulateCounts () -> void {
+      for (size_t i = counts().length; i-- > 1;) counts()[i] -= counts()[i - 1];
+    }
+    auto accumulateCounts () -> void {
+      for (size_t i = 1; i < counts().length; ++i) counts()[i] += counts()[i - 1];
+    }
     auto prev () -> NodeId & { AK_ASSERT(type == RECORD); return payload.record.prev; }
     auto next () -> NodeId & { AK_ASSERT(type == RECORD); return payload.record.next; }
-    auto entries () -> Set<Pair, 2 * RecordPayload::l> & { AK_ASSERT(type == RECORD); return payload.record.entries; }
+    auto entries () -> typename RecordPayload::Entries & {
+      AK_ASSERT(type == RECORD);
+      if constexpr (kEncoded) {
+        if (payload.record.entries == nullptr) decodeEntries_();
+        return *payload.record.entries;
+      } else {
+        return payload.record.entries;
+      }
+    }
+    auto nextPage () -> NodeId & { AK_ASSERT(type == BUFFER); return payload.buffer.next; }
+    auto messages () -> Message (&)[BufferPayload::m] { AK_ASSERT(type == BUFFER); return payload.buffer.messages; }
 
-    Node (BpTree &tree, NodeType type) : ManagedObject<Node, szChunk>(tree.file_), type(type) {
+   private:
+    /// the page an encoded record node is read from. it is decoded into entries on the first call to entries(), see entryAt.
+    std::shared_ptr<char[]> page_;
+
+    Node (File<szChunk> &file, size_t id, NodeType type) : ManagedObject<Node, szChunk>(file, id), type(type) { initPayload_(false); }
+    auto initPayload_ (bool withEntries) -> void {
       if (type == RECORD) {
         new(&payload.record) RecordPayload;
+        if constexpr (kEncoded) payload.record.entries = withEntries ? copyEntries_(nullptr) : nullptr;
+      } else if (type == BUFFER) {
+        new(&payload.buffer) BufferPayload;
       } else {
         new(&payload.index) IndexPayload;
       }
     }
+    /// @returns a copy of the entries in use of from on the heap, or empty entries if from is null.
+    static auto copyEntries_ (const typename RecordPayload::Entries *from) -> typename RecordPayload::Entries * {
+      // the entries past length are left uninitialized, as they would be by memcpy in ManagedObject::get.
+      auto *res = static_cast<typename RecordPayload::Entries *>(::operator new(sizeof(typename RecordPayload::Entries)));
+      res->length = from == nullptr ? 0 : from->length;
+      if (from != nullptr) memcpy(res->content, from->content, from->length * sizeof(Pair));
+      return res;
+    }
+    auto copyFrom_ (const Node &that) -> void {
+      memcpy(_start, that._start, that.rawSize_());
+      if constexpr (kEncoded) {
+        page_ = that.page_;
+        if (type == RECORD && that.payload.record.entries != nullptr) payload.record.entries = copyEntries_(that.payload.record.entries);
+      }
+    }
+    auto freeEntries_ () -> void {
+      if constexpr (kEncoded) {
+        if (type == RECORD) ::operator delete(payload.record.entries);
+      }
+    }
+    /// the bytes of the node in use, which encoded trees store as they are for index and buffer nodes.
+    auto rawSize_ () const -> size_t {
+      size_t payloadSize = type == RECORD ? sizeof(RecordPayload) : type == BUFFER ? sizeof(BufferPayload) : sizeof(IndexPayload);
+      return reinterpret_cast<const char *>(&payload) - _start + payloadSize;
+    }
+    auto encodeSlotted_ (char *page) -> void {
+      AK_ASSERT(fill() <= kSlottedCapacity);
+      memset(page, 0, szChunk);
+      auto &entries = this->entries();
+      memcpy(page, &type, sizeof(NodeType));
+      memcpy(page + kPrevAt, &payload.record.prev, sizeof(NodeId));
+      memcpy(page + kNextAt, &payload.record.next, sizeof(NodeId));
+      size_t top = szChunk;
+      for (size_t i = 0; i < entries.length; ++i) {
+        top -= cellSize_(entries.content[i]) - sizeof(Slot);
+        writeCell_(page, top, entries.content[i]);
+        setSlot_(page, kSlottedHeader + i * sizeof(Slot), top);
+      }
+      setSlot_(page, kLengthAt, entries.length);
+      setSlot_(page, kFillAt, szChunk - top + entries.length * sizeof(Slot));
+      setSlot_(page, kTopAt, top);
+    }
+    auto encodePacked_ (char *page) -> void {
+      AK_ASSERT(fill() <= kPackedCapacity);
+      memset(page, 0, szChunk);
+      auto &entries = this->entries();
+      memcpy(page, &type, sizeof(NodeType));
+      memcpy(page + kPrevAt, &payload.record.prev, sizeof(NodeId));
+      memcpy(page + kNextAt, &payload.record.next, sizeof(NodeId));
+      setSlot_(page, kLengthAt, entries.length);
+      if (entries.length == 0) return;
+      const KeyType &base = entries.content[0].key;
+      const size_t width = widthOf_(base, entries.content[entries.length - 1].key);
+      setSlot_(page, kWidthAt, width);
+      memcpy(page + kBaseAt, &base, sizeof(KeyType));
+      for (size_t i = 0; i < entries.length; ++i) {
+        packKey_(page, i, width, deltaOf_(entries.content[i].key, base));
+        memcpy(page + valueAt_(i), &entries.content[i].value, sizeof(ValueType));
+      }
+    }
+    /// sets the key at ix of a packed page to base + delta.
+    static auto packKey_ (char *page, size_t ix, size_t width, uint64_t delta) -> void {
+      // the bits around the key are left as they are, so that the word may reach into the next keys or the values.
+      char *at = page + kPackedHeader + ix * width / 8;
+      const size_t shift = ix * width % 8;
+      uint64_t word;
+      memcpy(&word, at, sizeof(uint64_t));
+      word = (word & ~(maskOf_(width) << shift)) | delta << shift;
+      memcpy(at, &word, sizeof(uint64_t));
+    }
+    /// moves the entries of a packed page in [begin, end) by one, towards the end if forward or the start otherwise.
+    static auto shiftPacked_ (char *page, size_t begin, size_t end, size_t width, bool forward) -> void {
+      if (begin == end) return;
+      if (forward) {
+        for (size_t i = end; i-- > begin;) packKey_(page, i + 1, width, unpackKey_(page, i, width));
+        memmove(page + valueAt_(end), page + valueAt_(end - 1), (end - begin) * sizeof(ValueType));
+      } else {
+        for (size_t i = begin; i < end; ++i) packKey_(page, i - 1, width, unpackKey_(page, i, width));
+        memmove(page + valueAt_(end - 2), page + valueAt_(end - 1), (end - begin) * sizeof(ValueType));
+      }
+    }
+    static auto unpackKey_ (const char *page, size_t ix, size_t width) -> uint64_t {
+      uint64_t word;
+      memcpy(&word, page + kPackedHeader + ix * width / 8, sizeof(uint64_t));
+      return (word >> (ix * width % 8)) & maskOf_(width);
+    }
+    static auto maskOf_ (size_t width) -> uint64_t { return width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1; }
+    static auto valueAt_ (size_t ix) -> size_t { return szChunk - (ix + 1) * sizeof(ValueType); }
+    auto baseOf_ (const char *page) -> KeyType {
+      KeyType res;
+      memcpy(&res, page + kBaseAt, sizeof(KeyType));
+      return res;
+    }
+    /// the bit width of the keys of a packed record node.
+    auto keyWidth_ () -> size_t {
+      if (payload.record.entries == nullptr) return slotAt_(page_.get(), kWidthAt);
+      const auto &entries = *payload.record.entries;
+      return entries.length == 0 ? 0 : widthOf_(entries.content[0].key, entries.content[entries.length - 1].key);
+    }
+    static auto slotAt_ (const char *page, size_t at) -> size_t {
+      Slot res;
+      memcpy(&res, page + at, sizeof(Slot));
+      return res;
+    }
+    static auto setSlot_ (char *page, size_t at, size_t value) -> void {
+      Slot slot = value;
+      memcpy(page + at, &slot, sizeof(Slot));
+    }
+    static auto writeCell_ (char *page, size_t offset, const Pair &entry) -> void {
+      size_t n = Cell<KeyType>::write(entry.key, page + offset);
+      Cell<ValueType>::write(entry.value, page + offset + n);
+    }
+    /// makes page_ private to this node before it is changed, as copies of the node share it.
+    auto ownPage_ () -> void {
+      if (page_.use_count() == 1) return;
+      auto page = std::make_shared_for_overwrite<char[]>(szChunk);
+      memcpy(page.get(), page_.get(), szChunk);
+      page_ = std::move(page);
+    }
+    /// fills page with the whole chunk of the node, zero-padded, so that get can always read a full chunk.
+    auto writePage_ (char *page) -> void {
+      if (type != RECORD) {
+        memset(page, 0, szChunk);
+        memcpy(page, _start, rawSize_());
+      } else if (payload.record.entries == nullptr) {
+        // not decoded, so only prev and next may have changed.
+        memcpy(page, page_.get(), szChunk);
+        memcpy(page + kPrevAt, &payload.record.prev, sizeof(NodeId));
+        memcpy(page + kNextAt, &payload.record.next, sizeof(NodeId));
+      } else if constexpr (kPacked) {
+        encodePacked_(page);
+      } else {
+        encodeSlotted_(page);
+      }
+    }
+    auto pageLength_ () -> size_t { return slotAt_(page_.get(), kLengthAt); }
+    auto decodeAt_ (size_t ix, Pair &entry) -> void {
+      if constexpr (kPacked) {
+        const char *page = page_.get();
+        entry.key = keyOf_(baseOf_(page), unpackKey_(page, ix, slotAt_(page, kWidthAt)));
+        memcpy(&entry.value, page + valueAt_(ix), sizeof(ValueType));
+        return;
+      }
+      size_t offset = slotAt_(page_.get(), kSlottedHeader + ix * sizeof(Slot));
+      size_t n = Cell<KeyType>::read(entry.key, page_.get() + offset);
+      Cell<ValueType>::read(entry.value, page_.get() + offset + n);
+    }
+    auto decodeEntries_ () -> void {
+      auto *entries = copyEntries_(nullptr);
+      entries->length = pageLength_();
+      if constexpr (kPacked) {
+        // the width and base are read once, and each key is a load, a shift and a mask, which the compiler unrolls.
+        const char *page = page_.get();
+        const size_t width = slotAt_(page, kWidthAt);
+        const KeyType base = baseOf_(page);
+        for (size_t i = 0; i < entries->length; ++i) {
+          entries->content[i].key = keyOf_(base, unpackKey_(page, i, width));
+          memcpy(&entries->content[i].value, page + valueAt_(i), sizeof(ValueType));
+        }
+      } else {
+        for (size_t i = 0; i < entries->length; ++i) decodeAt_(i, entries->content[i]);
+      }
+      payload.record.entries = entries;
+      page_.reset();
+    }
+   public:
+    Node (BpTree &tree, NodeType type) : ManagedObject<Node, szChunk>(tree.file_), type(type) { initPayload_(true); }
+    Node (const Node &that) : ManagedObject<Node, szChunk>(that) { copyFrom_(that); }
+    Node (Node &&that) noexcept : ManagedObject<Node, szChunk>(that) {
+      memcpy(_start, that._start, that.rawSize_());
+      if constexpr (kEncoded) {
+        page_ = std::move(that.page_);
+        if (type == RECORD) that.payload.record.entries = nullptr;
+      }
+    }
+    auto operator= (const Node &that) -> Node & {
+      if (this == &that) return *this;
+      freeEntries_();
+      ManagedObject<Node, szChunk>::operator=(that);
+      copyFrom_(that);
+      return *this;
+    }
     ~Node () {
+      freeEntries_();
       if (type == RECORD) {
         payload.record.~RecordPayload();
+      } else if (type == BUFFER) {
+        payload.buffer.~BufferPayload();
       } else {
         payload.index.~IndexPayload();
       }
     }
 
-    static auto root (BpTree &tree) -> Node { return Node::get(tree.file_, 0); }
-
-    auto halfLimit () -> size_t {
-      return type == RECORD ? RecordPayload::l : IndexPayload::k;
+    // encoded trees read and write record nodes in their own format, and the other nodes as ManagedObject does.
+    static auto get (File<szChunk> &file, size_t id, SnapshotId snapshot = kLatestVersion) -> Node {
+      if constexpr (!kEncoded) {
+        return ManagedObject<Node, szChunk>::get(file, id, snapshot);
+      } else {
+        auto page = std::make_shared_for_overwrite<char[]>(szChunk);
+        file.get(page.get(), id, szChunk, snapshot);
+        NodeType type;
+        memcpy(&type, page.get(), sizeof(NodeType));
+        Node res(file, id, type);
+        if (type == RECORD) {
+          memcpy(&res.payload.record.prev, page.get() + kPrevAt, sizeof(NodeId));
+          memcpy(&res.payload.record.next, page.get() + kNextAt, sizeof(NodeId));
+          res.page_ = std::move(page);
+        } else {
+          memcpy(res._start, page.get(), res.rawSize_());
+        }
+        return res;
+      }
+    }
+    auto save () -> void {
+      if constexpr (!kEncoded) {
+        ManagedObject<Node, szChunk>::save();
+      } else {
+        if (this->id_ != -1) throw Exception("Already saved");
+        char page[szChunk];
+        writePage_(page);
+        this->id_ = this->file_->push(page, szChunk);
+      }
     }
+    auto update () -> void {
+      if constexpr (!kEncoded) {
+        ManagedObject<Node, szChunk>::update();
+      } else {
+        if (this->id_ == -1) throw Exception("Not saved");
+        if (type != RECORD) {
+          this->file_->set(_start, this->id_, rawSize_());
+          return;
+        }
+        if constexpr (kPacked) {
+          // the node goes back to its page, so that the appends that follow go to the page in place, see insertEntry.
+          if (payload.record.entries != nullptr) {
+            auto page = std::make_shared_for_overwrite<char[]>(szChunk);
+            writePage_(page.get());
+            this->file_->set(page.get(), this->id_, szChunk);
+            freeEntries_();
+            payload.record.entries = nullptr;
+            page_ = std::move(page);
+            return;
+          }
+        }
+        char page[szChunk];
+        writePage_(page);
+        this->file_->set(page, this->id_, szChunk);
+      }
+    }
+    /// @returns the entry at ix of a record node, decoding only this entry if the node is encoded and not decoded yet.
+    auto entryAt (size_t ix) -> Pair {
+      AK_ASSERT(type == RECORD);
+      if constexpr (kEncoded) {
+        if (payload.record.entries == nullptr) {
+          AK_ASSERT(ix < pageLength_());
+          Pair res;
+          decodeAt_(ix, res);
+          return res;
+        }
+      }
+      return entries()[ix];
+    }
+    /// @returns the index of the first entry of a record node for which less does not hold, as std::partition_point.
+    template <typename Less>
+    auto partitionPoint (const Less &less) -> size_t {
+      AK_ASSERT(type == RECORD);
+      if constexpr (kEncoded) {
+        if (payload.record.entries == nullptr) {
+          size_t lo = 0, hi = pageLength_();
+          while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (less(entryAt(mid))) {
+              lo = mid + 1;
+            } else {
+              hi = mid;
+            }
+          }
+          return lo;
+        }
+      }
+      auto &entries = this->entries();
+      return std::partition_point(entries.content, entries.content + entries.length, less) - entries.content;
+    }
+    /**
+     * inserts entry into a record node as Set::insert, into the page itself if the node is not decoded and the cell fits, or for
+     * packed nodes, if the key is within the width of the others from the base.
+     */
+    auto insertEntry (const Pair &entry) -> void {
+      AK_ASSERT(type == RECORD);
+      if constexpr (kSlotted) {
+        if (payload.record.entries == nullptr) {
+          size_t length = pageLength_(), size = cellSize_(entry), top = slotAt_(page_.get(), kTopAt);
+          if (kSlottedHeader + length * sizeof(Slot) + size <= top) {
+            size_t ix = partitionPoint([&entry] (const Pair &e) { return e < entry; });
+            ownPage_();
+            char *page = page_.get(), *slot = page + kSlottedHeader + ix * sizeof(Slot);
+            top -= size - sizeof(Slot);
+            writeCell_(page, top, entry);
+            memmove(slot + sizeof(Slot), slot, (length - ix) * sizeof(Slot));
+            setSlot_(page, slot - page, top);
+            setSlot_(page, kLengthAt, length + 1);
+            setSlot_(page, kFillAt, slotAt_(page, kFillAt) + size);
+            setSlot_(page, kTopAt, top);
+            return;
+          }
+        }
+      } else if constexpr (kPacked) {
+        if (payload.record.entries == nullptr) {
+          const size_t length = pageLength_(), width = slotAt_(page_.get(), kWidthAt);
+          const KeyType base = baseOf_(page_.get());
+          if (length > 0 && !(entry.key < base) && (deltaOf_(entry.key, base) & ~maskOf_(width)) == 0 && packedFill_(length + 1, width) <= kPackedCapacity) {
+            size_t ix = partitionPoint([&entry] (const Pair &e) { return e < entry; });
+            ownPage_();
+            char *page = page_.get();
+            shiftPacked_(page, ix, length, width, true);
+            packKey_(page, ix, width, deltaOf_(entry.key, base));
+            memcpy(page + valueAt_(ix), &entry.value, sizeof(ValueType));
+            setSlot_(page, kLengthAt, length + 1);
+            return;
+          }
+        }
+      }
+      entries().insert(entry);
+    }
+    /**
+     * removes the entry target stands for from a record node, from the page itself if the node is not decoded. packed pages keep
+     * their base and width, which may then be wider than the keys left need until the node is encoded again.
+     * @returns false if there is no such entry.
+     */
+    auto removeEntry (const Separator &target) -> bool {
+      AK_ASSERT(type == RECORD);
+      const size_t length = this->length();
+      size_t ix = partitionPoint([&target] (const Pair &e) { return precedes_(e, target); });
+      if (ix >= length || !matches_(entryAt(ix), target)) return false;
+      if constexpr (kPacked) {
+        if (payload.record.entries == nullptr) {
+          ownPage_();
+          shiftPacked_(page_.get(), ix + 1, length, slotAt_(page_.get(), kWidthAt), false);
+          setSlot_(page_.get(), kLengthAt, length - 1);
+          return true;
+        }
+      }
+      if constexpr (kSlotted) {
+        if (payload.record.entries == nullptr) {
+          size_t size = fillAt(ix);
+          ownPage_();
+          char *page = page_.get(), *slot = page + kSlottedHeader + ix * sizeof(Slot);
+          // the cell is left as a hole unless it is the first one.
+          if (slotAt_(page, slot - page) == slotAt_(page, kTopAt)) setSlot_(page, kTopAt, slotAt_(page, kTopAt) + size - sizeof(Slot));
+          memmove(slot, slot + sizeof(Slot), (length - ix - 1) * sizeof(Slot));
+          setSlot_(page, kLengthAt, length - 1);
+          setSlot_(page, kFillAt, slotAt_(page, kFillAt) - size);
+          return true;
+        }
+      }
+      entries().removeAt(ix);
+      return true;
+    }
+    static auto root (BpTree &tree, SnapshotId snapshot = kLatestVersion) -> Node {
+      ++tree.stats_.nodesRead;
+      return Node::get(tree.file_, 0, snapshot);
+    }
+
     auto length () -> size_t {
-      return type == RECORD ? payload.record.entries.length : payload.index.children.length;
+      if constexpr (kEncoded) {
+        if (type == RECORD && payload.record.entries == nullptr) return pageLength_();
+      }
+      return type == RECORD ? entries().length : payload.index.children.length;
+    }
+    /**
+     * how full the node is: its number of children or entries, or for slotted record nodes, the bytes of its entries, and for
+     * packed ones, the bits of its entries, all of them as wide as the widest key.
+     */
+    auto fill () -> size_t {
+      if constexpr (kPacked) {
+        if (type == RECORD) return packedFill_(length(), keyWidth_());
+      }
+      if constexpr (kSlotted) {
+        if (type == RECORD) {
+          if (payload.record.entries == nullptr) return slotAt_(page_.get(), kFillAt);
+          size_t res = 0;
+          for (size_t i = 0; i < entries().length; ++i) res += cellSize_(entries().content[i]);
+          return res;
+        }
+      }
+      return length();
+    }
+    /// the fill of the child or entry at ix.
+    auto fillAt (size_t ix) -> size_t {
+      if constexpr (kPacked) {
+        if (type == RECORD) return packedFill_(1, keyWidth_());
+      }
+      if constexpr (kSlotted) {
+        if (type == RECORD) return cellSize_(entryAt(ix));
+      }
+      return 1;
     }
-    auto shouldSplit () -> bool { return length() == 2 * halfLimit(); }
-    auto shouldMerge () -> bool { return length() < halfLimit(); }
-    auto lowerBound () -> Pair {
-      return type == RECORD ? payload.record.entries[0] : payload.index.splits[0];
+    /// the fill of a record node once entry is inserted into it.
+    auto fillWith (const Pair &entry) -> size_t {
+      if constexpr (kPacked) {
+        if (length() == 0) return packedFill_(1, 0);
+        return packedFill_(length() + 1, widthOf_(std::min(entryAt(0).key, entry.key), std::max(entryAt(length() - 1).key, entry.key)));
+      }
+      if constexpr (kSlotted) return fill() + cellSize_(entry);
+      return fill() + 1;
+    }
+    auto maxFill () -> size_t {
+      if (type != RECORD) return 2 * IndexPayload::k - 1;
+      return kSlotted ? kSlottedCapacity : kPacked ? kPackedCapacity : 2 * RecordPayload::l - 1;
+    }
+    auto halfFill () -> size_t { return (maxFill() + 1) / 2; }
+    auto shouldSplit () -> bool { return fill() > maxFill(); }
+    auto lowerBound () -> Separator {
+      return type == RECORD ? separatorOf_(entryAt(0)) : payload.index.splits[0];
+    }
+    /// the number of entries in the subtree of this node.
+    auto size () -> size_t {
+      if (type == RECORD) return length();
+      return payload.index.counts.length == 0 ? 0 : payload.index.counts[payload.index.counts.length - 1];
     }
   };
 
+  /// the snapshots not released yet, which refer to this tree.
+  size_t liveSnapshots_ = 0;
+  // see setWriteBuffer. pending_ holds the buffered messages in the order of arrival, and pendingByKey_ their indices by key.
+  size_t writeBufferCapacity_ = 0;
+  std::vector<Message> pending_;
+  std::multimap<KeyType, size_t> pendingByKey_;
+  /**
+   * the change the buffered messages make to size(), see pendingSizeDelta_: sizeDelta_ is the sum of keyDeltas_, the changes on
+   * each key but those in staleKeys_, whose messages depend on what the tree holds and which are to be looked up again.
+   */
+  ptrdiff_t sizeDelta_ = 0;
+  std::map<KeyType, ptrdiff_t> keyDeltas_;
+  std::set<KeyType> staleKeys_;
+  std::vector<NodeId> bufferPages_;
+  /// the path from the root to the last record node while inserts append to the tree, see append_. empty otherwise.
+  std::vector<Node> rightmost_;
+
   // helper functions
-  auto ixInsert_ (const Pair &entry, Node &node) -> size_t {
-    AK_ASSERT(node.type != RECORD);
+  /// reads a node, counting it in stats_.
+  auto node_ (NodeId id, SnapshotId snapshot = kLatestVersion) -> Node {
+    ++stats_.nodesRead;
+    return Node::get(file_, id, snapshot);
+  }
+  auto ixInsert_ (const Separator &entry, Node &node) -> size_t {
+    AK_ASSERT(node.isIndex());
     auto &splits = node.splits();
     size_t ix = std::upper_bound(splits.content, splits.content + splits.length, entry) - splits.content;
     return ix == 0 ? ix : ix - 1;
   }
-  auto splitRoot_ (Node &node) -> void {
+  /// the number of children or entries a split leaves in node, so that about leftFill of its fill stays there.
+  static auto countToKeep_ (Node &node, double leftFill) -> size_t {
+    const size_t length = node.length();
+    size_t res = std::clamp<size_t>(countForFill_(node, static_cast<size_t>(node.fill() * leftFill), true), 1, length - 1);
+    if constexpr (kPacked) {
+      // a key far from the others widens all keys of the node, so that a half may not fit either. the key goes to a node of its
+      // own then, as the keys on either side of it fit together before it came.
+      if (node.type == RECORD) {
+        while (res > 1 && packedFill_(res, widthOf_(node.entryAt(0).key, node.entryAt(res - 1).key)) > node.maxFill()) --res;
+        while (res < length - 1 && packedFill_(length - res, widthOf_(node.entryAt(res).key, node.entryAt(length - 1).key)) > node.maxFill()) ++res;
+      }
+    }
+    return res;
+  }
+  auto splitRoot_ (Node &node, double leftFill) -> void {
     Node left(*this, INTERMEDIATE), right(*this, INTERMEDIATE);
 
     // copy children and splits
-    left.children().copyFrom(node.children(), 0, 0, IndexPayload::k);
-    left.splits().copyFrom(node.splits(), 0, 0, IndexPayload::k);
-    right.children().copyFrom(node.children(), IndexPayload::k, 0, IndexPayload::k);
-    right.splits().copyFrom(node.splits(), IndexPayload::k, 0, IndexPayload::k);
-    left.children().length = left.splits().length = right.children().length = right.splits().length = IndexPayload::k;
+    const size_t length = node.length(), nLeft = countToKeep_(node, leftFill);
+    node.unaccumulateCounts();
+    left.children().copyFrom(node.children(), 0, 0, nLeft);
+    left.splits().copyFrom(node.splits(), 0, 0, nLeft);
+    left.counts().copyFrom(node.counts(), 0, 0, nLeft);
+    right.children().copyFrom(node.children(), nLeft, 0, length - nLeft);
+    right.splits().copyFrom(node.splits(), nLeft, 0, length - nLeft);
+    right.counts().copyFrom(node.counts(), nLeft, 0, length - nLeft);
+    left.children().length = left.splits().length = left.counts().length = nLeft;
+    right.children().length = right.splits().length = right.counts().length = length - nLeft;
+    left.accumulateCounts();
+    right.accumulateCounts();
 
     // set misc properties and save
     left.leaf() = right.leaf() = node.leaf();
@@ -165,25 +872,37 @@ class BpTree {
     node.splits().clear();
     node.splits().insert(left.lowerBound());
     node.splits().insert(right.lowerBound());
+    node.counts().clear();
+    node.counts().push(left.size());
+    node.counts().push(left.size() + right.size());
   }
-  auto split_ (Node &node, Node &parent, size_t ixChild) -> void {
+  /// splits node into itself and a new next node. node keeps leftFill of the fill, which is more than half for appends, see setAppendFill.
+  auto split_ (Node &node, Node &parent, size_t ixChild, double leftFill = 0.5) -> void {
     AK_ASSERT(node.shouldSplit());
 #ifdef AK_DEBUG_BPTREE
     std::cerr << "[Split] " << node.id() << " (parent " << parent.id() << ")" << std::endl;
 #endif
     if (node.type == ROOT) {
       // the split of the root node is a bit different from other nodes. it produces two extra subnodes.
-      splitRoot_(node);
+      ++stats_.rootSplits;
+      splitRoot_(node, leftFill);
       return;
     }
+    ++stats_.splits;
     AK_ASSERT(node.type != ROOT);
 
     // create a new next node
     Node next(*this, node.type);
+    const size_t length = node.length(), nKeep = countToKeep_(node, leftFill);
     if (node.type == INTERMEDIATE) {
-      next.children().copyFrom(node.children(), IndexPayload::k, 0, IndexPayload::k);
-      next.splits().copyFrom(node.splits(), IndexPayload::k, 0, IndexPayload::k);
-      node.children().length = node.splits().length = next.children().length = next.splits().length = IndexPayload::k;
+      node.unaccumulateCounts();
+      next.children().copyFrom(node.children(), nKeep, 0, length - nKeep);
+      next.splits().copyFrom(node.splits(), nKeep, 0, length - nKeep);
+      next.counts().copyFrom(node.counts(), nKeep, 0, length - nKeep);
+      node.children().length = node.splits().length = node.counts().length = nKeep;
+      next.children().length = next.splits().length = next.counts().length = length - nKeep;
+      node.accumulateCounts();
+      next.accumulateCounts();
       next.leaf() = node.leaf();
       next.save();
     } else {
@@ -192,13 +911,14 @@ class BpTree {
       next.prev() = node.id();
       memmove(
         next.entries().content,
-        &node.entries().content[RecordPayload::l],
-        RecordPayload::l * sizeof(node.entries()[0])
+        &node.entries().content[nKeep],
+        (length - nKeep) * sizeof(node.entries()[0])
       );
-      next.entries().length = node.entries().length = RecordPayload::l;
+      next.entries().length = length - nKeep;
+      node.entries().length = nKeep;
       next.save();
       if (next.next() != 0) {
-        Node nextnext = Node::get(file_, next.next());
+        Node nextnext = node_(next.next());
         nextnext.prev() = next.id();
         nextnext.update();
       }
@@ -208,135 +928,267 @@ class BpTree {
     // update the parent node
     parent.children().insert(next.id(), ixChild + 1);
     parent.splits().insert(next.lowerBound());
+    parent.setCount(ixChild, node.size());
+    parent.insertCount(ixChild + 1, next.size());
   }
 
+  /// moves the last n elements of from to the start of to.
   template <typename A, typename B>
-  static auto unshift_ (A &to, B &from, size_t k) -> void {
-    // we now have [b[0],...,b[k-1]] and [a[0]...a[k-2]], want a -> [b[0],...,b[k-1],a[0],...,a[k-2]]
-    to.copyFrom(to, 0, k, k - 1);
-    to.copyFrom(from, 0, 0, k);
-    to.length += from.length;
-    from.length = 0;
+  static auto unshift_ (A &to, B &from, size_t n) -> void {
+    // we now have [b[0],...,b[m-1]] and [a[0]...a[l-1]], want a -> [b[m-n],...,b[m-1],a[0],...,a[l-1]]
+    to.copyFrom(to, 0, n, to.length);
+    to.copyFrom(from, from.length - n, 0, n);
+    to.length += n;
+    from.length -= n;
   }
   template <typename A, typename B>
-  static auto push_ (A &to, B &from, size_t k) -> void {
-    to.copyFrom(from, 0, k - 1, k);
-    to.length += from.length;
-    from.length = 0;
+  static auto unshift_ (A &to, B &from) -> void { unshift_(to, from, from.length); }
+  /// moves the first n elements of from to the end of to.
+  template <typename A, typename B>
+  static auto push_ (A &to, B &from, size_t n) -> void {
+    to.copyFrom(from, 0, to.length, n);
+    to.length += n;
+    from.copyFrom(from, n, 0, from.length - n);
+    from.length -= n;
   }
-  auto merge_ (Node &node, Node &parent, size_t ixChild) -> void {
-    AK_ASSERT(node.shouldMerge());
-#ifdef AK_DEBUG_BPTREE
-    std::cerr << "[Merge] " << node.id() << " (parent " << parent.id() << ")" << std::endl;
-#endif
-    if (node.type == ROOT) {
-      if (node.length() > 1 || node.leaf()) return;
-      Node onlyChild = Node::get(file_, node.children()[0]);
-      memcpy(node._start, onlyChild._start, node._end - node._start);
-      node.type = ROOT;
-      return;
-    }
-    const bool hasPrev = ixChild != 0;
-    const bool hasNext = ixChild != parent.children().length - 1;
-    if (!hasNext) {
-      // don't do anything to the only data node.
-      if (!hasPrev && node.type == RECORD) return;
-      // all index nodes has at least 2 child nodes, except for the root node.
-      AK_ASSERT(hasPrev);
-      Node prev = Node::get(file_, parent.children()[ixChild - 1]);
-      if (prev.length() > prev.halfLimit()) {
-        if (node.type == RECORD) {
-          node.entries().insert(prev.entries().pop());
-        } else {
-          node.children().unshift(prev.children().pop());
-          node.splits().insert(prev.splits().pop());
-        }
-        prev.update();
-        parent.splits()[ixChild] = node.lowerBound();
-        return;
+  template <typename A, typename B>
+  static auto push_ (A &to, B &from) -> void { push_(to, from, from.length); }
+  /// whether a non-root node has too few entries, see setMinFill.
+  auto shouldMerge_ (Node &node) -> bool {
+    return node.fill() < (node.type == RECORD ? minRecordFill_ : minIndexLength_);
+  }
+  /// the number of entries or children at the start of node, or at its end unless fromStart, that make up at least fill, or all of them.
+  static auto countForFill_ (Node &node, size_t fill, bool fromStart) -> size_t {
+    size_t res = 0;
+    for (size_t filled = 0; filled < fill && res < node.length(); ++res) filled += node.fillAt(fromStart ? res : node.length() - 1 - res);
+    return res;
+  }
+  /// the fill of node with the entries or children of next appended.
+  static auto joinedFill_ (Node &node, Node &next) -> size_t {
+    if constexpr (kPacked) {
+      if (node.type == RECORD && node.length() > 0 && next.length() > 0) {
+        return packedFill_(node.length() + next.length(), widthOf_(node.entryAt(0).key, next.entryAt(next.length() - 1).key));
       }
-      AK_ASSERT(prev.length() == prev.halfLimit());
-
-      if (node.type == RECORD) {
-        unshift_(node.entries(), prev.entries(), RecordPayload::l);
-        if (prev.prev() != 0) {
-          Node prevprev = Node::get(file_, prev.prev());
-          prevprev.next() = node.id();
-          prevprev.update();
-        }
-        node.prev() = prev.prev();
-      } else {
-        AK_ASSERT(node.type == INTERMEDIATE);
-        unshift_(node.children(), prev.children(), IndexPayload::k);
-        unshift_(node.splits(), prev.splits(), IndexPayload::k);
-      }
-      parent.splits()[ixChild] = node.lowerBound();
-      parent.children().removeAt(ixChild - 1);
-      parent.splits().removeAt(ixChild - 1);
-      prev.destroy();
-      return;
     }
-    AK_ASSERT(hasNext);
-
-    // FIXME: remove dupe code here
-    Node next = Node::get(file_, parent.children()[ixChild + 1]);
-    if (next.length() > next.halfLimit()) {
+    return node.fill() + next.fill();
+  }
+  /**
+   * the number of entries or children to move to node from the start of next, or from the end of prev, so that it is half full.
+   * packed record nodes take fewer if the keys moved would widen node past its maxFill, and may take none.
+   */
+  static auto countToBorrow_ (Node &node, Node &from, bool fromNext) -> size_t {
+    size_t res = std::min(countForFill_(from, node.halfFill() - node.fill(), fromNext), from.length() - 1);
+    if constexpr (kPacked) {
       if (node.type == RECORD) {
-        node.entries().insert(next.entries().shift());
-      } else {
-        node.children().push(next.children().shift());
-        node.splits().insert(next.splits().shift());
+        auto fits = [&] (size_t n) {
+          KeyType first = fromNext ? node.entryAt(0).key : from.entryAt(from.length() - n).key;
+          KeyType last = fromNext ? from.entryAt(n - 1).key : node.entryAt(node.length() - 1).key;
+          return packedFill_(node.length() + n, widthOf_(first, last)) <= node.maxFill();
+        };
+        while (res > 0 && !fits(res)) --res;
       }
-      next.update();
-      parent.splits()[ixChild + 1] = next.lowerBound();
-      return;
     }
-    AK_ASSERT(next.length() == next.halfLimit());
-
+    return res;
+  }
+  /// replaces the root by its only child, if it is an index node.
+  auto collapseRoot_ (Node &root) -> void {
+    AK_ASSERT(root.type == ROOT);
+    if (root.length() != 1 || root.leaf()) return;
+#ifdef AK_DEBUG_BPTREE
+    std::cerr << "[Collapse] " << root.children()[0] << std::endl;
+#endif
+    ++stats_.collapses;
+    Node onlyChild = node_(root.children()[0]);
+    const RootHeader header = root.header();
+    memcpy(root._start, onlyChild._start, root._end - root._start);
+    root.type = ROOT;
+    root.header() = header;
+    onlyChild.destroy();
+  }
+  /// merges next, the child right after node in parent, into node.
+  auto absorbNext_ (Node &node, Node &next, Node &parent, size_t ixChild) -> void {
+    ++stats_.merges;
     if (node.type == RECORD) {
-      push_(node.entries(), next.entries(), RecordPayload::l);
+      push_(node.entries(), next.entries());
       if (next.next() != 0) {
-        Node nextnext = Node::get(file_, next.next());
+        Node nextnext = node_(next.next());
         nextnext.prev() = node.id();
         nextnext.update();
       }
       node.next() = next.next();
     } else {
       AK_ASSERT(node.type == INTERMEDIATE);
-      push_(node.children(), next.children(), IndexPayload::k);
-      push_(node.splits(), next.splits(), IndexPayload::k);
+      node.unaccumulateCounts();
+      next.unaccumulateCounts();
+      push_(node.children(), next.children());
+      push_(node.splits(), next.splits());
+      push_(node.counts(), next.counts());
+      node.accumulateCounts();
     }
 
+    parent.setCount(ixChild, node.size());
     parent.children().removeAt(ixChild + 1);
     parent.splits().removeAt(ixChild + 1);
+    parent.removeCount(ixChild + 1);
     next.destroy();
   }
+  /// moves the first n entries or children of next, the child right after node in parent, to node.
+  auto borrowFromNext_ (Node &node, Node &next, Node &parent, size_t ixChild, size_t n) -> void {
+    ++stats_.borrows;
+    if (node.type == RECORD) {
+      push_(node.entries(), next.entries(), n);
+    } else {
+      node.unaccumulateCounts();
+      next.unaccumulateCounts();
+      push_(node.children(), next.children(), n);
+      push_(node.splits(), next.splits(), n);
+      push_(node.counts(), next.counts(), n);
+      node.accumulateCounts();
+      next.accumulateCounts();
+    }
+    parent.splits()[ixChild + 1] = next.lowerBound();
+    parent.setCount(ixChild, node.size());
+    parent.setCount(ixChild + 1, next.size());
+  }
+  /// moves the last n entries or children of prev, the child right before node in parent, to node.
+  auto borrowFromPrev_ (Node &node, Node &prev, Node &parent, size_t ixChild, size_t n) -> void {
+    ++stats_.borrows;
+    if (node.type == RECORD) {
+      unshift_(node.entries(), prev.entries(), n);
+    } else {
+      node.unaccumulateCounts();
+      prev.unaccumulateCounts();
+      unshift_(node.children(), prev.children(), n);
+      unshift_(node.splits(), prev.splits(), n);
+      unshift_(node.counts(), prev.counts(), n);
+      node.accumulateCounts();
+      prev.accumulateCounts();
+    }
+    parent.splits()[ixChild] = node.lowerBound();
+    parent.setCount(ixChild - 1, prev.size());
+    parent.setCount(ixChild, node.size());
+  }
+  /// removes the empty child at ixChild from node.
+  auto removeEmptyChild_ (Node &child, Node &node, size_t ixChild) -> void {
+    AK_ASSERT(child.length() == 0);
+    if (child.type == RECORD) {
+      if (child.prev() != 0) {
+        Node prev = node_(child.prev());
+        prev.next() = child.next();
+        prev.update();
+      }
+      if (child.next() != 0) {
+        Node next = node_(child.next());
+        next.prev() = child.prev();
+        next.update();
+      }
+    }
+    child.destroy();
+    node.children().removeAt(ixChild);
+    node.splits().removeAt(ixChild);
+    node.removeCount(ixChild);
+    if (node.type == ROOT && node.length() == 0) node.leaf() = true;
+  }
+  /// merges the underfull children of node bottom-up, until all nodes are at least half full again.
+  auto rebalance_ (Node &node) -> void {
+    AK_ASSERT(node.isIndex());
+    if (!node.leaf()) {
+      for (size_t i = 0; i < node.length(); ++i) {
+        Node child = node_(node.children()[i]);
+        rebalance_(child);
+        node.setCount(i, child.size());
+        child.update();
+      }
+    }
+    for (size_t i = 0; i < node.length(); ++i) {
+      Node child = node_(node.children()[i]);
+      if (!refill_(child, node, i)) break;
+      child.update();
+    }
+  }
+  /**
+   * merges the child at ixChild of node with its next siblings, or borrows from them, until it is at least half full.
+   * the last child has no next to merge with, so it goes to its previous sibling instead.
+   * @returns false if the child is merged into its previous sibling, and thus destroyed.
+   */
+  auto refill_ (Node &child, Node &node, size_t ixChild) -> bool {
+    while (child.fill() < child.halfFill() && ixChild + 1 < node.length()) {
+      Node next = node_(node.children()[ixChild + 1]);
+      if (joinedFill_(child, next) <= child.maxFill()) {
+        absorbNext_(child, next, node, ixChild);
+        continue;
+      }
+      size_t n = countToBorrow_(child, next, true);
+      if (n == 0) break;
+      borrowFromNext_(child, next, node, ixChild, n);
+      next.update();
+    }
+    if (child.fill() < child.halfFill() && ixChild > 0) {
+      Node prev = node_(node.children()[ixChild - 1]);
+      if (joinedFill_(prev, child) <= child.maxFill()) {
+        absorbNext_(prev, child, node, ixChild - 1);
+        prev.update();
+        return false;
+      }
+      size_t n = countToBorrow_(child, prev, false);
+      if (n == 0) return true;
+      borrowFromPrev_(child, prev, node, ixChild, n);
+      prev.update();
+    }
+    return true;
+  }
 
   // FIXME: lengthy function name
-  auto addValuesToVectorForAllKeyFrom_ (std::vector<ValueType> &vec, const KeyType &key, Node node, int first) -> void {
+  auto addValuesToVectorForAllKeyFrom_ (std::vector<ValueType> &vec, const KeyType &key, Node node, int first, SnapshotId snapshot) -> void {
     // we need to declare i outside to see if we have advanced to the last elemene
     int i = first;
-    for (; i < node.length() && equals(node.entries()[i].key, key); ++i) vec.push_back(node.entries()[i].value);
-    if (i == node.length() && node.next() != 0) addValuesToVectorForAllKeyFrom_(vec, key, Node::get(file_, node.next()), 0);
+    for (; i < node.length(); ++i) {
+      Pair entry = node.entryAt(i);
+      if (!equals(entry.key, key)) break;
+      vec.push_back(entry.value);
+    }
+    if (!kUnique && i == node.length() && node.next() != 0) addValuesToVectorForAllKeyFrom_(vec, key, node_(node.next(), snapshot), 0, snapshot);
   }
-  auto addEntriesToVector_ (std::vector<std::pair<KeyType, ValueType>> &vec, Node node) -> void {
-    for (int i = 0; i < node.length(); ++i) vec.emplace_back(node.entries()[i].key, node.entries()[i].value);
-    if (node.next() != 0) addEntriesToVector_(vec, Node::get(file_, node.next()));
+  auto addEntriesToVector_ (std::vector<std::pair<KeyType, ValueType>> &vec, Node node, SnapshotId snapshot) -> void {
+    for (int i = 0; i < node.length(); ++i) {
+      Pair entry = node.entryAt(i);
+      vec.emplace_back(entry.key, entry.value);
+    }
+    if (node.next() != 0) addEntriesToVector_(vec, node_(node.next(), snapshot), snapshot);
   }
-  auto findFirstChildWithKey_ (const KeyType &key, Node &node) -> std::pair<Node, std::optional<Node>> {
-    AK_ASSERT(node.type != RECORD);
+  auto findFirstChildWithKey_ (const KeyType &key, Node &node, SnapshotId snapshot) -> std::pair<Node, std::optional<Node>> {
+    AK_ASSERT(node.isIndex());
+    if constexpr (kUnique) {
+      // a unique key can only be in the last child starting no later than it.
+      size_t ixGreater = std::upper_bound(node.splits().content, node.splits().content + node.length(), key, KeyComparator_()) - node.splits().content;
+      size_t ix = ixGreater == 0 ? ixGreater : ixGreater - 1;
+      return { node_(node.children()[ix], snapshot), std::nullopt };
+    }
     size_t ixGreater = std::upper_bound(node.splits().content, node.splits().content + node.length(), key, KeyComparatorLess_()) - node.splits().content;
-    std::optional<Node> cdr = (ixGreater < node.length() && equals(node.splits()[ixGreater].key, key)) ? std::optional<Node>(Node::get(file_, node.children()[ixGreater])) : std::nullopt;
+    std::optional<Node> cdr = (ixGreater < node.length() && equals(node.splits()[ixGreater].key, key)) ? std::optional<Node>(node_(node.children()[ixGreater], snapshot)) : std::nullopt;
     size_t ix = ixGreater == 0 ? ixGreater : ixGreater - 1;
-    return std::make_pair(Node::get(file_, node.children()[ix]), cdr);
+    return std::make_pair(node_(node.children()[ix], snapshot), cdr);
   }
 
   // operation functions
-  auto insert_ (const Pair &entry, Node &node) -> void {
+  /**
+   * @returns false if the value of an existing key is overwritten instead, which only happens in unique trees.
+   * appended is set to whether entry went to the end of the last record node, which the nodes on its path then split for.
+   */
+  auto insert_ (const Pair &entry, Node &node, bool &appended) -> bool {
+    appended = false;
     if (node.type == RECORD) {
-      node.entries().insert(entry);
-      AK_ASSERT(node.entries().length <= 2 * RecordPayload::l);
-      return;
+      if constexpr (kUnique) {
+        size_t ix = node.partitionPoint([&entry] (const Pair &e) { return e < entry; });
+        if (ix < node.length() && equals(node.entryAt(ix).key, entry.key)) {
+          node.entries()[ix].value = entry.value;
+          return false;
+        }
+      }
+      node.insertEntry(entry);
+      AK_ASSERT(node.length() <= 2 * RecordPayload::l);
+      appended = node.next() == 0 && !(entry < node.entryAt(node.length() - 1));
+      return true;
     }
     // if this is the first entry of the root, go create a record node.
     if (node.children().length == 0) {
@@ -346,81 +1198,470 @@ class BpTree {
       child.entries().insert(entry);
       child.save();
       node.children().push(child.id());
-      node.splits().insert(entry);
-      return;
+      node.splits().insert(separatorOf_(entry));
+      node.counts().push(1);
+      appended = true;
+      return true;
     }
-    size_t ix = ixInsert_(entry, node);
-    if (entry < node.splits()[ix]) node.splits()[ix] = entry;
-    Node nodeToInsert = Node::get(file_, node.children()[ix]);
-    insert_(entry, nodeToInsert);
+    Separator separator = separatorOf_(entry);
+    size_t ix = ixInsert_(separator, node);
+    if (separator < node.splits()[ix]) node.splits()[ix] = separator;
+    Node nodeToInsert = node_(node.children()[ix]);
+    bool inserted = insert_(entry, nodeToInsert, appended);
     node.splits()[ix] = nodeToInsert.lowerBound();
-    if (nodeToInsert.shouldSplit()) split_(nodeToInsert, node, ix);
+    if (inserted) node.addCount(ix, 1);
+    if (nodeToInsert.shouldSplit()) split_(nodeToInsert, node, ix, appended ? appendFill_ : 0.5);
     nodeToInsert.update();
+    return inserted;
+  }
+  auto insert_ (const Pair &entry, Node &node) -> bool {
+    bool appended;
+    return insert_(entry, node, appended);
+  }
+  /// reads the path from the root to the last record node into rightmost_.
+  auto cacheRightmostPath_ () -> void {
+    rightmost_.clear();
+    Node node = Node::root(*this);
+    while (node.type != RECORD) {
+      if (node.length() == 0) {
+        rightmost_.clear();
+        return;
+      }
+      NodeId child = node.children()[node.length() - 1];
+      rightmost_.push_back(std::move(node));
+      node = node_(child);
+    }
+    rightmost_.push_back(std::move(node));
+  }
+  /**
+   * inserts entry along the cached rightmost_ path without descending the tree, if it goes to the end of the last record node
+   * and fits there. the nodes on the path only need their counts updated then, as the first entries stay the same.
+   * @returns false if it does not, and drops the cached path.
+   */
+  auto append_ (const Pair &entry) -> bool {
+    if (rightmost_.empty()) return false;
+    Node &last = rightmost_.back();
+    bool appends = last.fillWith(entry) <= last.maxFill();
+    if (appends) {
+      Pair lastEntry = last.entryAt(last.length() - 1);
+      appends = kUnique ? lastEntry.key < entry.key : !(entry < lastEntry);
+    }
+    if (!appends) {
+      rightmost_.clear();
+      return false;
+    }
+    last.insertEntry(entry);
+    last.update();
+    for (size_t i = rightmost_.size() - 1; i-- > 0;) {
+      rightmost_[i].addCount(rightmost_[i].length() - 1, 1);
+      rightmost_[i].update();
+    }
+    return true;
   }
-  auto remove_ (const Pair &entry, Node &node) -> void {
+  /// removes the entry target stands for, a Pair, or in unique trees only its key, from the subtree of node.
+  auto remove_ (const Separator &target, Node &node) -> void {
     if (node.type == RECORD) {
-      node.entries().remove(entry);
+      if (!node.removeEntry(target)) throw NotFound("BpTree::remove: entry not found");
       return;
     }
-    size_t ix = ixInsert_(entry, node);
-    Node child = Node::get(file_, node.children()[ix]);
-    remove_(entry, child);
+    size_t ix = ixInsert_(target, node);
+    Node child = node_(node.children()[ix]);
+    remove_(target, child);
     if (child.length() == 0) {
-      AK_ASSERT(node.type == ROOT);
-      AK_ASSERT(child.type == RECORD);
-      child.destroy();
-      node.children().clear();
-      node.splits().clear();
+      removeEmptyChild_(child, node, ix);
       return;
     }
     node.splits()[ix] = child.lowerBound();
-    if (child.shouldMerge()) merge_(child, node, ix);
+    node.addCount(ix, -1);
+    if (shouldMerge_(child) && !refill_(child, node, ix)) return;
     child.update();
   }
-  auto findOne_ (const KeyType &key, Node node) -> std::optional<ValueType> {
+  /**
+   * applies the sorted messages from begin on to the subtree of node, stopping at end or once node is full and needs splitting
+   * by its parent. the messages to a child are applied together, so each node is written once per batch instead of once per message.
+   * unless node is the leftmost one on its level, it also stops at messages that now belong to a previous sibling, which happens
+   * when the removal of its first entries leaves identical entries before it.
+   * @returns the index of the first message not applied.
+   */
+  auto applyMessages_ (const std::vector<Message> &messages, size_t begin, size_t end, Node &node, bool leftmost) -> size_t {
+    AK_ASSERT(node.isIndex());
+    size_t i = begin;
+    while (i < end && !node.shouldSplit()) {
+      if (node.length() == 0) {
+        // the parent drops an emptied index node, and the messages left go to its siblings instead.
+        if (node.type != ROOT) break;
+        // removals are buffered without checking that the entry exists, so those of an empty tree are dropped.
+        if (messages[i].type == INSERTION) insert_(messages[i].entry, node);
+        ++i;
+        continue;
+      }
+      if (!leftmost && separatorOf_(messages[i].entry) < node.lowerBound()) break;
+      size_t ix = ixInsert_(separatorOf_(messages[i].entry), node);
+      size_t last = i + 1;
+      if (ix + 1 < node.length()) {
+        while (last < end && separatorOf_(messages[last].entry) < node.splits()[ix + 1]) ++last;
+      } else {
+        last = end;
+      }
+      Node child = node_(node.children()[ix]);
+      const bool childLeftmost = leftmost && ix == 0;
+      if (child.type == RECORD) {
+        for (; i < last && !child.shouldSplit(); ++i) {
+          if (!childLeftmost && (child.length() == 0 || separatorOf_(messages[i].entry) < child.lowerBound())) break;
+          if (messages[i].type == REMOVAL) {
+            // as above, the entry may not exist.
+            child.removeEntry(separatorOf_(messages[i].entry));
+          } else {
+            insert_(messages[i].entry, child);
+          }
+        }
+      } else {
+        i = applyMessages_(messages, i, last, child, childLeftmost);
+      }
+      if (child.length() == 0) {
+        removeEmptyChild_(child, node, ix);
+        continue;
+      }
+      node.splits()[ix] = child.lowerBound();
+      node.setCount(ix, child.size());
+      // a batch of removals can leave the child far below the limit, which borrowing a single entry would not be enough for.
+      if (child.shouldSplit()) {
+        split_(child, node, ix);
+      } else if (shouldMerge_(child) && !refill_(child, node, ix)) {
+        continue;
+      }
+      child.update();
+    }
+    return i;
+  }
+  /// adds a message to the write buffer, flushing it once full.
+  auto buffer_ (const Message &message) -> void {
+    trackSizeDelta_(message);
+    pendingByKey_.emplace(message.entry.key, pending_.size());
+    pending_.push_back(message);
+    if (pending_.size() >= writeBufferCapacity_) {
+      flush();
+      return;
+    }
+    Node page = node_(bufferPages_.back());
+    size_t slot = pending_.size() - 1 - (bufferPages_.size() - 1) * BufferPayload::m;
+    if (slot < BufferPayload::m) {
+      page.messages()[slot] = message;
+      page.update();
+      return;
+    }
+    Node next(*this, BUFFER);
+    next.messages()[0] = message;
+    next.save();
+    page.nextPage() = next.id();
+    page.update();
+    bufferPages_.push_back(next.id());
+  }
+  auto loadWriteBuffer_ (NodeId head) -> void {
+    for (NodeId id = head; id != 0;) {
+      Node page = node_(id);
+      bufferPages_.push_back(id);
+      for (size_t i = 0; i < BufferPayload::m && page.messages()[i].type != NONE; ++i) {
+        pendingByKey_.emplace(page.messages()[i].entry.key, pending_.size());
+        pending_.push_back(page.messages()[i]);
+      }
+      id = page.nextPage();
+    }
+  }
+  /// @returns the values of key in order, with the buffered messages on key applied.
+  auto findManyBuffered_ (const KeyType &key) -> std::vector<ValueType> {
+    return applyPending_(key, findMany_(key, Node::root(*this), kLatestVersion));
+  }
+  /// applies the buffered messages on key to its values res in the tree. removals of values not in res are dropped.
+  auto applyPending_ (const KeyType &key, std::vector<ValueType> res) -> std::vector<ValueType> {
+    auto [ begin, end ] = pendingByKey_.equal_range(key);
+    for (auto it = begin; it != end; ++it) {
+      const Message &message = pending_[it->second];
+      if constexpr (kUnique) {
+        res.clear();
+        if (message.type == INSERTION) res.push_back(message.entry.value);
+      } else {
+        auto pos = std::lower_bound(res.begin(), res.end(), message.entry.value);
+        if (message.type == INSERTION) {
+          res.insert(pos, message.entry.value);
+        } else if (pos != res.end() && equals(*pos, message.entry.value)) {
+          res.erase(pos);
+        }
+      }
+    }
+    return res;
+  }
+  /**
+   * counts message in the change to size() as it is buffered. an insert into a duplicate tree adds an entry whatever the tree
+   * holds, so it is counted right away. removals, and inserts into unique trees, depend on whether the entry is in the tree, so
+   * their key is left to the next pendingSizeDelta_ to look up.
+   */
+  auto trackSizeDelta_ (const Message &message) -> void {
+    const KeyType &key = message.entry.key;
+    if (staleKeys_.contains(key)) return;
+    if (!kUnique && message.type == INSERTION) {
+      ++keyDeltas_[key];
+      ++sizeDelta_;
+      return;
+    }
+    if (auto it = keyDeltas_.find(key); it != keyDeltas_.end()) {
+      sizeDelta_ -= it->second;
+      keyDeltas_.erase(it);
+    }
+    staleKeys_.insert(key);
+  }
+  /// the change the buffered messages make to size(), looking up the keys of staleKeys_ once.
+  auto pendingSizeDelta_ () -> ptrdiff_t {
+    for (const KeyType &key : staleKeys_) {
+      std::vector<ValueType> values = findMany_(key, Node::root(*this), kLatestVersion);
+      const ptrdiff_t before = values.size();
+      const ptrdiff_t delta = (ptrdiff_t) applyPending_(key, std::move(values)).size() - before;
+      keyDeltas_[key] = delta;
+      sizeDelta_ += delta;
+    }
+    staleKeys_.clear();
+    return sizeDelta_;
+  }
+  auto findOne_ (const KeyType &key, Node node, SnapshotId snapshot) -> std::optional<ValueType> {
     if (node.type != RECORD) {
       if (node.length() == 0) return std::nullopt;
-      auto [ car, cdr ] = findFirstChildWithKey_(key, node);
-      if (!cdr) return findOne_(key, car);
-      std::optional<ValueType> res = findOne_(key, car);
+      auto [ car, cdr ] = findFirstChildWithKey_(key, node, snapshot);
+      if (!cdr) return findOne_(key, std::move(car), snapshot);
+      std::optional<ValueType> res = findOne_(key, std::move(car), snapshot);
       if (res) return res;
-      return findOne_(key, *cdr);
+      return findOne_(key, std::move(*cdr), snapshot);
     }
-    size_t ix = std::upper_bound(node.entries().content, node.entries().content + node.length(), key, KeyComparatorLess_()) - node.entries().content;
+    size_t ix = node.partitionPoint([&key] (const Pair &entry) { return entry.key < key; });
     if (ix >= node.length()) return std::nullopt;
-    Pair entry = node.entries()[ix];
+    Pair entry = node.entryAt(ix);
     if (!equals(entry.key, key)) return std::nullopt;
     return entry.value;
   }
   auto includes_ (const Pair &entry, Node node) -> bool {
-    if (node.type == RECORD) return node.entries().includes(entry);
+    if (node.type == RECORD) {
+      size_t ix = node.partitionPoint([&entry] (const Pair &e) { return e < entry; });
+      return ix < node.length() && equals(node.entryAt(ix), entry);
+    }
     if (node.length() == 0) return false;
-    return includes_(entry, Node::get(file_, node.children()[ixInsert_(entry, node)]));
+    return includes_(entry, node_(node.children()[ixInsert_(separatorOf_(entry), node)]));
   }
-  auto findMany_ (const KeyType &key, Node node) -> std::vector<ValueType> {
+  auto findMany_ (const KeyType &key, Node node, SnapshotId snapshot) -> std::vector<ValueType> {
     if (node.type != RECORD) {
       if (node.length() == 0) return {};
-      auto [ car, cdr ] = findFirstChildWithKey_(key, node);
-      if (!cdr) return findMany_(key, car);
-      std::vector<ValueType> res = findMany_(key, car);
+      auto [ car, cdr ] = findFirstChildWithKey_(key, node, snapshot);
+      if (!cdr) return findMany_(key, std::move(car), snapshot);
+      std::vector<ValueType> res = findMany_(key, std::move(car), snapshot);
       if (!res.empty()) return res;
-      return findMany_(key, *cdr);
+      return findMany_(key, std::move(*cdr), snapshot);
     }
-    size_t ix = std::upper_bound(node.entries().content, node.entries().content + node.length(), key, KeyComparatorLess_()) - node.entries().content;
+    size_t ix = node.partitionPoint([&key] (const Pair &entry) { return entry.key < key; });
     if (ix >= node.length()) return {};
     std::vector<ValueType> res;
-    addValuesToVectorForAllKeyFrom_(res, key, node, ix);
+    addValuesToVectorForAllKeyFrom_(res, key, node, ix, snapshot);
     return res;
   }
-  auto findAll_ (Node node) -> std::vector<std::pair<KeyType, ValueType>> {
+  /**
+   * descends to the record nodes of the keys keys[order[i]] for i in [begin, end), where order sorts keys, and calls
+   * visit(order[i], node, ix) with the first entry not less than each key, if any. the keys under a node share its read, so each
+   * node on their paths is read once for them all.
+   */
+  template <typename Visit>
+  auto findBatch_ (const std::vector<KeyType> &keys, const std::vector<size_t> &order, size_t begin, size_t end, Node &node, const Visit &visit) -> void {
+    // a key goes to the last child starting before it, or in unique trees, not after it. see findFirstChildWithKey_.
+    using Comparator = std::conditional_t<kUnique, KeyComparator_, KeyComparatorLess_>;
+    if (node.type == RECORD) {
+      for (size_t i = begin; i < end; ++i) {
+        const KeyType &key = keys[order[i]];
+        size_t ix = node.partitionPoint([&key] (const Pair &entry) { return entry.key < key; });
+        if (ix < node.length()) {
+          visit(order[i], node, ix);
+          continue;
+        }
+        if constexpr (kUnique) continue;
+        // the entries of key may start the next record node instead.
+        for (NodeId id = node.next(); id != 0;) {
+          Node next = node_(id);
+          if (next.length() > 0) {
+            visit(order[i], next, 0);
+            break;
+          }
+          id = next.next();
+        }
+      }
+      return;
+    }
+    if (node.length() == 0) return;
+    const Separator *splits = node.splits().content;
+    for (size_t i = begin; i < end;) {
+      size_t ixGreater = std::upper_bound(splits, splits + node.length(), keys[order[i]], Comparator()) - splits;
+      size_t ix = ixGreater == 0 ? ixGreater : ixGreater - 1, j = end;
+      if (ix + 1 < node.length()) {
+        j = std::partition_point(order.begin() + i, order.begin() + end, [&] (size_t k) { return Comparator()(keys[k], splits[ix + 1]); }) - order.begin();
+      }
+      Node child = node_(node.children()[ix]);
+      findBatch_(keys, order, i, j, child, visit);
+      i = j;
+    }
+  }
+  /**
+   * @returns the indices of the keys to look up in the tree, sorted by key. the keys ruled out by the bloom filter are skipped, and
+   * buffered(i, values) is called with the values of the keys with buffered messages instead.
+   */
+  auto batchOrder_ (const std::vector<KeyType> &keys, const std::function<void (size_t i, std::vector<ValueType> &&values)> &buffered) -> std::vector<size_t> {
+    std::vector<size_t> order;
+    order.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (!bloomMayContain_(keys[i])) continue;
+      if (pendingByKey_.contains(keys[i])) {
+        buffered(i, findManyBuffered_(keys[i]));
+      } else {
+        order.push_back(i);
+      }
+    }
+    std::sort(order.begin(), order.end(), [&keys] (size_t lhs, size_t rhs) { return keys[lhs] < keys[rhs]; });
+    return order;
+  }
+  auto findAll_ (Node node, SnapshotId snapshot) -> std::vector<std::pair<KeyType, ValueType>> {
     if (node.type != RECORD) {
       if (node.length() == 0) return {};
-      return findAll_(Node::get(file_, node.children()[0]));
+      return findAll_(node_(node.children()[0], snapshot), snapshot);
     }
     std::vector<std::pair<KeyType, ValueType>> res;
-    addEntriesToVector_(res, node);
+    addEntriesToVector_(res, node, snapshot);
+    return res;
+  }
+  /// @returns at most limit entries from the offset-th one on.
+  auto findPage_ (size_t offset, size_t limit, SnapshotId snapshot) -> std::vector<std::pair<KeyType, ValueType>> {
+    Node node = Node::root(*this, snapshot);
+    if (offset >= node.size()) return {};
+    while (node.type != RECORD) {
+      node = node_(node.children()[node.childOf(offset)], snapshot);
+    }
+    std::vector<std::pair<KeyType, ValueType>> res;
+    while (true) {
+      for (; offset < node.length() && res.size() < limit; ++offset) {
+        Pair entry = node.entryAt(offset);
+        res.emplace_back(entry.key, entry.value);
+      }
+      if (res.size() == limit || node.next() == 0) return res;
+      node = node_(node.next(), snapshot);
+      offset = 0;
+    }
+  }
+  /**
+   * counts the entries e for which Comparator()(e, key) holds. only one root-to-record path is visited, and the record node at
+   * its end is searched, as the separators do not tell where key falls among its entries. in unique trees, a key that is the
+   * separator of a child is counted from the index nodes alone.
+   */
+  template <typename Comparator>
+  auto countBefore_ (const KeyType &key, Node node) -> size_t {
+    if (node.type == RECORD) {
+      return node.partitionPoint([&key] (const Pair &entry) { return !Comparator()(key, entry); });
+    }
+    if (node.length() == 0) return 0;
+    // children before ixGreater - 1 lie entirely before key, children from ixGreater on entirely after it.
+    size_t ixGreater = std::upper_bound(node.splits().content, node.splits().content + node.length(), key, Comparator()) - node.splits().content;
+    if (ixGreater == 0) return 0;
+    if constexpr (kUnique && std::same_as<Comparator, KeyComparatorLess_>) {
+      // the keys of a child are all less than the separator of the next one.
+      if (ixGreater < node.length() && equals(node.splits()[ixGreater].key, key)) return node.counts()[ixGreater - 1];
+    }
+    return node.countBefore(ixGreater - 1) + countBefore_<Comparator>(key, node_(node.children()[ixGreater - 1]));
+  }
+  auto select_ (size_t index, Node node) -> std::pair<KeyType, ValueType> {
+    if (node.type == RECORD) {
+      Pair entry = node.entryAt(index);
+      return std::make_pair(entry.key, entry.value);
+    }
+    const size_t ix = node.childOf(index);
+    return select_(index, node_(node.children()[ix]));
+  }
+  // the bloom filter is only available for hashable keys. these wrappers compile to nothing for the others.
+  auto bloomInsert_ (const KeyType &key) -> void {
+    if constexpr (Hashable<KeyType>) {
+      if (bloom_) bloom_->insert(key);
+    }
+  }
+  auto bloomMayContain_ (const KeyType &key) -> bool {
+    if constexpr (Hashable<KeyType>) {
+      return !bloom_ || bloom_->mayContain(key);
+    } else {
+      return true;
+    }
+  }
+  auto bloomReportFalsePositive_ () -> void {
+    if constexpr (Hashable<KeyType>) {
+      if (bloom_) bloom_->reportFalsePositive();
+    }
+  }
+  /// calls callback on every entry in order, walking the record chain.
+  auto forEach_ (const std::function<void (const Pair &entry)> &callback) -> void {
+    Node node = Node::root(*this);
+    while (node.type != RECORD) {
+      if (node.length() == 0) return;
+      node = node_(node.children()[0]);
+    }
+    while (true) {
+      for (int i = 0; i < node.length(); ++i) callback(node.entryAt(i));
+      if (node.next() == 0) return;
+      node = node_(node.next());
+    }
+  }
+  /// count entries in order from the first one under the node first, the unit of work of the parallel scans.
+  struct ScanPart_ {
+    NodeId first;
+    size_t count;
+  };
+  /// splits the entries into at most nParts parts of similar counts, at the children of the highest index level with enough of them.
+  auto scanParts_ (size_t nParts) -> std::vector<ScanPart_> {
+    Node root = Node::root(*this);
+    std::vector<ScanPart_> subtrees;
+    for (size_t i = 0; i < root.length(); ++i) subtrees.push_back({ root.children()[i], root.countAt(i) });
+    for (bool leaf = root.leaf(); !leaf && subtrees.size() < nParts;) {
+      std::vector<ScanPart_> children;
+      for (const ScanPart_ &subtree : subtrees) {
+        Node node = node_(subtree.first);
+        for (size_t i = 0; i < node.length(); ++i) children.push_back({ node.children()[i], node.countAt(i) });
+        leaf = node.leaf();
+      }
+      subtrees = std::move(children);
+    }
+    size_t total = 0;
+    for (const ScanPart_ &subtree : subtrees) total += subtree.count;
+    std::vector<ScanPart_> res;
+    for (size_t i = 0, done = 0; i < subtrees.size(); ++i) {
+      if (subtrees[i].count == 0) continue;
+      // a new part starts once the parts so far hold their share of the entries.
+      if (res.empty() || done * nParts >= res.size() * total) res.push_back({ subtrees[i].first, 0 });
+      res.back().count += subtrees[i].count;
+      done += subtrees[i].count;
+    }
     return res;
   }
+  /// calls visit(entry) on the entries of part in order, reading through file.
+  template <typename Visit>
+  static auto scanPart_ (File<szChunk> &file, const ScanPart_ &part, Visit &visit) -> void {
+    Node node = Node::get(file, part.first);
+    while (node.type != RECORD) node = Node::get(file, node.children()[0]);
+    for (size_t left = part.count; ; node = Node::get(file, node.next())) {
+      for (size_t i = 0; i < node.length() && left > 0; ++i, --left) visit(node.entryAt(i));
+      if (left == 0 || node.next() == 0) return;
+    }
+  }
+  /// calls visit(part, entry) on the entries of each part of scanParts_ on pool, each part reading through its own handle of the file.
+  template <typename Visit>
+  auto scanInParallel_ (ThreadPool &pool, size_t nParts, const Visit &visit) -> size_t {
+    flush();
+    // the other handles only see what is written through.
+    file_.flush();
+    std::vector<ScanPart_> parts = scanParts_(nParts);
+    pool.parallelFor(parts.size(), [&] (size_t i) {
+      File<szChunk> file(filename_.c_str(), [] () {});
+      auto visitEntry = [&visit, i] (const Pair &entry) { visit(i, entry); };
+      scanPart_(file, parts[i], visitEntry);
+    });
+    return parts.size();
+  }
   auto init_ () -> void {
     Node root(*this, ROOT);
     root.leaf() = true;
@@ -430,46 +1671,520 @@ class BpTree {
 #ifdef AK_DEBUG
   auto print_ (Node node) -> void {
     if (node.type == RECORD) {
-      std::cerr << "[Record " << node.id() << " (" << node.length() << "/" << 2 * RecordPayload::l - 1 << ")]";
+      std::cerr << "[Record " << node.id() << " (" << node.fill() << "/" << node.maxFill() << ")]";
       for (int i = 0; i < node.length(); ++i) std::cerr << " (" << std::string(node.entries()[i].key) << ", " << node.entries()[i].value << ")";
       std::cerr << std::endl;
       return;
     }
     std::cerr << "[Node " << node.id() << " (" << node.length() << "/" << 2 * IndexPayload::k - 1 << ")" << (node.leaf() ? " leaf" : "") << "]";
-    for (int i = 0; i < node.length(); ++i) std::cerr << " (" << std::string(node.splits()[i].key) << ", " << node.splits()[i].value << ") " << node.children()[i];
+    for (int i = 0; i < node.length(); ++i) {
+      if constexpr (kUnique) {
+        std::cerr << " (" << std::string(node.splits()[i].key) << ") " << node.children()[i];
+      } else {
+        std::cerr << " (" << std::string(node.splits()[i].key) << ", " << node.splits()[i].value << ") " << node.children()[i];
+      }
+    }
     std::cerr << std::endl;
-    for (int i = 0; i < node.length(); ++i) print_(Node::get(file_, node.children()[i]));
+    for (int i = 0; i < node.length(); ++i) print_(node_(node.children()[i]));
   }
 #endif
  public:
   BpTree () = delete;
-  BpTree (const char *filename) : file_(filename, [this] () { init_(); }) {}
+  BpTree (const char *filename) : filename_(filename), file_(filename, [this] () { init_(); }) {
+    setMinFill(0.5);
+    Node root = Node::root(*this);
+    if (root.type != ROOT || root.header().format != kFormat) throw Exception("BpTree: the file is of another format or version");
+    // writes buffered when the tree was last open are applied now, as the buffer is off until setWriteBuffer.
+    if (NodeId head = root.header().writeBuffer; head != 0) {
+      loadWriteBuffer_(head);
+      flush();
+    }
+  }
+  /**
+   * opens the tree together with a bloom filter over its keys, stored in bloomFilename.
+   * definite misses of findOne, findMany and includes then return without reading any node.
+   * the tree must always be opened with its filter afterwards, or the filter would miss keys inserted in the meantime.
+   * bitsPerKey and capacity only take effect when the filter is created; see rebuildBloomFilter.
+   */
+  BpTree (const char *filename, const char *bloomFilename, size_t bitsPerKey = 10, size_t capacity = 65536) requires Hashable<KeyType> : BpTree(filename) {
+    bloom_.emplace(bloomFilename, bitsPerKey, capacity);
+    if (bloom_->size() == 0 && size() > 0) rebuildBloomFilter(capacity);
+  }
+  BpTree (const BpTree &) = delete;
+  auto operator= (const BpTree &) -> BpTree & = delete;
+  ~BpTree () { AK_ASSERT(liveSnapshots_ == 0); }
+  /// in unique trees, this overwrites the value if the key is already present.
   auto insert (const KeyType &key, const ValueType &value) -> void {
+    if (writeBufferCapacity_ > 0) {
+      buffer_({ .entry = { .key = key, .value = value }, .type = INSERTION });
+      bloomInsert_(key);
+      return;
+    }
+    Pair entry = { .key = key, .value = value };
+    if (append_(entry)) {
+      bloomInsert_(key);
+      return;
+    }
     Node root = Node::root(*this);
-    insert_({ .key = key, .value = value }, root);
-    if (root.shouldSplit()) split_(root, root, 0);
+    bool appended;
+    bool inserted = insert_(entry, root, appended);
+    if (root.shouldSplit()) split_(root, root, 0, appended ? appendFill_ : 0.5);
     root.update();
+    // the next inserts are likely to append too, e.g. of increasing timestamps or ids.
+    if (appended) cacheRightmostPath_();
+    if (inserted) bloomInsert_(key);
   }
-  auto remove (const KeyType &key, const ValueType &value) -> void {
+  auto remove (const KeyType &key, const ValueType &value) -> void requires (!kUnique) {
+    if (writeBufferCapacity_ > 0) {
+      // removals are buffered blindly, see setWriteBuffer.
+      if (bloomMayContain_(key)) buffer_({ .entry = { .key = key, .value = value }, .type = REMOVAL });
+      return;
+    }
+    rightmost_.clear();
     Node root = Node::root(*this);
     remove_({ .key = key, .value = value }, root);
-    if (root.shouldMerge()) merge_(root, root, 0);
+    collapseRoot_(root);
+    root.update();
+  }
+  auto remove (const KeyType &key) -> void requires kUnique {
+    if (writeBufferCapacity_ > 0) {
+      if (!bloomMayContain_(key)) return;
+      // the value of a removal is not used, as in the empty slots of buffer pages.
+      Message message = { .type = REMOVAL };
+      message.entry.key = key;
+      buffer_(message);
+      return;
+    }
+    rightmost_.clear();
+    Node root = Node::root(*this);
+    remove_({ .key = key }, root);
+    collapseRoot_(root);
+    root.update();
+  }
+  /**
+   * sets how full nodes are kept on removal: a node is merged with its siblings once less than minFill of it is used.
+   * the default of 0.5 rebalances eagerly. lower values save most of the merges, and the split-merge thrashing of churn
+   * around the boundary, at the cost of sparser nodes; 0 only drops empty nodes. call rebalance() to merge them in bulk.
+   * this is not persisted.
+   */
+  auto setMinFill (double minFill) -> void {
+    minFill = std::clamp(minFill, 0.0, 0.5);
+    const size_t recordFills = kSlotted ? kSlottedCapacity + 1 : kPacked ? kPackedCapacity + 1 : 2 * RecordPayload::l;
+    minRecordFill_ = std::min<size_t>(recordFills / 2, std::ceil(minFill * (double) recordFills));
+    minIndexLength_ = std::min<size_t>(IndexPayload::k, std::ceil(minFill * 2 * IndexPayload::k));
+  }
+  /**
+   * sets how full a split leaves the left node when the insert that causes it appends to the end of the tree. splitting in half,
+   * nodes filled by increasing keys would stay half empty, as no key goes to them again, so the default of 0.9 leaves them fuller.
+   * 0.5 splits all nodes in half. this is not persisted.
+   */
+  auto setAppendFill (double fill) -> void { appendFill_ = std::clamp(fill, 0.5, 1.0); }
+  /**
+   * buffers up to capacity inserts and removals instead of applying each to its record node. once the buffer is full, they are
+   * sorted and applied together, so the nodes they share are written once per batch rather than once per write. this pays off
+   * for random writes to large trees, where every write would otherwise rewrite its whole root-to-record path.
+   *
+   * removals are buffered blindly, without a lookup of the entry, so that they are batched as inserts are: removing an entry that
+   * does not exist is then a no-op rather than a NotFound.
+   *
+   * findOne, findMany, includes and count look into the buffer on top of the tree, reading the path of their key only. size
+   * reads the paths of the keys removed, or in unique trees written, since it was last called, once each. the other reads,
+   * snapshot() among them, flush the buffer first.
+   * 0 turns buffering off, which is the default.
+   * the capacity is not persisted, but the buffered writes are, in buffer nodes of the tree file: opening the tree applies them.
+   * the first buffer node is created here, and dropped again by turning buffering off, so trees without a buffer pay nothing for it.
+   */
+  auto setWriteBuffer (size_t capacity) -> void {
+    writeBufferCapacity_ = capacity;
+    if (pending_.size() >= capacity) flush();
+    if ((capacity > 0) == !bufferPages_.empty()) return;
+    // the cached path holds a copy of the root, which would write the old header back.
+    rightmost_.clear();
+    Node root = Node::root(*this);
+    if (capacity > 0) {
+      Node head(*this, BUFFER);
+      head.save();
+      bufferPages_.push_back(head.id());
+      root.header().writeBuffer = head.id();
+    } else {
+      file_.remove(bufferPages_.front());
+      bufferPages_.clear();
+      root.header().writeBuffer = 0;
+    }
+    root.update();
+  }
+  /// applies the buffered writes to the tree.
+  auto flush () -> void {
+    if (pending_.empty()) return;
+    rightmost_.clear();
+    std::vector<Message> messages = std::move(pending_);
+    pending_.clear();
+    pendingByKey_.clear();
+    sizeDelta_ = 0;
+    keyDeltas_.clear();
+    staleKeys_.clear();
+    // a stable sort keeps the messages on the same entry in the order of arrival.
+    std::stable_sort(messages.begin(), messages.end(), [] (const Message &lhs, const Message &rhs) { return lhs.entry < rhs.entry; });
+    Node root = Node::root(*this);
+    for (size_t i = 0; i < messages.size();) {
+      i = applyMessages_(messages, i, messages.size(), root, true);
+      if (root.shouldSplit()) split_(root, root, 0);
+    }
+    while (!root.leaf() && root.length() == 1) collapseRoot_(root);
+    root.update();
+
+    Node head = node_(bufferPages_.front());
+    for (size_t i = 0; i < BufferPayload::m; ++i) head.messages()[i].type = NONE;
+    head.nextPage() = 0;
+    head.update();
+    for (size_t i = 1; i < bufferPages_.size(); ++i) file_.remove(bufferPages_[i]);
+    bufferPages_.resize(1);
+  }
+  /// merges the nodes left underfull by lazy removals, so that all non-root nodes are at least half full again.
+  auto rebalance () -> void {
+    flush();
+    rightmost_.clear();
+    Node root = Node::root(*this);
+    rebalance_(root);
+    while (!root.leaf() && root.length() == 1) collapseRoot_(root);
     root.update();
   }
   auto findOne (const KeyType &key) -> std::optional<ValueType> {
-    return findOne_(key, Node::root(*this));
+    if (!bloomMayContain_(key)) return std::nullopt;
+    if (pendingByKey_.contains(key)) {
+      std::vector<ValueType> values = findManyBuffered_(key);
+      if (values.empty()) return std::nullopt;
+      return values[0];
+    }
+    std::optional<ValueType> res = findOne_(key, Node::root(*this), kLatestVersion);
+    if (!res) bloomReportFalsePositive_();
+    return res;
   }
   auto findMany (const KeyType &key) -> std::vector<ValueType> {
-    return findMany_(key, Node::root(*this));
+    if (!bloomMayContain_(key)) return {};
+    if (pendingByKey_.contains(key)) return findManyBuffered_(key);
+    std::vector<ValueType> res = findMany_(key, Node::root(*this), kLatestVersion);
+    if (res.empty()) bloomReportFalsePositive_();
+    return res;
+  }
+  /**
+   * findOne for each of keys, in their order. the keys are looked up together in key order, so that the nodes they share, e.g. the
+   * upper levels, are read once for all of them rather than once per key.
+   */
+  auto findOneBatch (const std::vector<KeyType> &keys) -> std::vector<std::optional<ValueType>> {
+    std::vector<std::optional<ValueType>> res(keys.size());
+    std::vector<size_t> order = batchOrder_(keys, [&res] (size_t i, std::vector<ValueType> &&values) {
+      if (!values.empty()) res[i] = values[0];
+    });
+    Node root = Node::root(*this);
+    findBatch_(keys, order, 0, order.size(), root, [&keys, &res] (size_t i, Node &node, size_t ix) {
+      Pair entry = node.entryAt(ix);
+      if (equals(entry.key, keys[i])) res[i] = entry.value;
+    });
+    for (size_t i : order) {
+      if (!res[i]) bloomReportFalsePositive_();
+    }
+    return res;
+  }
+  /// findMany for each of keys, in their order. see findOneBatch.
+  auto findManyBatch (const std::vector<KeyType> &keys) -> std::vector<std::vector<ValueType>> {
+    std::vector<std::vector<ValueType>> res(keys.size());
+    std::vector<size_t> order = batchOrder_(keys, [&res] (size_t i, std::vector<ValueType> &&values) { res[i] = std::move(values); });
+    Node root = Node::root(*this);
+    findBatch_(keys, order, 0, order.size(), root, [this, &keys, &res] (size_t i, Node &node, size_t ix) {
+      if (equals(node.entryAt(ix).key, keys[i])) addValuesToVectorForAllKeyFrom_(res[i], keys[i], node, ix, kLatestVersion);
+    });
+    for (size_t i : order) {
+      if (res[i].empty()) bloomReportFalsePositive_();
+    }
+    return res;
   }
   auto findAll () -> std::vector<std::pair<KeyType, ValueType>> {
-    return findAll_(Node::root(*this));
+    flush();
+    return findAll_(Node::root(*this), kLatestVersion);
+  }
+  /// @returns the entries with lo <= key < hi, in order.
+  auto findRange (const KeyType &lo, const KeyType &hi) -> std::vector<std::pair<KeyType, ValueType>> {
+    if (!(lo < hi)) return {};
+    flush();
+    Node root = Node::root(*this);
+    size_t begin = countBefore_<KeyComparatorLess_>(lo, root);
+    return findPage_(begin, countBefore_<KeyComparatorLess_>(hi, root) - begin, kLatestVersion);
+  }
+  /**
+   * iterates the values of a key in order, reading the record nodes one at a time instead of all values up front, e.g. to
+   * intersect posting lists with the kernels of setops.h. seek gallops through the current node, and descends from the root to
+   * get past it, so a seek far ahead reads one path rather than every node in between.
+   * the tree must not be changed while a cursor is in use.
+   */
+  class Cursor {
+   private:
+    friend BpTree;
+    BpTree *tree_;
+    KeyType key_;
+    std::optional<Node> leaf_;
+    size_t ix_ = 0;
+    Pair current_;
+    bool valid_ = false;
+    Cursor (BpTree &tree, const KeyType &key) : tree_(&tree), key_(key) {
+      descend_([&key] (const Pair &entry) { return entry.key < key; });
+    }
+    /// moves to the first entry for which before does not hold, which is monotone in the order of the entries.
+    template <typename Before>
+    auto descend_ (const Before &before) -> void {
+      Node node = Node::root(*tree_);
+      while (node.type != RECORD) {
+        if (node.length() == 0) {
+          valid_ = false;
+          return;
+        }
+        auto &splits = node.splits();
+        size_t ix = std::partition_point(splits.content, splits.content + splits.length, before) - splits.content;
+        node = tree_->node_(node.children()[ix == 0 ? 0 : ix - 1]);
+      }
+      ix_ = node.partitionPoint(before);
+      leaf_ = std::move(node);
+      settle_();
+    }
+    /// loads the entry at ix_, moving on to the next node past the end of this one.
+    auto settle_ () -> void {
+      while (ix_ == leaf_->length() && leaf_->next() != 0) {
+        leaf_ = tree_->node_(leaf_->next());
+        ix_ = 0;
+      }
+      valid_ = ix_ < leaf_->length();
+      if (!valid_) return;
+      current_ = leaf_->entryAt(ix_);
+      valid_ = equals(current_.key, key_);
+    }
+   public:
+    using value_type = ValueType;
+    auto valid () const -> bool { return valid_; }
+    auto current () const -> const ValueType & { return current_.value; }
+    auto next () -> void {
+      ++ix_;
+      settle_();
+    }
+    /// moves to the first value not less than value, if it is after the current one.
+    auto seek (const ValueType &value) -> void {
+      if (!valid_ || !(current_.value < value)) return;
+      const Pair target = { .key = key_, .value = value };
+      const size_t length = leaf_->length();
+      if (leaf_->entryAt(length - 1) < target) {
+        descend_([&target] (const Pair &entry) { return entry < target; });
+        return;
+      }
+      // the entry at length - 1 is not less than target, so the gallop stops by then.
+      size_t bound = 1;
+      while (ix_ + bound < length - 1 && leaf_->entryAt(ix_ + bound) < target) bound *= 2;
+      size_t lo = ix_ + bound / 2 + 1, hi = std::min(ix_ + bound, length - 1);
+      while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (leaf_->entryAt(mid) < target) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      ix_ = lo;
+      settle_();
+    }
+  };
+  /// @returns a cursor at the first value of key, which is invalid if there is none.
+  auto cursor (const KeyType &key) -> Cursor requires (!kUnique) {
+    flush();
+    return Cursor(*this, key);
+  }
+  /**
+   * calls visit(part, key, value) on every entry, on the threads of pool. the entries are split into at most nParts contiguous parts
+   * of similar sizes, 4 per thread if 0, at the children of the upper index levels. a part is visited in order on one thread, and
+   * the parts concurrently, so visit needs to be thread-safe across parts. part is the index of the part in key order.
+   * each part reads through its own handle of the file, so that the reads are issued in parallel too. they are not counted in
+   * fileStats, and do not warm the cache of the tree.
+   * @returns the number of parts.
+   */
+  template <typename Visit>
+  auto parallelForEach (ThreadPool &pool, const Visit &visit, size_t nParts = 0) -> size_t {
+    return scanInParallel_(pool, nParts == 0 ? 4 * pool.size() : nParts, [&visit] (size_t part, const Pair &entry) {
+      visit(part, entry.key, entry.value);
+    });
+  }
+  /**
+   * folds every entry into a value, on the threads of pool. each part of parallelForEach is folded from identity with
+   * accumulate(acc, key, value), then the results are combined in key order with combine(lhs, rhs), which thus needs to be
+   * associative but not commutative.
+   * @example tree.parallelReduce(pool, 0L, [] (long &sum, int, int value) { sum += value; }, std::plus<long>());
+   */
+  template <typename T, typename Accumulate, typename Combine>
+  auto parallelReduce (ThreadPool &pool, const T &identity, const Accumulate &accumulate, const Combine &combine, size_t nParts = 0) -> T {
+    if (nParts == 0) nParts = 4 * pool.size();
+    // not a std::vector<T>, whose elements may share bytes, e.g. for bool.
+    std::vector<std::optional<T>> results(nParts, identity);
+    nParts = scanInParallel_(pool, nParts, [&] (size_t part, const Pair &entry) { accumulate(*results[part], entry.key, entry.value); });
+    T res = identity;
+    for (size_t i = 0; i < nParts; ++i) res = combine(std::move(res), std::move(*results[i]));
+    return res;
   }
-  auto includes (const KeyType &key, const ValueType &value) -> bool {
+  auto includes (const KeyType &key, const ValueType &value) -> bool requires (!kUnique) {
+    if (!bloomMayContain_(key)) return false;
+    if (pendingByKey_.contains(key)) {
+      std::vector<ValueType> values = findManyBuffered_(key);
+      return std::binary_search(values.begin(), values.end(), value);
+    }
     return includes_({ .key = key, .value = value }, Node::root(*this));
   }
+  auto includes (const KeyType &key) -> bool {
+    if (!bloomMayContain_(key)) return false;
+    if (pendingByKey_.contains(key)) return !findManyBuffered_(key).empty();
+    return findOne_(key, Node::root(*this), kLatestVersion).has_value();
+  }
+
+  /**
+   * clears the bloom filter, resizes it for capacity keys (the current number of entries if 0), and inserts all keys again.
+   * removals leave stale bits behind, so call this after lots of them.
+   */
+  auto rebuildBloomFilter (size_t capacity = 0) -> void requires Hashable<KeyType> {
+    AK_ASSERT(bloom_);
+    flush();
+    bloom_->rebuild(capacity == 0 ? size() : capacity);
+    forEach_([this] (const Pair &entry) { bloom_->insert(entry.key); });
+  }
+  /// @returns the lookup statistics of the bloom filter.
+  auto bloomFilterStats () -> typename BloomFilter<KeyType, szChunk>::Stats requires Hashable<KeyType> {
+    AK_ASSERT(bloom_);
+    return bloom_->stats();
+  }
+  /// @returns the false positive rate the bloom filter is expected to have in its current fill.
+  auto bloomFilterEstimatedFalsePositiveRate () -> double requires Hashable<KeyType> {
+    AK_ASSERT(bloom_);
+    return bloom_->estimatedFalsePositiveRate();
+  }
+
+  // order statistics. these descend a single path and never walk the record chain: size reads the root only, select a node per
+  // level, and count, countRange and rank a node per level for each bound, the record node at the end included.
+  // all but size and count flush the write buffer.
+  /// @returns the number of entries in the tree.
+  auto size () -> size_t { return Node::root(*this).size() + pendingSizeDelta_(); }
+  /// @returns the number of entries with the given key.
+  auto count (const KeyType &key) -> size_t {
+    if (pendingByKey_.contains(key)) return findManyBuffered_(key).size();
+    Node root = Node::root(*this);
+    return countBefore_<KeyComparator_>(key, root) - countBefore_<KeyComparatorLess_>(key, root);
+  }
+  /// @returns the number of entries with lo <= key < hi.
+  auto countRange (const KeyType &lo, const KeyType &hi) -> size_t {
+    if (!(lo < hi)) return 0;
+    flush();
+    Node root = Node::root(*this);
+    return countBefore_<KeyComparatorLess_>(hi, root) - countBefore_<KeyComparatorLess_>(lo, root);
+  }
+  /// @returns the number of entries with a key less than the given key, i.e. the index of its first entry.
+  auto rank (const KeyType &key) -> size_t {
+    flush();
+    return countBefore_<KeyComparatorLess_>(key, Node::root(*this));
+  }
+  /// @returns the index-th entry in (key, value) order, or nullopt if index >= size().
+  auto select (size_t index) -> std::optional<std::pair<KeyType, ValueType>> {
+    flush();
+    Node root = Node::root(*this);
+    if (index >= root.size()) return std::nullopt;
+    return select_(index, root);
+  }
+
+  /**
+   * a read-only view of the tree as of its creation, e.g. for long-running exports.
+   * writes to the tree keep going but don't show up in the snapshot, as the file keeps copies of the old nodes they overwrite;
+   * see File. releasing the snapshot, or destructing it, returns the copies to the free list.
+   * neither the tree nor its snapshots are thread-safe, but calls to them only need to be serialized one by one.
+   *
+   * a snapshot refers to its tree, so it must be released or destructed before the tree is. debug builds assert this when the tree
+   * is destructed.
+   */
+  class Snapshot {
+   private:
+    friend BpTree;
+    BpTree *tree_;
+    SnapshotId id_;
+    Snapshot (BpTree &tree) : tree_(&tree), id_(tree.file_.createSnapshot()) { ++tree.liveSnapshots_; }
+   public:
+    Snapshot () = delete;
+    Snapshot (const Snapshot &) = delete;
+    Snapshot (Snapshot &&that) noexcept : tree_(that.tree_), id_(that.id_) { that.tree_ = nullptr; }
+    auto operator= (const Snapshot &) -> Snapshot & = delete;
+    auto operator= (Snapshot &&) -> Snapshot & = delete;
+    ~Snapshot () { release(); }
 
-  auto clearCache () -> void { file_.clearCache(); }
+    /// the snapshot can not be used after it is released.
+    auto release () -> void {
+      if (tree_ == nullptr) return;
+      tree_->file_.releaseSnapshot(id_);
+      --tree_->liveSnapshots_;
+      tree_ = nullptr;
+    }
+    auto findOne (const KeyType &key) -> std::optional<ValueType> {
+      return tree_->findOne_(key, Node::root(*tree_, id_), id_);
+    }
+    auto findMany (const KeyType &key) -> std::vector<ValueType> {
+      return tree_->findMany_(key, Node::root(*tree_, id_), id_);
+    }
+    auto findAll () -> std::vector<std::pair<KeyType, ValueType>> {
+      return tree_->findAll_(Node::root(*tree_, id_), id_);
+    }
+    /// @returns at most limit entries from the offset-th one on. as snapshots never change, this pages through them consistently.
+    auto findPage (size_t offset, size_t limit) -> std::vector<std::pair<KeyType, ValueType>> {
+      return tree_->findPage_(offset, limit, id_);
+    }
+    auto size () -> size_t { return Node::root(*tree_, id_).size(); }
+  };
+  /**
+   * takes a snapshot, see Snapshot, which must not outlive the tree. the copies of the nodes kept for it are only freed when it is
+   * released: those of snapshots still open when the file is closed, e.g. by a crash, are leaked in the file.
+   */
+  auto snapshot () -> Snapshot {
+    flush();
+    return Snapshot(*this);
+  }
+
+  /// @returns the disk I/O counters of the tree file.
+  auto fileStats () const -> const typename File<szChunk>::Stats & { return file_.stats(); }
+  /// @returns the structural counters of the tree. counting is always on, at the cost of an increment each.
+  auto stats () const -> const Stats & { return stats_; }
+  /**
+   * reads every node to report the shape of the tree: its height, the nodes and fill of each level, and how sequentially the record
+   * nodes lie in the file. low fill calls for rebalance(), or a smaller szChunk if the nodes never fill up; low adjacency, for
+   * rewriting the tree in key order. the reads are not counted in stats.
+   */
+  auto analyze () -> Shape {
+    flush();
+    Shape res;
+    std::vector<NodeId> level = { 0 };
+    while (!level.empty()) {
+      LevelShape &shape = res.levels.emplace_back();
+      std::vector<NodeId> children;
+      for (NodeId id : level) {
+        Node node = Node::get(file_, id);
+        double fill = (double) node.fill() / (double) node.maxFill();
+        ++shape.nodes;
+        shape.length += node.length();
+        shape.meanFill += fill;
+        ++shape.fillHistogram[std::min<size_t>(fill * 10, 9)];
+        if (node.type != RECORD) children.insert(children.end(), node.children().content, node.children().content + node.length());
+      }
+      shape.meanFill /= (double) shape.nodes;
+      // each level lists its nodes in key order, so the last one lists the record nodes in the order scans read them.
+      if (children.empty() && level.size() > 1) {
+        size_t adjacent = 0;
+        for (size_t i = 1; i < level.size(); ++i) adjacent += level[i] == level[i - 1] + 1;
+        res.leafAdjacency = (double) adjacent / (double) (level.size() - 1);
+      }
+      level = std::move(children);
+    }
+    return res;
+  }
+  auto clearCache () -> void {
+    file_.clearCache();
+    if (bloom_) bloom_->clearCache();
+  }
 
 #ifdef AK_DEBUG
   auto print () -> void { print_(Node::root(*this)); }
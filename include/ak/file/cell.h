@@ -0,0 +1,33 @@
+#ifndef AK_LIB_FILE_CELL_H_
+#define AK_LIB_FILE_CELL_H_
+
+#include <string.h>
+
+#include <cstddef>
+
+namespace ak::file {
+/**
+ * how a value is written into a variable-length cell, e.g. of the slotted record nodes of BpTree.
+ * by default, a value takes its sizeof bytes as it is in memory. variable-length types specialize this to write fewer bytes,
+ * setting kVariable, and kMinSize and kMaxSize to the bounds of size().
+ */
+template <typename T>
+struct Cell {
+  static constexpr bool kVariable = false;
+  static constexpr size_t kMinSize = sizeof(T);
+  static constexpr size_t kMaxSize = sizeof(T);
+  static auto size (const T &) -> size_t { return sizeof(T); }
+  /// @returns the number of bytes written, which is size(value).
+  static auto write (const T &value, char *buf) -> size_t {
+    memcpy(buf, &value, sizeof(T));
+    return sizeof(T);
+  }
+  /// @returns the number of bytes read.
+  static auto read (T &value, const char *buf) -> size_t {
+    memcpy(&value, buf, sizeof(T));
+    return sizeof(T);
+  }
+};
+} // namespace ak::file
+
+#endif
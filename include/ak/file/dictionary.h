@@ -0,0 +1,217 @@
+#ifndef AK_LIB_FILE_DICTIONARY_H_
+#define AK_LIB_FILE_DICTIONARY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <compare>
+#include <concepts>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ak/base.h"
+#include "ak/file/array.h"
+#include "ak/file/file.h"
+#include "ak/file/varchar.h"
+
+namespace ak::file {
+template <int maxLength, std::unsigned_integral Code, size_t szChunk>
+class StringDictionary;
+
+/**
+ * a string of at most maxLength chars, stored as its code in a StringDictionary, e.g. for a column with few distinct values.
+ * it takes sizeof(Code) bytes instead of those of a Varchar, and compares as an integer. codes are in the order of the strings,
+ * so comparing codes compares the strings, as long as both come from the same dictionary.
+ * the default value is the empty string, which is code 0 in every dictionary.
+ */
+template <int maxLength, std::unsigned_integral Code = uint32_t>
+struct DictVarchar {
+ private:
+  template <int A, std::unsigned_integral C, size_t szChunk>
+  friend class StringDictionary;
+  Code code_ = 0;
+  explicit DictVarchar (Code code) : code_(code) {}
+ public:
+  DictVarchar () = default;
+  auto code () const -> Code { return code_; }
+  auto operator<=> (const DictVarchar &that) const -> std::strong_ordering = default;
+};
+
+/**
+ * a persistent dictionary of strings, which encodes each string to a DictVarchar and decodes it back.
+ *
+ * codes are assigned in the order of the strings, leaving gaps so that strings added later fit between their neighbours: a
+ * string after all others takes a fixed step after the last code, and one between two others takes the code in the middle of
+ * theirs. DictVarchar keys can thus be range queried: the strings in [lo, hi) are the codes in [lowerBound(lo), lowerBound(hi)).
+ * adding many strings between the same two neighbours halves the gap each time, and throws Overflow once there is none left.
+ * encodeAll spreads a batch of new strings evenly across the gaps instead, so add the strings known up front with it, and choose
+ * a wider Code for dictionaries that keep growing.
+ *
+ * the entries are appended to a chain of pages, and all of them are loaded into memory when the dictionary is opened: an ordered
+ * map to encode, and a hash map to decode, so that neither reads the file. it is meant for hundreds or thousands of strings.
+ * @example StringDictionary<16> statuses("statuses.dict"); record.status = statuses.encode("active"); statuses.decode(record.status);
+ */
+template <int maxLength, std::unsigned_integral Code = uint32_t, size_t szChunk = kDefaultSzChunk>
+class StringDictionary {
+ public:
+  using Value = DictVarchar<maxLength, Code>;
+ private:
+  /// the code past all strings, as returned by lowerBound. 0 is the empty string.
+  static constexpr Code kEnd = std::numeric_limits<Code>::max();
+  /// the gap left after the last string, and before the first.
+  static constexpr Code kStep = Code(1) << (std::numeric_limits<Code>::digits / 2);
+
+  struct Entry {
+    Code code;
+    Varchar<maxLength> value;
+  };
+  static constexpr size_t kPageLength = (szChunk - 2 * sizeof(size_t)) / sizeof(Entry);
+  static_assert(kPageLength >= 1);
+  struct Page : public ManagedObject<Page, szChunk> {
+    char _start[0];
+    size_t next = 0;
+    Array<Entry, kPageLength> entries;
+    char _end[0];
+    Page (File<szChunk> &file) : ManagedObject<Page, szChunk>(file) {}
+  };
+  /// orders Varchars and string_views alike, so that the map can be looked up without building a Varchar.
+  struct ViewLess {
+    using is_transparent = void;
+    static auto view_ (const Varchar<maxLength> &s) -> std::string_view { return s.view(); }
+    static auto view_ (std::string_view s) -> std::string_view { return s; }
+    auto operator() (const auto &lhs, const auto &rhs) const -> bool { return view_(lhs) < view_(rhs); }
+  };
+
+  File<szChunk> file_;
+  size_t lastPage_ = 0;
+  std::map<Varchar<maxLength>, Code, ViewLess> codes_;
+  std::unordered_map<Code, Varchar<maxLength>> values_;
+  const Varchar<maxLength> empty_;
+
+  auto init_ () -> void {
+    Page page(file_);
+    page.save();
+    AK_ASSERT(page.id() == 0);
+  }
+  auto load_ () -> void {
+    for (size_t id = 0;;) {
+      Page page = Page::get(file_, id);
+      for (size_t i = 0; i < page.entries.length; ++i) add_(page.entries[i]);
+      lastPage_ = id;
+      if (page.next == 0) break;
+      id = page.next;
+    }
+  }
+  auto add_ (const Entry &entry) -> void {
+    codes_.emplace(entry.value, entry.code);
+    values_.emplace(entry.code, entry.value);
+  }
+  auto append_ (const Entry &entry) -> void {
+    Page last = Page::get(file_, lastPage_);
+    if (last.entries.length < kPageLength) {
+      last.entries.push(entry);
+      last.update();
+      return;
+    }
+    Page page(file_);
+    page.entries.push(entry);
+    page.save();
+    last.next = page.id();
+    last.update();
+    lastPage_ = page.id();
+  }
+  /// @returns a code strictly between lo and hi, the codes of the neighbours of a new string.
+  static auto codeBetween_ (Code lo, Code hi) -> Code {
+    Code res;
+    if (lo == 0 && hi == kEnd) res = kEnd / 2;
+    else if (hi == kEnd) res = lo + std::min<Code>(kStep, (hi - lo) / 2);
+    else if (lo == 0) res = hi - std::min<Code>(kStep, (hi - lo) / 2);
+    else res = lo + (hi - lo) / 2;
+    if (res == lo || res == hi) throw Overflow("StringDictionary::encode: no code left between the neighbours of the string");
+    return res;
+  }
+ public:
+  StringDictionary () = delete;
+  StringDictionary (const char *filename) : file_(filename, [this] () { init_(); }) { load_(); }
+  StringDictionary (const StringDictionary &) = delete;
+  auto operator= (const StringDictionary &) -> StringDictionary & = delete;
+
+  /// @returns the code of s, adding s to the dictionary if it is not there yet. throws Overflow if s is longer than maxLength.
+  auto encode (std::string_view s) -> Value {
+    if (s.empty()) return Value();
+    auto next = codes_.lower_bound(s);
+    if (next != codes_.end() && next->first.view() == s) return Value(next->second);
+    Code lo = next == codes_.begin() ? 0 : std::prev(next)->second;
+    Code hi = next == codes_.end() ? kEnd : next->second;
+    Entry entry = { .code = codeBetween_(lo, hi), .value = Varchar<maxLength>(s) };
+    append_(entry);
+    add_(entry);
+    return Value(entry.code);
+  }
+  /// @returns the codes of strings, in their order, adding those not in the dictionary yet with evenly spaced codes.
+  auto encodeAll (const std::vector<std::string> &strings) -> std::vector<Value> {
+    std::vector<std::string_view> added;
+    for (const std::string &s : strings) {
+      if (s.length() > maxLength) throw Overflow("Varchar length overflow");
+      if (!s.empty() && !codes_.contains(std::string_view(s))) added.push_back(s);
+    }
+    std::sort(added.begin(), added.end());
+    added.erase(std::unique(added.begin(), added.end()), added.end());
+    // the strings of each gap between the codes present, [begin, end), share it evenly.
+    for (size_t begin = 0, end; begin < added.size(); begin = end) {
+      auto next = codes_.lower_bound(added[begin]);
+      for (end = begin + 1; end < added.size() && (next == codes_.end() || added[end] < next->first.view()); ++end);
+      Code lo = next == codes_.begin() ? 0 : std::prev(next)->second;
+      Code hi = next == codes_.end() ? kEnd : next->second;
+      if (hi - lo <= end - begin) throw Overflow("StringDictionary::encodeAll: not enough codes left between the neighbours of the strings");
+      Code step = (hi - lo) / (end - begin + 1);
+      for (size_t i = begin; i < end; ++i) {
+        Entry entry = { .code = Code(lo + step * (i - begin + 1)), .value = Varchar<maxLength>(added[i]) };
+        append_(entry);
+        add_(entry);
+      }
+    }
+    std::vector<Value> res;
+    res.reserve(strings.size());
+    for (const std::string &s : strings) res.push_back(*find(s));
+    return res;
+  }
+  /// @returns the code of s, or nullopt if s is not in the dictionary.
+  auto find (std::string_view s) const -> std::optional<Value> {
+    if (s.empty()) return Value();
+    auto it = codes_.find(s);
+    if (it == codes_.end()) return std::nullopt;
+    return Value(it->second);
+  }
+  /// @returns the code of the least string not less than s, or one past all codes if there is none. s need not be in the dictionary.
+  auto lowerBound (std::string_view s) const -> Value {
+    if (s.empty()) return Value();
+    auto it = codes_.lower_bound(s);
+    return Value(it == codes_.end() ? kEnd : it->second);
+  }
+  /// @returns the string of a code. throws NotFound if the code is not from this dictionary.
+  auto decode (Value value) const -> const Varchar<maxLength> & {
+    if (value.code_ == 0) return empty_;
+    auto it = values_.find(value.code_);
+    if (it == values_.end()) throw NotFound("StringDictionary::decode: unknown code");
+    return it->second;
+  }
+  /// the number of strings added, not counting the empty string.
+  auto size () const -> size_t { return codes_.size(); }
+};
+} // namespace ak::file
+
+template <int maxLength, std::unsigned_integral Code>
+struct std::hash<ak::file::DictVarchar<maxLength, Code>> {
+  auto operator() (const ak::file::DictVarchar<maxLength, Code> &s) const -> size_t { return std::hash<Code>()(s.code()); }
+};
+
+#endif
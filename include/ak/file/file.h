@@ -15,9 +15,26 @@
 
 namespace ak::file {
 constexpr size_t kDefaultSzChunk = 4096;
-/// a chunked file storage with manual garbage collection, with chunk size of szChunk and a cache powered by unordered_map.
+using SnapshotId = size_t;
+/// reads with this snapshot id see the latest version.
+constexpr SnapshotId kLatestVersion = -1;
+/**
+ * a chunked file storage with manual garbage collection, with chunk size of szChunk and a cache powered by unordered_map.
+ *
+ * snapshots are copy-on-write: while a snapshot is open, the first set or remove of a chunk copies its old content to a spare chunk
+ * which reads at that snapshot are redirected to. the copies go back to the free list when the snapshot is released.
+ * snapshots live in memory, so copies of snapshots not released before the file is closed are leaked.
+ */
 template <size_t szChunk = kDefaultSzChunk>
 class File {
+ public:
+  /// disk I/O counters. reads served by the cache are not counted.
+  struct Stats {
+    size_t reads = 0;
+    size_t writes = 0;
+    size_t bytesRead = 0;
+    size_t bytesWritten = 0;
+  };
  private:
   struct Metadata {
     size_t next;
@@ -34,12 +51,73 @@ class File {
   auto offset_ (size_t index) -> size_t { return (index + 1) * szChunk; }
   std::fstream file_;
   std::unordered_map<size_t, char *> cache_;
+  Stats stats_;
   auto putCache_ (const void *buf, size_t index, size_t n) -> void {
     char *cache = new char[n];
     memcpy(cache, buf, n);
     if (cache_.count(index) > 0) delete[] cache_[index];
     cache_[index] = cache;
   }
+
+  /// for each open snapshot, the ids of the copies of the chunks changed since it is taken.
+  /// chunks allocated after the snapshot is taken are invisible to it and map to kNoCopy.
+  std::unordered_map<SnapshotId, std::unordered_map<size_t, size_t>> snapshots_;
+  static constexpr size_t kNoCopy = -1;
+  /// the number of snapshots sharing each copy.
+  std::unordered_map<size_t, size_t> copyRefs_;
+  SnapshotId nextSnapshot_ = 0;
+  /// keeps the current content of a chunk for the snapshots not having a copy of it yet.
+  auto preserve_ (size_t index) -> void {
+    size_t copy = -1;
+    for (auto &[ _, copies ] : snapshots_) {
+      if (copies.count(index) > 0) continue;
+      if (copy == -1) {
+        // chunks may be shorter than szChunk at the end of file, so the read may hit EOF.
+        char buf[szChunk];
+        memset(buf, 0, szChunk);
+        file_.seekg(offset_(index));
+        file_.read(buf, szChunk);
+        stats_.bytesRead += file_.gcount();
+        ++stats_.reads;
+        file_.clear();
+        copy = push_(buf, szChunk);
+      }
+      copies[index] = copy;
+      ++copyRefs_[copy];
+    }
+  }
+  /// write without keeping the old content for snapshots.
+  auto write_ (const void *buf, size_t index, size_t n) -> void {
+    if (index != -1) putCache_(buf, index, n);
+    file_.seekp(offset_(index));
+    file_.write((const char *) buf, n);
+    AK_ASSERT(file_.good());
+    ++stats_.writes;
+    stats_.bytesWritten += n;
+  }
+  /// allocate a chunk. new and freed chunks are never read at a snapshot, so they need not be preserved.
+  auto push_ (const void *buf, size_t n) -> size_t {
+    Metadata meta = meta_();
+    size_t id = meta.next;
+    if (meta.hasNext) {
+      Metadata nextMeta;
+      get(&nextMeta, meta.next, sizeof(nextMeta));
+      write_(&nextMeta, -1, sizeof(nextMeta));
+    } else {
+      ++meta.next;
+      write_(&meta, -1, sizeof(meta));
+    }
+    write_(buf, id, n);
+    return id;
+  }
+  auto remove_ (size_t index) -> void {
+    Metadata meta = meta_();
+    write_(&meta, index, sizeof(meta));
+    Metadata newMeta(index, true);
+    write_(&newMeta, -1, sizeof(newMeta));
+    if (cache_.count(index) > 0) delete[] cache_[index];
+    cache_.erase(index);
+  }
  public:
   File () = delete;
   File (const char *filename, const std::function<void (void)> &initializer) {
@@ -69,47 +147,76 @@ class File {
     file_.seekg(offset_(index));
     file_.read((char *) buf, n);
     AK_ASSERT(file_.good());
+    ++stats_.reads;
+    stats_.bytesRead += n;
     if (index != -1) putCache_(buf, index, n);
   }
-  /// write n bytes at index from buf.
+  /// read n bytes at index into buf, as it was when the snapshot was taken.
+  auto get (void *buf, size_t index, size_t n, SnapshotId snapshot) -> void {
+    if (snapshot != kLatestVersion) {
+      const auto &copies = snapshots_.at(snapshot);
+      auto it = copies.find(index);
+      if (it != copies.end() && it->second != kNoCopy) index = it->second;
+    }
+    get(buf, index, n);
+  }
+  /// write n bytes at index from buf. if the chunk is cached, only the range of bytes that changed is written.
   auto set (const void *buf, size_t index, size_t n) -> void {
-    if (index != -1) {
-      // dirty check
-      if (cache_.count(index) > 0 && memcmp(buf, cache_[index], n) == 0) return;
-      putCache_(buf, index, n);
+    if (index == -1 || cache_.count(index) == 0) {
+      if (index != -1 && !snapshots_.empty()) preserve_(index);
+      write_(buf, index, n);
+      return;
     }
-    file_.seekp(offset_(index));
-    file_.write((const char *) buf, n);
+    const char *bytes = (const char *) buf;
+    char *cache = cache_[index];
+    // compare word by word first, which the compiler turns into plain integer comparisons.
+    size_t begin = 0, end = n;
+    while (begin + sizeof(size_t) <= n && memcmp(bytes + begin, cache + begin, sizeof(size_t)) == 0) begin += sizeof(size_t);
+    while (begin < n && bytes[begin] == cache[begin]) ++begin;
+    if (begin == n) return;
+    while (end - begin >= sizeof(size_t) && memcmp(bytes + end - sizeof(size_t), cache + end - sizeof(size_t), sizeof(size_t)) == 0) end -= sizeof(size_t);
+    while (bytes[end - 1] == cache[end - 1]) --end;
+    if (!snapshots_.empty()) preserve_(index);
+    memcpy(cache + begin, bytes + begin, end - begin);
+    file_.seekp(offset_(index) + begin);
+    file_.write(bytes + begin, end - begin);
     AK_ASSERT(file_.good());
+    ++stats_.writes;
+    stats_.bytesWritten += end - begin;
   }
   /// @returns the stored index of the object
   auto push (const void *buf, size_t n) -> size_t {
-    Metadata meta = meta_();
-    size_t id = meta.next;
-    if (meta.hasNext) {
-      Metadata nextMeta;
-      get(&nextMeta, meta.next, sizeof(nextMeta));
-      set(&nextMeta, -1, sizeof(nextMeta));
-    } else {
-      ++meta.next;
-      set(&meta, -1, sizeof(meta));
-    }
-    set(buf, id, n);
+    size_t id = push_(buf, n);
+    for (auto &[ _, copies ] : snapshots_) copies.emplace(id, kNoCopy);
     return id;
   }
   auto remove (size_t index) -> void {
-    Metadata meta = meta_();
-    set(&meta, index, sizeof(meta));
-    Metadata newMeta(index, true);
-    set(&newMeta, -1, sizeof(newMeta));
-    if (cache_.count(index) > 0) delete[] cache_[index];
-    cache_.erase(index);
+    if (!snapshots_.empty()) preserve_(index);
+    remove_(index);
   }
 
+  /// pins the current version of all chunks until the snapshot is released.
+  auto createSnapshot () -> SnapshotId {
+    snapshots_[nextSnapshot_];
+    return nextSnapshot_++;
+  }
+  /// frees the copies only needed by this snapshot.
+  auto releaseSnapshot (SnapshotId snapshot) -> void {
+    for (const auto &[ _, copy ] : snapshots_.at(snapshot)) {
+      if (copy == kNoCopy || --copyRefs_[copy] > 0) continue;
+      copyRefs_.erase(copy);
+      remove_(copy);
+    }
+    snapshots_.erase(snapshot);
+  }
+
+  /// passes the writes buffered by the stream on to the OS, so that other handles of the file see them.
+  auto flush () -> void { file_.flush(); }
   auto clearCache () -> void {
     for (const auto &[ _, ptr ] : cache_) delete[] ptr;
     cache_.clear();
   }
+  auto stats () const -> const Stats & { return stats_; }
 };
 
 /**
@@ -119,10 +226,12 @@ class File {
  */
 template <typename T, size_t szChunk = kDefaultSzChunk>
 class ManagedObject {
- private:
+ protected:
+  // for objects that store themselves in another format, and thus have their own get, save and update.
   File<szChunk> *file_;
   size_t id_ = -1;
   ManagedObject (File<szChunk> &file, size_t id) : file_(&file), id_(id) {}
+ private:
   static auto getSize_ () -> size_t { return offsetof(T, _end) - offsetof(T, _start); }
   static auto getOffset_ () -> size_t { return offsetof(T, _start); }
  public:
@@ -132,9 +241,9 @@ class ManagedObject {
 
   auto id () -> size_t { return id_; }
 
-  static auto get (File<szChunk> &file, size_t id) -> T {
+  static auto get (File<szChunk> &file, size_t id, SnapshotId snapshot = kLatestVersion) -> T {
     char buf[sizeof(T)];
-    file.get(buf + getOffset_(), id, getSize_());
+    file.get(buf + getOffset_(), id, getSize_(), snapshot);
     ManagedObject &result = *reinterpret_cast<ManagedObject *>(buf);
     result.file_ = &file;
     result.id_ = id;
@@ -0,0 +1,337 @@
+#ifndef AK_LIB_FILE_HASHINDEX_H_
+#define AK_LIB_FILE_HASHINDEX_H_
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include "ak/base.h"
+#include "ak/compare.h"
+#include "ak/file/array.h"
+#include "ak/file/bloom.h"
+#include "ak/file/bptree.h"
+#include "ak/file/file.h"
+
+namespace ak::file {
+/**
+ * a persistent extendible hash index, for pure equality lookups. it has the insert, remove, findOne and findMany of BpTree,
+ * and the same key policies, but no order: a lookup reads a single bucket page (and its overflow pages, if any) instead of
+ * descending the tree.
+ *
+ * the directory maps the low globalDepth bits of the hash of a key to its bucket. it is kept in memory and written back to
+ * directory pages when a bucket splits. a full bucket splits in two by one more bit of the hash, doubling the directory if
+ * needed; entries that no bit can tell apart, i.e. those with equal hashes, go to overflow pages instead.
+ * buckets are not merged back on removal. every lookup walks all overflow pages of its bucket, so keys with many more duplicates
+ * than a page holds are better off in a BpTree.
+ *
+ * constraints: KeyType needs to be comparable and Hashable. ValueType needs to be comparable unless the keys are unique.
+ */
+template <
+  BptStorable KeyType,
+  std::copy_constructible ValueType,
+  size_t szChunk = kDefaultSzChunk,
+  BptKeyPolicy keyPolicy = BptKeyPolicy::DUPLICATE
+> requires Hashable<KeyType> && (keyPolicy == BptKeyPolicy::UNIQUE || Comparable<ValueType>)
+class HashIndex {
+ private:
+  static constexpr bool kUnique = keyPolicy == BptKeyPolicy::UNIQUE;
+  using PageId = unsigned int;
+  /// the directory has at most 2^kMaxDepth slots. beyond that, buckets grow overflow pages instead of splitting.
+  static constexpr size_t kMaxDepth = 24;
+  /**
+   * the directory only doubles while it has less than kMaxSlotsPerBucket slots per bucket the entries would fill.
+   * otherwise a few keys whose hashes share many low bits would blow it up, as would lots of duplicates in small buckets.
+   */
+  static constexpr size_t kMaxSlotsPerBucket = 8;
+
+  struct Entry {
+    size_t hash;
+    KeyType key;
+    ValueType value;
+  };
+  static constexpr size_t kBucketLength = (szChunk - 3 * sizeof(size_t)) / sizeof(Entry);
+  static_assert(kBucketLength >= 2);
+  static constexpr size_t kDirectoryPageLength = (szChunk - sizeof(size_t)) / sizeof(PageId);
+
+  struct Header : public ManagedObject<Header, szChunk> {
+    char _start[0];
+    size_t globalDepth;
+    size_t size;
+    PageId directory;
+    char _end[0];
+    Header (File<szChunk> &file) : ManagedObject<Header, szChunk>(file) {}
+  };
+  struct DirectoryPage : public ManagedObject<DirectoryPage, szChunk> {
+    char _start[0];
+    PageId next = 0;
+    PageId buckets[kDirectoryPageLength];
+    char _end[0];
+    DirectoryPage (File<szChunk> &file) : ManagedObject<DirectoryPage, szChunk>(file) {}
+  };
+  /// a bucket, or one of its overflow pages, whose localDepth is unused.
+  struct Bucket : public ManagedObject<Bucket, szChunk> {
+    char _start[0];
+    size_t localDepth = 0;
+    PageId overflow = 0;
+    Array<Entry, kBucketLength> entries;
+    char _end[0];
+    Bucket (File<szChunk> &file) : ManagedObject<Bucket, szChunk>(file) {}
+  };
+
+  File<szChunk> file_;
+  std::vector<PageId> directory_;
+  std::vector<PageId> directoryPages_;
+
+  static auto hashOf_ (const KeyType &key) -> size_t { return mixHash(std::hash<KeyType>()(key)); }
+  auto header_ () -> Header { return Header::get(file_, 0); }
+  auto bucketOf_ (size_t hash) -> PageId { return directory_[hash & (directory_.size() - 1)]; }
+  static auto matches_ (const Entry &entry, size_t hash, const KeyType &key) -> bool {
+    return entry.hash == hash && equals(entry.key, key);
+  }
+
+  /// writes the slots from begin on of directory_ back to the directory pages, allocating more of them if it has grown.
+  auto saveDirectory_ (size_t begin = 0) -> void {
+    size_t numPages = (directory_.size() + kDirectoryPageLength - 1) / kDirectoryPageLength;
+    while (directoryPages_.size() < numPages) {
+      DirectoryPage page(file_);
+      page.save();
+      DirectoryPage last = DirectoryPage::get(file_, directoryPages_.back());
+      last.next = page.id();
+      last.update();
+      directoryPages_.push_back(page.id());
+    }
+    for (size_t i = begin / kDirectoryPageLength; i < numPages; ++i) saveDirectoryPage_(i);
+  }
+  auto saveDirectoryPage_ (size_t ixPage) -> void {
+    DirectoryPage page = DirectoryPage::get(file_, directoryPages_[ixPage]);
+    size_t begin = ixPage * kDirectoryPageLength, end = std::min(directory_.size(), begin + kDirectoryPageLength);
+    std::copy(directory_.begin() + begin, directory_.begin() + end, page.buckets);
+    page.update();
+  }
+  auto loadDirectory_ () -> void {
+    Header header = header_();
+    directory_.resize(size_t(1) << header.globalDepth);
+    for (PageId id = header.directory; id != 0;) {
+      DirectoryPage page = DirectoryPage::get(file_, id);
+      size_t begin = directoryPages_.size() * kDirectoryPageLength;
+      size_t end = std::min(directory_.size(), begin + kDirectoryPageLength);
+      if (begin < end) std::copy(page.buckets, page.buckets + (end - begin), directory_.begin() + begin);
+      directoryPages_.push_back(id);
+      id = page.next;
+    }
+  }
+
+  /// calls callback on each page of the bucket until it returns true. @returns whether it did.
+  template <typename F>
+  auto findPage_ (PageId id, const F &callback) -> bool {
+    while (id != 0) {
+      Bucket page = Bucket::get(file_, id);
+      if (callback(page)) return true;
+      id = page.overflow;
+    }
+    return false;
+  }
+  /// adds entry to the first page of the bucket with room, or to a new overflow page right after head.
+  auto append_ (Bucket &head, const Entry &entry) -> void {
+    if (head.entries.length < kBucketLength) {
+      head.entries.push(entry);
+      return;
+    }
+    bool added = findPage_(head.overflow, [this, &entry] (Bucket &page) {
+      if (page.entries.length == kBucketLength) return false;
+      page.entries.push(entry);
+      page.update();
+      return true;
+    });
+    if (added) return;
+    Bucket page(file_);
+    page.overflow = head.overflow;
+    page.entries.push(entry);
+    page.save();
+    head.overflow = page.id();
+  }
+  /**
+   * whether splitting the full bucket head could make room for an entry with hash, i.e. whether its first page has an entry
+   * with another hash. a page full of a single hash only grows overflow pages, as no split would ever tell its entries apart.
+   */
+  auto splittable_ (Bucket &head, size_t hash) -> bool {
+    if (head.localDepth == kMaxDepth) return false;
+    if (head.localDepth == header_().globalDepth && directory_.size() >= kMaxSlotsPerBucket * (size() / kBucketLength + 1)) return false;
+    for (size_t i = 0; i < head.entries.length; ++i) if (head.entries[i].hash != hash) return true;
+    return false;
+  }
+  /// splits the bucket of hash by the next bit of the hash, moving the entries with the bit set to a new bucket.
+  auto split_ (Bucket &head, size_t hash) -> void {
+    Header header = header_();
+    const size_t oldLength = directory_.size();
+    if (head.localDepth == header.globalDepth) {
+      directory_.resize(2 * oldLength);
+      std::copy_n(directory_.begin(), oldLength, directory_.begin() + oldLength);
+      ++header.globalDepth;
+      header.update();
+    }
+    std::vector<Entry> entries;
+    for (PageId id = head.id(); id != 0;) {
+      Bucket page = id == head.id() ? head : Bucket::get(file_, id);
+      for (size_t i = 0; i < page.entries.length; ++i) entries.push_back(page.entries[i]);
+      if (id != head.id()) page.destroy();
+      id = page.overflow;
+    }
+    const size_t bit = size_t(1) << head.localDepth;
+    Bucket sibling(file_);
+    sibling.localDepth = ++head.localDepth;
+    head.entries.clear();
+    head.overflow = 0;
+    for (const Entry &entry : entries) if ((entry.hash & bit) == 0) append_(head, entry);
+    for (const Entry &entry : entries) if ((entry.hash & bit) != 0) append_(sibling, entry);
+    sibling.save();
+    head.update();
+    // the slots of the bucket are those ending with its bits, every 2^localDepth slots.
+    size_t lastPage = -1;
+    for (size_t i = (hash & (bit - 1)) | bit; i < directory_.size(); i += bit << 1) {
+      directory_[i] = sibling.id();
+      if (i < oldLength && i / kDirectoryPageLength != lastPage) saveDirectoryPage_(lastPage = i / kDirectoryPageLength);
+    }
+    saveDirectory_(oldLength);
+  }
+  auto addSize_ (long delta) -> void {
+    Header header = header_();
+    header.size += delta;
+    header.update();
+  }
+
+  /// removes the first entry satisfying pred from the bucket of hash. overflow pages left empty are dropped.
+  template <typename Pred>
+  auto remove_ (size_t hash, const Pred &pred) -> void {
+    PageId prev = 0;
+    for (PageId id = bucketOf_(hash); id != 0;) {
+      Bucket page = Bucket::get(file_, id);
+      for (size_t i = 0; i < page.entries.length; ++i) {
+        if (!pred(page.entries[i])) continue;
+        page.entries.removeAt(i);
+        if (page.entries.length == 0 && prev != 0) {
+          Bucket prevPage = Bucket::get(file_, prev);
+          prevPage.overflow = page.overflow;
+          prevPage.update();
+          page.destroy();
+        } else {
+          page.update();
+        }
+        addSize_(-1);
+        return;
+      }
+      prev = id;
+      id = page.overflow;
+    }
+    throw NotFound("HashIndex::remove: entry not found");
+  }
+
+  auto init_ () -> void {
+    Header header(file_);
+    header.globalDepth = header.size = 0;
+    header.directory = 0;
+    header.save();
+    AK_ASSERT(header.id() == 0);
+    Bucket bucket(file_);
+    bucket.save();
+    DirectoryPage page(file_);
+    page.buckets[0] = bucket.id();
+    page.save();
+    header.directory = page.id();
+    header.update();
+  }
+ public:
+  HashIndex () = delete;
+  HashIndex (const char *filename) : file_(filename, [this] () { init_(); }) { loadDirectory_(); }
+
+  /// in unique indexes, this overwrites the value if the key is already present.
+  auto insert (const KeyType &key, const ValueType &value) -> void {
+    const size_t hash = hashOf_(key);
+    if constexpr (kUnique) {
+      bool updated = findPage_(bucketOf_(hash), [&] (Bucket &page) {
+        for (size_t i = 0; i < page.entries.length; ++i) {
+          if (!matches_(page.entries[i], hash, key)) continue;
+          page.entries[i].value = value;
+          page.update();
+          return true;
+        }
+        return false;
+      });
+      if (updated) return;
+    }
+    Bucket head = Bucket::get(file_, bucketOf_(hash));
+    while (head.entries.length == kBucketLength && splittable_(head, hash)) {
+      split_(head, hash);
+      head = Bucket::get(file_, bucketOf_(hash));
+    }
+    append_(head, { .hash = hash, .key = key, .value = value });
+    head.update();
+    addSize_(1);
+  }
+  auto remove (const KeyType &key, const ValueType &value) -> void requires (!kUnique) {
+    const size_t hash = hashOf_(key);
+    remove_(hash, [&] (const Entry &entry) { return matches_(entry, hash, key) && equals(entry.value, value); });
+  }
+  auto remove (const KeyType &key) -> void requires kUnique {
+    const size_t hash = hashOf_(key);
+    remove_(hash, [&] (const Entry &entry) { return matches_(entry, hash, key); });
+  }
+  auto findOne (const KeyType &key) -> std::optional<ValueType> {
+    if constexpr (kUnique) {
+      const size_t hash = hashOf_(key);
+      std::optional<ValueType> res;
+      findPage_(bucketOf_(hash), [&] (Bucket &page) {
+        for (size_t i = 0; i < page.entries.length; ++i) {
+          if (!matches_(page.entries[i], hash, key)) continue;
+          res = page.entries[i].value;
+          return true;
+        }
+        return false;
+      });
+      return res;
+    } else {
+      // the least value, as BpTree would return.
+      std::vector<ValueType> values = findMany(key);
+      if (values.empty()) return std::nullopt;
+      return values[0];
+    }
+  }
+  /// @returns the values of the key in order, as BpTree would.
+  auto findMany (const KeyType &key) -> std::vector<ValueType> {
+    const size_t hash = hashOf_(key);
+    std::vector<ValueType> res;
+    findPage_(bucketOf_(hash), [&] (Bucket &page) {
+      for (size_t i = 0; i < page.entries.length; ++i) if (matches_(page.entries[i], hash, key)) res.push_back(page.entries[i].value);
+      return false;
+    });
+    if constexpr (!kUnique) std::sort(res.begin(), res.end());
+    return res;
+  }
+  auto includes (const KeyType &key, const ValueType &value) -> bool requires (!kUnique) {
+    const size_t hash = hashOf_(key);
+    return findPage_(bucketOf_(hash), [&] (Bucket &page) {
+      for (size_t i = 0; i < page.entries.length; ++i) {
+        if (matches_(page.entries[i], hash, key) && equals(page.entries[i].value, value)) return true;
+      }
+      return false;
+    });
+  }
+  auto includes (const KeyType &key) -> bool {
+    const size_t hash = hashOf_(key);
+    return findPage_(bucketOf_(hash), [&] (Bucket &page) {
+      for (size_t i = 0; i < page.entries.length; ++i) if (matches_(page.entries[i], hash, key)) return true;
+      return false;
+    });
+  }
+
+  /// @returns the number of entries.
+  auto size () -> size_t { return header_().size; }
+  /// @returns the number of bits of the hash the directory is indexed by.
+  auto globalDepth () -> size_t { return header_().globalDepth; }
+  /// @returns the disk I/O counters of the index file.
+  auto fileStats () const -> const typename File<szChunk>::Stats & { return file_.stats(); }
+  auto clearCache () -> void { file_.clearCache(); }
+};
+} // namespace ak::file
+
+#endif
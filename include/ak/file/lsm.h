@@ -0,0 +1,579 @@
+#ifndef AK_LIB_FILE_LSM_H_
+#define AK_LIB_FILE_LSM_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+#include <compare>
+#include <concepts>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ak/base.h"
+#include "ak/compare.h"
+#include "ak/file/array.h"
+#include "ak/file/bloom.h"
+#include "ak/file/bptree.h"
+#include "ak/file/file.h"
+
+namespace ak::file {
+/**
+ * a log-structured merge tree, for append-heavy data where the in-place updates of BpTree cost too many writes.
+ * it has the insert, remove, findOne, findMany, findAll and includes of BpTree, and the same key policies.
+ *
+ * writes go to an in-memory sorted memtable, and to an append-only log to survive restarts. a full memtable is written out
+ * sequentially as an immutable sorted run, with a sparse index of the first entry of each page and a bloom filter of its keys,
+ * both loaded in memory when the run is opened. a lookup checks the memtable, then the runs from newest to oldest, reading
+ * one page of each run whose filter does not rule the key out.
+ *
+ * runs are compacted size-tiered on a background thread: once a level has kRunsPerLevel runs, they are merged into a single
+ * run of the next level. removals write tombstones, which are dropped once merged into the oldest level.
+ *
+ * files: `<prefix>.manifest` lists the runs, `<prefix>.log` is the log, and each run is `<prefix>.<seq>.run`.
+ *
+ * unlike BpTree, removals are blind: removing an absent entry is not an error. with duplicate keys, entries are a set of
+ * (key, value) pairs, so inserting one twice keeps one copy.
+ * calls need to be serialized, as in BpTree; only the compaction runs on its own.
+ *
+ * constraints: KeyType needs to be comparable and Hashable. ValueType needs to be comparable unless the keys are unique.
+ * both are written to disk as they are in memory, as with ManagedObject.
+ */
+template <
+  BptStorable KeyType,
+  std::copy_constructible ValueType,
+  size_t szChunk = kDefaultSzChunk,
+  BptKeyPolicy keyPolicy = BptKeyPolicy::DUPLICATE
+> requires Hashable<KeyType> && (keyPolicy == BptKeyPolicy::UNIQUE || Comparable<ValueType>)
+class LsmTree {
+ public:
+  /// the number of runs that make a level full and get merged into the next one.
+  static constexpr size_t kRunsPerLevel = 4;
+  /// writes stall while level 0 has this many runs waiting for compaction.
+  static constexpr size_t kMaxLevel0Runs = 3 * kRunsPerLevel;
+  static constexpr size_t kDefaultMemtableCapacity = 65536;
+ private:
+  static constexpr bool kUnique = keyPolicy == BptKeyPolicy::UNIQUE;
+  static constexpr size_t kBloomBitsPerKey = 10;
+
+  // data structures
+  /// same as BpTree::Pair.
+  struct Pair {
+    KeyType key;
+    ValueType value;
+    /// one comparison of the keys, and of the values if the keys are equivalent.
+    auto operator<=> (const Pair &that) const -> std::weak_ordering {
+      std::weak_ordering res = compare(key, that.key);
+      if constexpr (!kUnique) {
+        if (res == 0) return compare(value, that.value);
+      }
+      return res;
+    }
+  };
+  /// orders pairs, and pairs against keys, so that the memtable can be searched by key.
+  struct PairLess {
+    using is_transparent = void;
+    auto operator() (const Pair &lhs, const Pair &rhs) const -> bool { return lhs < rhs; }
+    auto operator() (const Pair &lhs, const KeyType &rhs) const -> bool { return lhs.key < rhs; }
+    auto operator() (const KeyType &lhs, const Pair &rhs) const -> bool { return lhs < rhs.key; }
+  };
+  using Memtable = std::map<Pair, bool, PairLess>;
+  struct Record {
+    Pair entry;
+    bool tombstone;
+  };
+  /// calls return the records of a source in order, then nullopt.
+  using Source = std::function<std::optional<Record> ()>;
+
+  /// an immutable sorted run: a header, the data pages, the pages of the sparse index, and the pages of the bloom filter.
+  class Run {
+   public:
+    static constexpr size_t kPageLength = (szChunk - sizeof(size_t)) / sizeof(Record);
+    static_assert(kPageLength >= 1);
+    static constexpr size_t kFencePageLength = (szChunk - sizeof(size_t)) / sizeof(Pair);
+    static_assert(kFencePageLength >= 1);
+    static constexpr size_t kBloomPageBits = szChunk * 8;
+    struct Header : public ManagedObject<Header, szChunk> {
+      char _start[0];
+      size_t numEntries = 0;
+      size_t numPages = 0;
+      size_t numFencePages = 0;
+      size_t numBloomPages = 0;
+      size_t numHashes = 0;
+      char _end[0];
+      Header (File<szChunk> &file) : ManagedObject<Header, szChunk>(file) {}
+    };
+    struct Page : public ManagedObject<Page, szChunk> {
+      char _start[0];
+      Array<Record, kPageLength> records;
+      char _end[0];
+      Page (File<szChunk> &file) : ManagedObject<Page, szChunk>(file) {}
+    };
+    struct FencePage : public ManagedObject<FencePage, szChunk> {
+      char _start[0];
+      Array<Pair, kFencePageLength> fences;
+      char _end[0];
+      FencePage (File<szChunk> &file) : ManagedObject<FencePage, szChunk>(file) {}
+    };
+
+    /// writes a run sequentially. capacity is an upper bound of the number of records, to size the bloom filter by.
+    class Builder {
+     private:
+      File<szChunk> file_;
+      Page page_;
+      std::vector<Pair> fences_;
+      std::vector<uint64_t> bloom_;
+      size_t numHashes_;
+      size_t numEntries_ = 0;
+      static auto truncate_ (const std::string &path) -> const char * {
+        ::remove(path.c_str());
+        return path.c_str();
+      }
+      auto flushPage_ () -> void {
+        if (page_.records.length == 0) return;
+        page_.save();
+        page_ = Page(file_);
+      }
+     public:
+      Builder (const std::string &path, size_t capacity)
+        : file_(truncate_(path), [this] () { Header(file_).save(); }), page_(file_),
+          bloom_(std::max<size_t>(1, (capacity * kBloomBitsPerKey + kBloomPageBits - 1) / kBloomPageBits) * (kBloomPageBits / 64)),
+          numHashes_(std::clamp<size_t>(std::lround((double) kBloomBitsPerKey * std::numbers::ln2), 1, 30)) {}
+
+      auto append (const Record &record) -> void {
+        if (page_.records.length == kPageLength) flushPage_();
+        if (page_.records.length == 0) fences_.push_back(record.entry);
+        page_.records.push(record);
+        size_t numBits = bloom_.size() * 64;
+        forEachBit_(hashOf_(record.entry.key), numHashes_, numBits, [this] (size_t bit) { bloom_[bit / 64] |= uint64_t(1) << (bit % 64); });
+        ++numEntries_;
+      }
+      auto stats () const -> const typename File<szChunk>::Stats & { return file_.stats(); }
+      auto finish () -> void {
+        flushPage_();
+        Header header = Header::get(file_, 0);
+        header.numEntries = numEntries_;
+        header.numPages = fences_.size();
+        for (size_t i = 0; i < fences_.size(); i += kFencePageLength) {
+          FencePage page(file_);
+          for (size_t j = i; j < std::min(fences_.size(), i + kFencePageLength); ++j) page.fences.push(fences_[j]);
+          page.save();
+          ++header.numFencePages;
+        }
+        for (size_t i = 0; i < bloom_.size(); i += kBloomPageBits / 64) {
+          file_.push(&bloom_[i], szChunk);
+          ++header.numBloomPages;
+        }
+        header.numHashes = numHashes_;
+        header.update();
+      }
+    };
+
+    /// iterates the records of a run in order, reading each page once.
+    class Cursor {
+     private:
+      Run *run_;
+      size_t page_;
+      size_t ix_ = 0;
+      std::optional<Page> current_;
+     public:
+      Cursor (Run &run, size_t page) : run_(&run), page_(page) {}
+      auto operator() () -> std::optional<Record> {
+        while (true) {
+          if (page_ >= run_->header_.numPages) return std::nullopt;
+          if (!current_) current_.emplace(Page::get(run_->file_, 1 + page_));
+          if (ix_ < current_->records.length) return current_->records[ix_++];
+          ++page_;
+          ix_ = 0;
+          current_.reset();
+        }
+      }
+    };
+
+   private:
+    File<szChunk> file_;
+    Header header_;
+    std::vector<Pair> fences_;
+    std::vector<uint64_t> bloom_;
+   public:
+    const size_t seq;
+    Run (const std::string &path, size_t seq) : file_(path.c_str(), [] () {}), header_(Header::get(file_, 0)), seq(seq) {
+      size_t id = 1 + header_.numPages;
+      for (size_t i = 0; i < header_.numFencePages; ++i, ++id) {
+        FencePage page = FencePage::get(file_, id);
+        for (size_t j = 0; j < page.fences.length; ++j) fences_.push_back(page.fences[j]);
+      }
+      bloom_.resize(header_.numBloomPages * (kBloomPageBits / 64));
+      for (size_t i = 0; i < header_.numBloomPages; ++i, ++id) file_.get(&bloom_[i * (kBloomPageBits / 64)], id, szChunk);
+    }
+
+    auto size () const -> size_t { return header_.numEntries; }
+    auto mayContain (const KeyType &key) const -> bool {
+      bool res = true;
+      forEachBit_(hashOf_(key), header_.numHashes, bloom_.size() * 64, [this, &res] (size_t bit) {
+        res = res && (bloom_[bit / 64] >> (bit % 64) & 1) != 0;
+      });
+      return res;
+    }
+    /// @returns a cursor from the page the first record with key would be in.
+    auto seek (const KeyType &key) -> Cursor {
+      // the pages starting before key, the last of which may hold its first record.
+      size_t before = std::lower_bound(fences_.begin(), fences_.end(), key, [] (const Pair &fence, const KeyType &key) { return fence.key < key; }) - fences_.begin();
+      return Cursor(*this, before == 0 ? 0 : before - 1);
+    }
+    auto begin () -> Cursor { return Cursor(*this, 0); }
+    auto stats () const -> const typename File<szChunk>::Stats & { return file_.stats(); }
+    auto clearCache () -> void { file_.clearCache(); }
+  };
+
+  struct RunInfo {
+    size_t seq;
+    size_t level;
+  };
+  static constexpr size_t kManifestPageLength = (szChunk - 3 * sizeof(size_t)) / sizeof(RunInfo);
+  static_assert(kManifestPageLength >= 1);
+  /// the runs, in pages chained from page 0, which also holds nextSeq.
+  struct Manifest : public ManagedObject<Manifest, szChunk> {
+    char _start[0];
+    size_t nextSeq = 0;
+    size_t next = 0;
+    Array<RunInfo, kManifestPageLength> runs;
+    char _end[0];
+    Manifest (File<szChunk> &file) : ManagedObject<Manifest, szChunk>(file) {}
+  };
+
+  std::string prefix_;
+  File<szChunk> manifestFile_;
+  Memtable memtable_;
+  size_t memtableCapacity_ = kDefaultMemtableCapacity;
+  std::ofstream log_;
+  size_t nextSeq_;
+  /// levels_[i] holds the runs of level i, newest first.
+  std::vector<std::vector<std::unique_ptr<Run>>> levels_;
+  // guards levels_ and the manifest against the compaction thread.
+  std::mutex mutex_;
+  std::condition_variable compactionChanged_;
+  bool compacting_ = false;
+  bool stopping_ = false;
+  std::thread compactor_;
+  /// the I/O of the runs written or closed so far. the log has its own, as it is written without the lock.
+  typename File<szChunk>::Stats stats_;
+  typename File<szChunk>::Stats logStats_;
+
+  // helper functions
+  static auto addStats_ (typename File<szChunk>::Stats &to, const typename File<szChunk>::Stats &from) -> void {
+    to.reads += from.reads;
+    to.writes += from.writes;
+    to.bytesRead += from.bytesRead;
+    to.bytesWritten += from.bytesWritten;
+  }
+  static auto hashOf_ (const KeyType &key) -> size_t { return mixHash(std::hash<KeyType>()(key)); }
+  /// calls callback with the bit positions of a key with hash in a filter of numBits bits.
+  template <typename F>
+  static auto forEachBit_ (size_t hash, size_t numHashes, size_t numBits, const F &callback) -> void {
+    size_t h1 = hash & 0xffffffffULL, h2 = (hash >> 32) | 1;
+    for (size_t i = 0; i < numHashes; ++i) callback((h1 + i * h2) % numBits);
+  }
+  auto runPath_ (size_t seq) const -> std::string { return prefix_ + "." + std::to_string(seq) + ".run"; }
+  auto logPath_ () const -> std::string { return prefix_ + ".log"; }
+
+  /**
+   * merges sources, newest first, calling callback with their records in order. of the records with the same entry, only the
+   * one from the newest source is kept, and it is dropped too if it is a tombstone and dropTombstones.
+   */
+  template <typename F>
+  static auto merge_ (std::vector<Source> &sources, bool dropTombstones, const F &callback) -> void {
+    std::vector<std::optional<Record>> heads;
+    for (Source &source : sources) heads.push_back(source());
+    while (true) {
+      // a strict comparison keeps the newest of the equal heads.
+      size_t best = heads.size();
+      for (size_t i = 0; i < heads.size(); ++i) {
+        if (heads[i] && (best == heads.size() || heads[i]->entry < heads[best]->entry)) best = i;
+      }
+      if (best == heads.size()) return;
+      Record record = *heads[best];
+      for (size_t i = 0; i < heads.size(); ++i) {
+        if (heads[i] && equals(heads[i]->entry, record.entry)) heads[i] = sources[i]();
+      }
+      if (!dropTombstones || !record.tombstone) callback(record);
+    }
+  }
+  static auto memtableSource_ (const Memtable &memtable) -> Source {
+    return [it = memtable.begin(), end = memtable.end()] () mutable -> std::optional<Record> {
+      if (it == end) return std::nullopt;
+      Record record { .entry = it->first, .tombstone = it->second };
+      ++it;
+      return record;
+    };
+  }
+  /// @returns the records with key from the sources, newest first.
+  auto sourcesOf_ (const KeyType &key) -> std::vector<Source> {
+    std::vector<Source> res;
+    res.push_back([it = memtable_.lower_bound(key), end = memtable_.end(), key] () mutable -> std::optional<Record> {
+      if (it == end || !equals(it->first.key, key)) return std::nullopt;
+      Record record { .entry = it->first, .tombstone = it->second };
+      ++it;
+      return record;
+    });
+    for (auto &level : levels_) {
+      for (auto &run : level) {
+        if (!run->mayContain(key)) continue;
+        res.push_back([cursor = run->seek(key), key] () mutable -> std::optional<Record> {
+          while (true) {
+            std::optional<Record> record = cursor();
+            if (!record || key < record->entry.key) return std::nullopt;
+            if (equals(record->entry.key, key)) return record;
+          }
+        });
+      }
+    }
+    return res;
+  }
+  auto findMany_ (const KeyType &key) -> std::vector<ValueType> {
+    std::vector<Source> sources = sourcesOf_(key);
+    std::vector<ValueType> res;
+    merge_(sources, true, [&res] (const Record &record) { res.push_back(record.entry.value); });
+    return res;
+  }
+
+  /// unlike operator[], this replaces the value stored in the key too.
+  auto put_ (const Pair &entry, bool tombstone) -> void {
+    memtable_.erase(entry);
+    memtable_.emplace(entry, tombstone);
+  }
+  auto write_ (const Pair &entry, bool tombstone) -> void {
+    Record record { .entry = entry, .tombstone = tombstone };
+    log_.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    log_.flush();
+    ++logStats_.writes;
+    logStats_.bytesWritten += sizeof(record);
+    put_(entry, tombstone);
+    if (memtable_.size() >= memtableCapacity_) flush();
+  }
+  auto saveManifest_ () -> void {
+    std::vector<RunInfo> infos;
+    for (size_t level = 0; level < levels_.size(); ++level) {
+      for (auto &run : levels_[level]) infos.push_back({ .seq = run->seq, .level = level });
+    }
+    Manifest page = Manifest::get(manifestFile_, 0);
+    page.nextSeq = nextSeq_;
+    for (size_t i = 0; ; ) {
+      page.runs.clear();
+      for (; i < infos.size() && page.runs.length < kManifestPageLength; ++i) page.runs.push(infos[i]);
+      if (i == infos.size()) {
+        for (size_t id = page.next; id != 0; ) {
+          Manifest rest = Manifest::get(manifestFile_, id);
+          id = rest.next;
+          rest.destroy();
+        }
+        page.next = 0;
+        page.update();
+        return;
+      }
+      if (page.next == 0) {
+        Manifest next(manifestFile_);
+        next.save();
+        page.next = next.id();
+      }
+      page.update();
+      page = Manifest::get(manifestFile_, page.next);
+    }
+  }
+  /// @returns the lowest level full of runs, if any.
+  auto fullLevel_ () -> std::optional<size_t> {
+    for (size_t level = 0; level < levels_.size(); ++level) if (levels_[level].size() >= kRunsPerLevel) return level;
+    return std::nullopt;
+  }
+  /// merges the runs of a full level into one run of the next level. only the install of the result holds the lock.
+  auto compact_ (std::unique_lock<std::mutex> &lock, size_t level) -> void {
+    std::vector<size_t> seqs;
+    for (auto &run : levels_[level]) seqs.push_back(run->seq);
+    const size_t seq = nextSeq_++;
+    // tombstones can go once nothing older is left under them.
+    bool dropTombstones = true;
+    for (size_t i = level + 1; i < levels_.size(); ++i) dropTombstones = dropTombstones && levels_[i].empty();
+    lock.unlock();
+
+    // the inputs are opened again, as File is not thread-safe.
+    std::vector<std::unique_ptr<Run>> inputs;
+    std::vector<Source> sources;
+    typename File<szChunk>::Stats stats;
+    size_t capacity = 0;
+    for (size_t s : seqs) {
+      inputs.push_back(std::make_unique<Run>(runPath_(s), s));
+      capacity += inputs.back()->size();
+      sources.push_back(inputs.back()->begin());
+    }
+    {
+      typename Run::Builder builder(runPath_(seq), capacity);
+      merge_(sources, dropTombstones, [&builder] (const Record &record) { builder.append(record); });
+      builder.finish();
+      addStats_(stats, builder.stats());
+    }
+    sources.clear();
+    for (auto &input : inputs) addStats_(stats, input->stats());
+    inputs.clear();
+    auto output = std::make_unique<Run>(runPath_(seq), seq);
+
+    lock.lock();
+    addStats_(stats_, stats);
+    auto &runs = levels_[level];
+    auto isInput = [&seqs] (const auto &run) { return std::find(seqs.begin(), seqs.end(), run->seq) != seqs.end(); };
+    for (auto &run : runs) if (isInput(run)) addStats_(stats_, run->stats());
+    runs.erase(std::remove_if(runs.begin(), runs.end(), isInput), runs.end());
+    if (levels_.size() == level + 1) levels_.emplace_back();
+    levels_[level + 1].insert(levels_[level + 1].begin(), std::move(output));
+    saveManifest_();
+    for (size_t s : seqs) ::remove(runPath_(s).c_str());
+  }
+  auto compactLoop_ () -> void {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      compactionChanged_.wait(lock, [this] () { return stopping_ || fullLevel_(); });
+      if (stopping_) return;
+      compacting_ = true;
+      compact_(lock, *fullLevel_());
+      compacting_ = false;
+      compactionChanged_.notify_all();
+    }
+  }
+
+  auto init_ () -> void {
+    Manifest manifest(manifestFile_);
+    manifest.save();
+    AK_ASSERT(manifest.id() == 0);
+  }
+  auto open_ () -> void {
+    nextSeq_ = Manifest::get(manifestFile_, 0).nextSeq;
+    for (size_t id = 0; ; ) {
+      Manifest page = Manifest::get(manifestFile_, id);
+      for (size_t i = 0; i < page.runs.length; ++i) {
+        const RunInfo &info = page.runs[i];
+        if (levels_.size() <= info.level) levels_.resize(info.level + 1);
+        levels_[info.level].push_back(std::make_unique<Run>(runPath_(info.seq), info.seq));
+      }
+      if (page.next == 0) break;
+      id = page.next;
+    }
+    // replay the writes not flushed into a run yet.
+    std::ifstream log(logPath_(), std::ios_base::binary);
+    Record record;
+    while (log.read(reinterpret_cast<char *>(&record), sizeof(record))) put_(record.entry, record.tombstone);
+    log.close();
+    log_.open(logPath_(), std::ios_base::binary | std::ios_base::app);
+    if (!log_.is_open()) throw IOException("LsmTree: unable to open the log");
+  }
+ public:
+  LsmTree () = delete;
+  LsmTree (const char *prefix) : prefix_(prefix), manifestFile_((prefix_ + ".manifest").c_str(), [this] () { init_(); }) {
+    open_();
+    compactor_ = std::thread([this] () { compactLoop_(); });
+  }
+  LsmTree (const LsmTree &) = delete;
+  auto operator= (const LsmTree &) -> LsmTree & = delete;
+  /// flushes the memtable, and waits for the compaction in progress, if any.
+  ~LsmTree () {
+    flush();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    compactionChanged_.notify_all();
+    compactor_.join();
+  }
+
+  /// sets the number of entries the memtable holds before it is written out as a run. this is not persisted.
+  auto setMemtableCapacity (size_t capacity) -> void { memtableCapacity_ = std::max<size_t>(1, capacity); }
+
+  /// in unique trees, this overwrites the value if the key is already present.
+  auto insert (const KeyType &key, const ValueType &value) -> void { write_({ .key = key, .value = value }, false); }
+  auto remove (const KeyType &key, const ValueType &value) -> void requires (!kUnique) { write_({ .key = key, .value = value }, true); }
+  /// the tombstone of a unique key is a Pair too, as runs store them as they are in memory, so its value is value-initialized.
+  auto remove (const KeyType &key) -> void requires kUnique && std::default_initializable<ValueType> {
+    write_({ .key = key, .value = ValueType() }, true);
+  }
+  auto findOne (const KeyType &key) -> std::optional<ValueType> {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<ValueType> values = findMany_(key);
+    if (values.empty()) return std::nullopt;
+    return values[0];
+  }
+  auto findMany (const KeyType &key) -> std::vector<ValueType> {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return findMany_(key);
+  }
+  auto findAll () -> std::vector<std::pair<KeyType, ValueType>> {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Source> sources { memtableSource_(memtable_) };
+    for (auto &level : levels_) for (auto &run : level) sources.push_back(run->begin());
+    std::vector<std::pair<KeyType, ValueType>> res;
+    merge_(sources, true, [&res] (const Record &record) { res.emplace_back(record.entry.key, record.entry.value); });
+    return res;
+  }
+  auto includes (const KeyType &key, const ValueType &value) -> bool requires (!kUnique) {
+    std::vector<ValueType> values = findMany(key);
+    return std::binary_search(values.begin(), values.end(), value);
+  }
+  auto includes (const KeyType &key) -> bool { return findOne(key).has_value(); }
+
+  /// writes the memtable out as a run of level 0, waiting first if too many of those are waiting for compaction.
+  auto flush () -> void {
+    if (memtable_.empty()) return;
+    std::unique_lock<std::mutex> lock(mutex_);
+    compactionChanged_.wait(lock, [this] () { return levels_.empty() || levels_[0].size() < kMaxLevel0Runs; });
+    const size_t seq = nextSeq_++;
+    {
+      typename Run::Builder builder(runPath_(seq), memtable_.size());
+      for (const auto &[ entry, tombstone ] : memtable_) builder.append({ .entry = entry, .tombstone = tombstone });
+      builder.finish();
+      addStats_(stats_, builder.stats());
+    }
+    if (levels_.empty()) levels_.emplace_back();
+    levels_[0].insert(levels_[0].begin(), std::make_unique<Run>(runPath_(seq), seq));
+    saveManifest_();
+    memtable_.clear();
+    log_.close();
+    log_.open(logPath_(), std::ios_base::binary | std::ios_base::trunc);
+    compactionChanged_.notify_all();
+  }
+  /// waits until no level is full and no compaction is in progress.
+  auto waitForCompaction () -> void {
+    std::unique_lock<std::mutex> lock(mutex_);
+    compactionChanged_.wait(lock, [this] () { return !compacting_ && !fullLevel_(); });
+  }
+  /// @returns the number of runs in each level.
+  auto levels () -> std::vector<size_t> {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<size_t> res;
+    for (auto &level : levels_) res.push_back(level.size());
+    return res;
+  }
+  /// the disk I/O of all files of the tree so far, including compactions.
+  auto fileStats () -> typename File<szChunk>::Stats {
+    std::lock_guard<std::mutex> lock(mutex_);
+    typename File<szChunk>::Stats res = stats_;
+    addStats_(res, logStats_);
+    addStats_(res, manifestFile_.stats());
+    for (auto &level : levels_) for (auto &run : level) addStats_(res, run->stats());
+    return res;
+  }
+  auto clearCache () -> void {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &level : levels_) for (auto &run : level) run->clearCache();
+  }
+};
+} // namespace ak::file
+
+#endif
@@ -4,18 +4,52 @@
 #include <string.h>
 
 #include <algorithm>
+#include <compare>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
 
 #include "ak/base.h"
 #include "ak/compare.h"
+#include "ak/file/array.h"
+#include "ak/setops.h"
 
 // FIXME: remove dupe code of Set and Array. does C++ support mixins?
 namespace ak::file {
-/// a sorted array with utility functions and bound checks.
-template <typename T, size_t maxLength>
+/// a sorted array with utility functions and bound checks, as checkPolicy says.
+template <typename T, size_t maxLength, CheckPolicy checkPolicy = CheckPolicy::CHECKED>
 struct Set {
  private:
-  auto boundsCheck_ (size_t index) -> void {
-    if (index >= length) throw OutOfBounds("Set: overflow or underflow");
+  template <typename E>
+  static auto check_ (bool ok, const char *message) -> void {
+    if constexpr (checkPolicy == CheckPolicy::CHECKED) {
+      if (!ok) throw E(message);
+    } else if constexpr (checkPolicy == CheckPolicy::DEBUG) {
+      AK_ASSERT(ok);
+    }
+  }
+  auto boundsCheck_ (size_t index) const -> void { check_<OutOfBounds>(index < length, "Set: overflow or underflow"); }
+  /// indexOfInsert, and whether the element there is equivalent to element. elements with <=> take one comparison per step.
+  auto find_ (const T &element) const -> std::pair<size_t, bool> {
+    if constexpr (ThreeWayComparable<T>) {
+      size_t lo = 0, hi = length;
+      bool found = false;
+      while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        std::weak_ordering res = compare(content[mid], element);
+        if (res < 0) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+          found = res == 0;
+        }
+      }
+      return { lo, found };
+    } else {
+      size_t ix = std::lower_bound(content, content + length, element) - content;
+      return { ix, ix < length && equals(content[ix], element) };
+    }
   }
  public:
   Set () = default;
@@ -24,17 +58,24 @@ struct Set {
   auto indexOfInsert (const T &element) -> size_t {
     return std::lower_bound(content, content + length, element) - content;
   }
+  /// @returns the index of element, or npos.
+  auto find (const T &element) const -> size_t {
+    auto [ index, found ] = find_(element);
+    return found ? index : npos;
+  }
   auto indexOf (const T &element) -> size_t {
-    size_t index = indexOfInsert(element);
-    if (index >= length || !equals(content[index], element)) throw NotFound("Set::indexOf: element not found");
+    size_t index = find(element);
+    if (index == npos) throw NotFound("Set::indexOf: element not found");
     return index;
   }
-  auto includes (const T &element) -> bool {
-    size_t ix = indexOfInsert(element);
-    return ix < length && equals(content[ix], element);
+  auto includes (const T &element) -> bool { return find_(element).second; }
+  /// @returns the element at index, or nullopt if index is out of bounds, whatever the check policy.
+  auto get (size_t index) const -> std::optional<T> {
+    if (index >= length) return std::nullopt;
+    return content[index];
   }
   auto insert (const T &element) -> void {
-    if (length == maxLength) throw Overflow("Set::insert: overflow");
+    check_<Overflow>(length < maxLength, "Set::insert: overflow");
     size_t offset = indexOfInsert(element);
     if (offset != length) memmove(&content[offset + 1], &content[offset], (length - offset) * sizeof(content[0]));
     content[offset] = element;
@@ -54,15 +95,15 @@ struct Set {
     else memcpy(&content[toIndex], &other.content[fromIndex], count * sizeof(content[0]));
   }
 
-  auto &operator[] (size_t index) -> T { boundsCheck_(index); return content[index]; }
+  auto operator[] (size_t index) -> T & { boundsCheck_(index); return content[index]; }
   auto operator[] (size_t index) const -> const T & { boundsCheck_(index); return content[index]; }
 
   auto pop () -> T {
-    if (length == 0) throw Underflow("Set::pop: underflow");
+    check_<Underflow>(length > 0, "Set::pop: underflow");
     return content[--length];
   }
   auto shift () -> T {
-    if (length == 0) throw Underflow("Set::pop: underflow");
+    check_<Underflow>(length > 0, "Set::shift: underflow");
     T result = content[0];
     removeAt(0);
     return result;
@@ -71,6 +112,18 @@ struct Set {
   auto forEach (const std::function<void (const T &element)> &callback) -> void {
     for (int i = 0; i < length; ++i) callback(content[i]);
   }
+
+  /// a cursor over the elements, for the kernels of setops.h.
+  auto cursor () const -> SpanCursor<T> { return { content, content + length }; }
+  /// @returns the elements in both this and that, in order.
+  template <size_t A, CheckPolicy P>
+  auto intersect (const Set<T, A, P> &that) const -> std::vector<T> { return ak::intersect(cursor(), that.cursor()); }
+  /// @returns the elements in this or that, in order.
+  template <size_t A, CheckPolicy P>
+  auto unite (const Set<T, A, P> &that) const -> std::vector<T> { return ak::unite(cursor(), that.cursor()); }
+  /// @returns the elements in this but not in that, in order.
+  template <size_t A, CheckPolicy P>
+  auto difference (const Set<T, A, P> &that) const -> std::vector<T> { return ak::difference(cursor(), that.cursor()); }
 };
 } // namespace ak::file
 
@@ -0,0 +1,199 @@
+#ifndef AK_LIB_FILE_SHARDED_H_
+#define AK_LIB_FILE_SHARDED_H_
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ak/base.h"
+#include "ak/compare.h"
+#include "ak/file/bloom.h"
+#include "ak/file/bptree.h"
+#include "ak/file/file.h"
+#include "ak/losertree.h"
+#include "ak/threadpool.h"
+
+namespace ak::file {
+/// how ShardedBpTree assigns keys to its shards.
+enum class ShardPolicy { HASH, RANGE };
+
+/**
+ * a BpTree partitioned across several files, the shards, by the hash of the key or by key ranges. as the shards share nothing,
+ * a call spanning them runs on a thread pool, one task per shard, so that it scales with cores and disks rather than with one
+ * file. point operations go to the shard of the key only.
+ *
+ * shard i is stored in `<prefix>.<i>.shard`. the partitioning is not persisted: open the tree with the same shards every time.
+ * with hash sharding, scans merge the sorted results of all shards. with range sharding, shard i holds the keys from
+ * boundaries[i - 1] on and before boundaries[i], so scans only visit the shards they overlap and need no merge.
+ *
+ * a key is only ever in one shard, so the entries of each key are in order, as in BpTree. calls need to be serialized, as in
+ * BpTree; each call only runs the shards in parallel internally.
+ *
+ * constraints: the same as BpTree. KeyType also needs to be Hashable for hash sharding.
+ */
+template <
+  BptStorable KeyType,
+  std::copy_constructible ValueType,
+  size_t szChunk = kDefaultSzChunk,
+  BptKeyPolicy keyPolicy = BptKeyPolicy::DUPLICATE,
+  BptRecordFormat recordFormat = BptRecordFormat::PLAIN
+> requires (keyPolicy == BptKeyPolicy::UNIQUE || Comparable<ValueType>) && (recordFormat != BptRecordFormat::PACKED || BptPackable<KeyType>)
+class ShardedBpTree {
+ public:
+  using Tree = BpTree<KeyType, ValueType, szChunk, keyPolicy, recordFormat>;
+ private:
+  static constexpr bool kUnique = keyPolicy == BptKeyPolicy::UNIQUE;
+  using Entry = std::pair<KeyType, ValueType>;
+
+  ShardPolicy policy_;
+  /// with range sharding, the first key of each shard but the first, in order.
+  std::vector<KeyType> boundaries_;
+  std::vector<std::unique_ptr<Tree>> shards_;
+  ThreadPool pool_;
+
+  static auto threadsFor_ (size_t nShards, size_t nThreads) -> size_t {
+    if (nThreads > 0) return nThreads;
+    return std::clamp<size_t>(std::thread::hardware_concurrency(), 1, nShards);
+  }
+  auto open_ (const char *prefix, size_t nShards) -> void {
+    if (nShards == 0) throw Exception("ShardedBpTree: no shards");
+    for (size_t i = 0; i < nShards; ++i) shards_.push_back(std::make_unique<Tree>((std::string(prefix) + "." + std::to_string(i) + ".shard").c_str()));
+  }
+  auto shardOf_ (const KeyType &key) -> size_t {
+    if (policy_ == ShardPolicy::RANGE) return std::upper_bound(boundaries_.begin(), boundaries_.end(), key) - boundaries_.begin();
+    // only hashable keys can be hash sharded, see the constructors.
+    if constexpr (Hashable<KeyType>) {
+      return mixHash(std::hash<KeyType>()(key)) % shards_.size();
+    } else {
+      AK_ASSERT(false);
+      return 0;
+    }
+  }
+  auto shard_ (const KeyType &key) -> Tree & { return *shards_[shardOf_(key)]; }
+  /// the shards that may hold keys in [lo, hi), as a range of indices.
+  auto shardsIn_ (const KeyType &lo, const KeyType &hi) -> std::pair<size_t, size_t> {
+    if (policy_ == ShardPolicy::HASH) return { 0, shards_.size() };
+    return { shardOf_(lo), std::lower_bound(boundaries_.begin(), boundaries_.end(), hi) - boundaries_.begin() + 1 };
+  }
+  /// merges the sorted results of the shards. the entries of a key all come from one shard, so merging by key alone keeps them in order.
+  auto merge_ (std::vector<std::vector<Entry>> &runs) -> std::vector<Entry> {
+    std::vector<Entry> res;
+    size_t total = 0;
+    for (const std::vector<Entry> &run : runs) total += run.size();
+    res.reserve(total);
+    if (policy_ == ShardPolicy::RANGE) {
+      // the shards are in key order already.
+      for (std::vector<Entry> &run : runs) std::move(run.begin(), run.end(), std::back_inserter(res));
+      return res;
+    }
+    // the next entry of each run, of which the loser tree picks the least.
+    auto byKey = [] (const Entry &lhs, const Entry &rhs) { return lhs.first < rhs.first; };
+    std::vector<size_t> next(runs.size(), 1);
+    std::vector<std::optional<Entry>> heads;
+    for (const std::vector<Entry> &run : runs) heads.push_back(run.empty() ? std::nullopt : std::optional<Entry>(run[0]));
+    for (LoserTree<Entry, decltype(byKey)> merger(std::move(heads), byKey); !merger.empty();) {
+      res.push_back(merger.top());
+      const std::vector<Entry> &run = runs[merger.source()];
+      size_t &ix = next[merger.source()];
+      merger.replace(ix < run.size() ? std::optional<Entry>(run[ix++]) : std::nullopt);
+    }
+    return res;
+  }
+ public:
+  ShardedBpTree () = delete;
+  /// hash sharding across nShards shards, on nThreads threads, or up to one per hardware thread if 0.
+  ShardedBpTree (const char *prefix, size_t nShards, size_t nThreads = 0) requires Hashable<KeyType>
+    : policy_(ShardPolicy::HASH), pool_(threadsFor_(nShards, nThreads)) {
+    open_(prefix, nShards);
+  }
+  /// range sharding across boundaries.size() + 1 shards. see the class comment.
+  ShardedBpTree (const char *prefix, std::vector<KeyType> boundaries, size_t nThreads = 0)
+    : policy_(ShardPolicy::RANGE), boundaries_(std::move(boundaries)), pool_(threadsFor_(boundaries_.size() + 1, nThreads)) {
+    std::sort(boundaries_.begin(), boundaries_.end());
+    open_(prefix, boundaries_.size() + 1);
+  }
+  ShardedBpTree (const ShardedBpTree &) = delete;
+  auto operator= (const ShardedBpTree &) -> ShardedBpTree & = delete;
+
+  auto policy () const -> ShardPolicy { return policy_; }
+  auto shards () const -> size_t { return shards_.size(); }
+  /// the i-th shard, e.g. to tune it with setWriteBuffer or setMinFill. its keys must not be changed to those of other shards.
+  auto shard (size_t i) -> Tree & { return *shards_.at(i); }
+
+  /// in unique trees, this overwrites the value if the key is already present.
+  auto insert (const KeyType &key, const ValueType &value) -> void { shard_(key).insert(key, value); }
+  /// inserts entries, each shard on its own thread.
+  auto insertBatch (const std::vector<std::pair<KeyType, ValueType>> &entries) -> void {
+    std::vector<std::vector<size_t>> byShard(shards_.size());
+    for (size_t i = 0; i < entries.size(); ++i) byShard[shardOf_(entries[i].first)].push_back(i);
+    pool_.parallelFor(shards_.size(), [&] (size_t i) {
+      for (size_t ix : byShard[i]) shards_[i]->insert(entries[ix].first, entries[ix].second);
+    });
+  }
+  auto remove (const KeyType &key, const ValueType &value) -> void requires (!kUnique) { shard_(key).remove(key, value); }
+  auto remove (const KeyType &key) -> void requires kUnique { shard_(key).remove(key); }
+  auto findOne (const KeyType &key) -> std::optional<ValueType> { return shard_(key).findOne(key); }
+  auto findMany (const KeyType &key) -> std::vector<ValueType> { return shard_(key).findMany(key); }
+  auto includes (const KeyType &key, const ValueType &value) -> bool requires (!kUnique) { return shard_(key).includes(key, value); }
+  auto includes (const KeyType &key) -> bool { return shard_(key).includes(key); }
+  auto count (const KeyType &key) -> size_t { return shard_(key).count(key); }
+
+  /// @returns all entries in order. the shards are read in parallel.
+  auto findAll () -> std::vector<std::pair<KeyType, ValueType>> {
+    std::vector<std::vector<Entry>> runs(shards_.size());
+    pool_.parallelFor(shards_.size(), [&] (size_t i) { runs[i] = shards_[i]->findAll(); });
+    return merge_(runs);
+  }
+  /// @returns the entries with lo <= key < hi, in order. the shards overlapping the range are read in parallel.
+  auto findRange (const KeyType &lo, const KeyType &hi) -> std::vector<std::pair<KeyType, ValueType>> {
+    if (!(lo < hi)) return {};
+    auto [ begin, end ] = shardsIn_(lo, hi);
+    std::vector<std::vector<Entry>> runs(end - begin);
+    pool_.parallelFor(end - begin, [&] (size_t i) { runs[i] = shards_[begin + i]->findRange(lo, hi); });
+    return merge_(runs);
+  }
+  auto size () -> size_t {
+    size_t res = 0;
+    for (auto &shard : shards_) res += shard->size();
+    return res;
+  }
+  /// @returns the number of entries with lo <= key < hi.
+  auto countRange (const KeyType &lo, const KeyType &hi) -> size_t {
+    if (!(lo < hi)) return 0;
+    auto [ begin, end ] = shardsIn_(lo, hi);
+    size_t res = 0;
+    for (size_t i = begin; i < end; ++i) res += shards_[i]->countRange(lo, hi);
+    return res;
+  }
+  /// applies the buffered writes of all shards, in parallel.
+  auto flush () -> void {
+    pool_.parallelFor(shards_.size(), [this] (size_t i) { shards_[i]->flush(); });
+  }
+
+  /// the disk I/O of all shards so far.
+  auto fileStats () -> typename File<szChunk>::Stats {
+    typename File<szChunk>::Stats res;
+    for (auto &shard : shards_) {
+      const auto &stats = shard->fileStats();
+      res.reads += stats.reads;
+      res.writes += stats.writes;
+      res.bytesRead += stats.bytesRead;
+      res.bytesWritten += stats.bytesWritten;
+    }
+    return res;
+  }
+  auto clearCache () -> void {
+    for (auto &shard : shards_) shard->clearCache();
+  }
+};
+} // namespace ak::file
+
+#endif
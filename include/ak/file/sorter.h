@@ -0,0 +1,295 @@
+#ifndef AK_LIB_FILE_SORTER_H_
+#define AK_LIB_FILE_SORTER_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <concepts>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ak/base.h"
+#include "ak/file/array.h"
+#include "ak/file/file.h"
+#include "ak/losertree.h"
+#include "ak/threadpool.h"
+
+namespace ak::file {
+/**
+ * an external merge sort of fixed-size records, for data sets larger than memory, e.g. to load a BpTree in key order.
+ *
+ * pushed records are buffered; a full buffer is sorted and written out as a sorted run on a background thread, while the next
+ * buffer fills. iterating then merges the runs with a LoserTree, reading the next page of each run ahead on the background
+ * thread while the current ones are merged. if there are too many runs to merge at once within the budget, they are merged in
+ * passes into fewer, longer runs first. if all records fit in one buffer, nothing is written.
+ *
+ * memoryBudget bounds the records held in memory: two buffers of half of it while pushing, and two pages per run while merging.
+ * as each run merged is an open file, at most kMaxFanIn runs, and a quarter of the file descriptors the process may open, are
+ * merged at once, whatever the budget.
+ * runs are stored in `<prefix>.<seq>.run` and removed once merged.
+ * @example ExternalSorter<Entry> sorter("tmp"); for (...) sorter.push(entry); for (const Entry &entry : sorter) tree.insert(...);
+ *
+ * constraints: T needs to be trivially copyable, as it is written to disk as it is in memory. the sort is not stable.
+ */
+template <typename T, size_t szChunk = kDefaultSzChunk, typename Compare = std::less<T>>
+  requires std::is_trivially_copyable_v<T> && std::default_initializable<T>
+class ExternalSorter {
+ public:
+  static constexpr size_t kDefaultMemoryBudget = 64 << 20;
+  /// the most runs merged at once.
+  static constexpr size_t kMaxFanIn = 256;
+ private:
+  static constexpr size_t kPageLength = (szChunk - sizeof(size_t)) / sizeof(T);
+  static_assert(kPageLength >= 1);
+  struct Page : public ManagedObject<Page, szChunk> {
+    char _start[0];
+    Array<T, kPageLength> records;
+    char _end[0];
+    Page (File<szChunk> &file) : ManagedObject<Page, szChunk>(file) {}
+  };
+  struct Run {
+    std::string path;
+    size_t size;
+  };
+
+  /// writes a run sequentially. pages are dropped from the cache once written, so that a run takes one page of memory.
+  class Writer {
+   private:
+    File<szChunk> file_;
+    Page page_;
+    static auto truncate_ (const std::string &path) -> const char * {
+      ::remove(path.c_str());
+      return path.c_str();
+    }
+    auto flushPage_ () -> void {
+      if (page_.records.length == 0) return;
+      page_.save();
+      file_.clearCache();
+      page_ = Page(file_);
+    }
+   public:
+    Writer (const std::string &path) : file_(truncate_(path), [] () {}), page_(file_) {}
+    auto append (const T &record) -> void {
+      if (page_.records.length == kPageLength) flushPage_();
+      page_.records.push(record);
+    }
+    auto finish () -> void { flushPage_(); }
+  };
+
+  /// reads a run in order, reading each page ahead on io while the one before it is consumed.
+  class Reader {
+   private:
+    std::unique_ptr<File<szChunk>> file_;
+    ThreadPool *io_;
+    size_t numPages_;
+    size_t page_ = 0;
+    size_t ix_ = 0;
+    std::optional<Page> current_;
+    std::future<Page> next_;
+    auto fetch_ (size_t page) -> std::future<Page> {
+      return io_->submit([file = file_.get(), page] () {
+        Page res = Page::get(*file, page);
+        file->clearCache();
+        return res;
+      });
+    }
+   public:
+    Reader (const Run &run, ThreadPool &io)
+      : file_(std::make_unique<File<szChunk>>(run.path.c_str(), [] () {})), io_(&io), numPages_((run.size + kPageLength - 1) / kPageLength) {
+      if (numPages_ > 0) next_ = fetch_(0);
+    }
+    Reader (Reader &&) = default;
+    // the page read ahead refers to file_.
+    ~Reader () {
+      if (next_.valid()) next_.wait();
+    }
+    auto next () -> std::optional<T> {
+      while (!current_ || ix_ == current_->records.length) {
+        if (page_ == numPages_) return std::nullopt;
+        current_.emplace(next_.get());
+        ix_ = 0;
+        if (++page_ < numPages_) next_ = fetch_(page_);
+      }
+      return current_->records.content[ix_++];
+    }
+  };
+
+  std::string prefix_;
+  Compare compare_;
+  /// the records per buffer, and the runs merged at once.
+  size_t bufferCapacity_;
+  size_t fanIn_;
+  size_t size_ = 0;
+  size_t nextSeq_ = 0;
+  std::vector<T> buffer_;
+  /// the buffer being written out by spilling_.
+  std::vector<T> spare_;
+  std::future<void> spilling_;
+  std::vector<Run> runs_;
+  bool started_ = false;
+  // the state of the iteration: the sorted buffer_ if nothing is spilled, or the merge of the runs otherwise.
+  size_t bufferIx_ = 0;
+  std::vector<Reader> readers_;
+  std::optional<LoserTree<T, Compare>> merger_;
+  // the last member, so that it is joined before the buffers and files its tasks refer to are destructed.
+  ThreadPool io_;
+
+  auto newRun_ (size_t size) -> Run {
+    return { .path = prefix_ + "." + std::to_string(nextSeq_++) + ".run", .size = size };
+  }
+  /// waits for the run being written, and rethrows its errors.
+  auto waitForSpill_ () -> void {
+    if (spilling_.valid()) spilling_.get();
+  }
+  /// sorts buffer_ and writes it out as a run on io_, leaving buffer_ empty to be filled meanwhile.
+  auto spill_ () -> void {
+    waitForSpill_();
+    std::swap(buffer_, spare_);
+    buffer_.clear();
+    runs_.push_back(newRun_(spare_.size()));
+    spilling_ = io_.submit([this, path = runs_.back().path] () {
+      std::sort(spare_.begin(), spare_.end(), compare_);
+      Writer writer(path);
+      for (const T &record : spare_) writer.append(record);
+      writer.finish();
+    });
+  }
+  /// merges runs into a single run, and removes them.
+  auto mergeRuns_ (const std::vector<Run> &runs) -> Run {
+    std::vector<Reader> readers;
+    std::vector<std::optional<T>> heads;
+    size_t size = 0;
+    for (const Run &run : runs) {
+      readers.emplace_back(run, io_);
+      heads.push_back(readers.back().next());
+      size += run.size;
+    }
+    Run res = newRun_(size);
+    {
+      Writer writer(res.path);
+      for (LoserTree<T, Compare> merger(std::move(heads), compare_); !merger.empty(); merger.replace(readers[merger.source()].next())) {
+        writer.append(merger.top());
+      }
+      writer.finish();
+    }
+    readers.clear();
+    for (const Run &run : runs) ::remove(run.path.c_str());
+    return res;
+  }
+  /// ends the input, and gets the records ready to be iterated.
+  auto start_ () -> void {
+    if (started_) throw Exception("ExternalSorter: already iterated");
+    started_ = true;
+    if (runs_.empty()) {
+      std::sort(buffer_.begin(), buffer_.end(), compare_);
+      return;
+    }
+    if (!buffer_.empty()) spill_();
+    waitForSpill_();
+    buffer_ = std::vector<T>();
+    spare_ = std::vector<T>();
+    // merge in passes until the runs can be merged at once. each pass merges consecutive runs, keeping them in order.
+    while (runs_.size() > fanIn_) {
+      std::vector<Run> merged;
+      for (size_t i = 0; i < runs_.size(); i += fanIn_) {
+        std::vector<Run> group(runs_.begin() + i, runs_.begin() + std::min(runs_.size(), i + fanIn_));
+        merged.push_back(group.size() == 1 ? group[0] : mergeRuns_(group));
+      }
+      runs_ = std::move(merged);
+    }
+    std::vector<std::optional<T>> heads;
+    for (const Run &run : runs_) {
+      readers_.emplace_back(run, io_);
+      heads.push_back(readers_.back().next());
+    }
+    merger_.emplace(std::move(heads), compare_);
+  }
+  /// kMaxFanIn, or less if the process may not open four times as many files, to leave most of them to the rest of it.
+  static auto maxFanIn_ () -> size_t {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY) return kMaxFanIn;
+    return std::clamp<size_t>(limit.rlim_cur / 4, 2, kMaxFanIn);
+  }
+
+  /// @returns the next record in order, or nullopt after the last one.
+  auto next_ () -> std::optional<T> {
+    if (!merger_) {
+      if (bufferIx_ == buffer_.size()) return std::nullopt;
+      return buffer_[bufferIx_++];
+    }
+    if (merger_->empty()) return std::nullopt;
+    T res = merger_->top();
+    merger_->replace(readers_[merger_->source()].next());
+    return res;
+  }
+ public:
+  /// iterates the sorted records. see begin.
+  class Iterator {
+   private:
+    friend ExternalSorter;
+    ExternalSorter *sorter_ = nullptr;
+    std::optional<T> current_;
+    Iterator (ExternalSorter &sorter) : sorter_(&sorter), current_(sorter.next_()) {}
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+    Iterator () = default;
+    auto operator* () const -> const T & { return *current_; }
+    auto operator-> () const -> const T * { return &*current_; }
+    auto operator++ () -> Iterator & {
+      current_ = sorter_->next_();
+      return *this;
+    }
+    auto operator++ (int) -> void { ++*this; }
+    auto operator== (std::default_sentinel_t) const -> bool { return !current_; }
+  };
+
+  ExternalSorter () = delete;
+  ExternalSorter (const char *prefix, size_t memoryBudget = kDefaultMemoryBudget, Compare compare = Compare())
+    : prefix_(prefix), compare_(compare), bufferCapacity_(std::max<size_t>(1, memoryBudget / 2 / sizeof(T))),
+      fanIn_(std::clamp<size_t>(memoryBudget / (2 * szChunk), 2, maxFanIn_())), io_(1) {}
+  ExternalSorter (const ExternalSorter &) = delete;
+  auto operator= (const ExternalSorter &) -> ExternalSorter & = delete;
+  /// removes the runs.
+  ~ExternalSorter () {
+    if (spilling_.valid()) spilling_.wait();
+    readers_.clear();
+    for (const Run &run : runs_) ::remove(run.path.c_str());
+  }
+
+  auto push (const T &record) -> void {
+    if (started_) throw Exception("ExternalSorter::push: already iterated");
+    if (buffer_.empty()) buffer_.reserve(bufferCapacity_);
+    buffer_.push_back(record);
+    ++size_;
+    if (buffer_.size() == bufferCapacity_) spill_();
+  }
+  /// ends the input, and iterates the records in order. the records can only be iterated once.
+  auto begin () -> Iterator {
+    start_();
+    return Iterator(*this);
+  }
+  auto end () -> std::default_sentinel_t { return std::default_sentinel; }
+  /// the number of records pushed.
+  auto size () const -> size_t { return size_; }
+  /// the number of sorted runs on disk, which the merge passes reduce.
+  auto runs () const -> size_t { return runs_.size(); }
+  /// the number of runs merged at once.
+  auto fanIn () const -> size_t { return fanIn_; }
+};
+} // namespace ak::file
+
+#endif
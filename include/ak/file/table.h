@@ -0,0 +1,213 @@
+#ifndef AK_LIB_FILE_TABLE_H_
+#define AK_LIB_FILE_TABLE_H_
+
+#include <string.h>
+
+#include <concepts>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ak/base.h"
+#include "ak/file/bptree.h"
+#include "ak/file/file.h"
+
+namespace ak::file {
+/**
+ * a set of records stored with ManagedObject, kept in sync with any number of BpTree indexes on their fields.
+ *
+ * Record must inherit ManagedObject<Record, szChunk> and be constructible from a File<szChunk> &. records are stored in
+ * `<prefix>.records` and each index in `<prefix>.<name>.index`.
+ *
+ * indexes are not persisted as a schema: declare the same indexes, before any other operation, every time the table is opened.
+ * an index declared on a table already holding records would miss them.
+ *
+ * a covering index also stores selected fields of the record in its entries, so that queries on them need no record fetch.
+ * @example auto &byAge = users.addIndex<int>("age", [] (const User &u) { return u.age; });
+ * @example auto &nameByAge = users.addIndex<int, Varchar<32>>("age_name", [] (const User &u) { return u.age; }, [] (const User &u) { return u.name; });
+ */
+template <typename Record, size_t szChunk = kDefaultSzChunk>
+  requires std::derived_from<Record, ManagedObject<Record, szChunk>> && std::constructible_from<Record, File<szChunk> &>
+class Table {
+ private:
+  class IndexBase {
+   public:
+    virtual ~IndexBase () = default;
+    virtual auto insert (const Record &record, size_t id) -> void = 0;
+    virtual auto remove (const Record &record, size_t id) -> void = 0;
+    /// whether the indexed or covered fields differ between the records.
+    virtual auto differs (const Record &lhs, const Record &rhs) -> bool = 0;
+  };
+ public:
+  /// an index of the records by a key. Covered is the type of the fields stored alongside, or void for none.
+  template <BptStorable Key, typename Covered = void>
+  class Index : public IndexBase {
+   private:
+    friend Table;
+    static constexpr bool kCovering = !std::is_void_v<Covered>;
+    /// the record id, together with the covered fields if any. ordered by id alone.
+    struct CoveringEntry {
+      size_t id;
+      std::conditional_t<kCovering, Covered, char> covered;
+      auto operator< (const CoveringEntry &that) const -> bool { return id < that.id; }
+    };
+    using Entry = std::conditional_t<kCovering, CoveringEntry, size_t>;
+    using Cover = std::function<std::conditional_t<kCovering, Covered, void> (const Record &record)>;
+
+    Table &table_;
+    BpTree<Key, Entry, szChunk> tree_;
+    std::function<Key (const Record &record)> key_;
+    Cover cover_;
+
+    auto entry_ (const Record &record, size_t id) -> Entry {
+      if constexpr (kCovering) {
+        return { .id = id, .covered = cover_(record) };
+      } else {
+        return id;
+      }
+    }
+    static auto idOf_ (const Entry &entry) -> size_t {
+      if constexpr (kCovering) {
+        return entry.id;
+      } else {
+        return entry;
+      }
+    }
+    auto insert (const Record &record, size_t id) -> void override { tree_.insert(key_(record), entry_(record, id)); }
+    auto remove (const Record &record, size_t id) -> void override { tree_.remove(key_(record), entry_(record, id)); }
+    auto differs (const Record &lhs, const Record &rhs) -> bool override {
+      if (!equals(key_(lhs), key_(rhs))) return true;
+      if constexpr (kCovering) {
+        Covered a = cover_(lhs), b = cover_(rhs);
+        if constexpr (std::equality_comparable<Covered>) return !(a == b);
+        return memcmp(&a, &b, sizeof(Covered)) != 0;
+      } else {
+        return false;
+      }
+    }
+   public:
+    Index (Table &table, const std::string &filename, const std::function<Key (const Record &record)> &key, const Cover &cover)
+      : table_(table), tree_(filename.c_str()), key_(key), cover_(cover) {}
+
+    /// @returns the ids of the records with the key.
+    auto findIds (const Key &key) -> std::vector<size_t> {
+      std::vector<size_t> res;
+      for (const Entry &entry : tree_.findMany(key)) res.push_back(idOf_(entry));
+      return res;
+    }
+    auto findOne (const Key &key) -> std::optional<Record> {
+      std::optional<Entry> entry = tree_.findOne(key);
+      if (!entry) return std::nullopt;
+      return table_.get(idOf_(*entry));
+    }
+    auto findMany (const Key &key) -> std::vector<Record> {
+      std::vector<Record> res;
+      for (const Entry &entry : tree_.findMany(key)) res.push_back(table_.get(idOf_(entry)));
+      return res;
+    }
+    /// @returns the ids and covered fields of the records with the key, without fetching the records.
+    auto findCovered (const Key &key) -> std::vector<std::pair<size_t, Covered>> requires kCovering {
+      std::vector<std::pair<size_t, Covered>> res;
+      for (const Entry &entry : tree_.findMany(key)) res.emplace_back(entry.id, entry.covered);
+      return res;
+    }
+    auto count (const Key &key) -> size_t { return tree_.count(key); }
+    auto countRange (const Key &lo, const Key &hi) -> size_t { return tree_.countRange(lo, hi); }
+  };
+ private:
+  std::string prefix_;
+  File<szChunk> file_;
+  std::vector<std::unique_ptr<IndexBase>> indexes_;
+
+  /// runs op on each index, undoing it on the preceding ones with undo if it throws.
+  template <typename Op, typename Undo>
+  auto forEachIndex_ (const Op &op, const Undo &undo) -> void {
+    size_t i = 0;
+    try {
+      for (; i < indexes_.size(); ++i) op(*indexes_[i]);
+    } catch (...) {
+      while (i-- > 0) undo(*indexes_[i]);
+      throw;
+    }
+  }
+ public:
+  Table () = delete;
+  Table (const char *prefix) : prefix_(prefix), file_((prefix_ + ".records").c_str(), [] () {}) {}
+
+  /// declares an index named name on the key extracted by key.
+  template <BptStorable Key>
+  auto addIndex (const char *name, const std::function<Key (const Record &record)> &key) -> Index<Key> & {
+    auto index = std::make_unique<Index<Key>>(*this, prefix_ + "." + name + ".index", key, [] (const Record &) {});
+    Index<Key> &res = *index;
+    indexes_.push_back(std::move(index));
+    return res;
+  }
+  /// declares a covering index named name on the key extracted by key, which stores the fields extracted by cover.
+  template <BptStorable Key, typename Covered>
+  auto addIndex (const char *name, const std::function<Key (const Record &record)> &key, const std::function<Covered (const Record &record)> &cover) -> Index<Key, Covered> & {
+    auto index = std::make_unique<Index<Key, Covered>>(*this, prefix_ + "." + name + ".index", key, cover);
+    Index<Key, Covered> &res = *index;
+    indexes_.push_back(std::move(index));
+    return res;
+  }
+
+  /// @returns a new record to be filled in and inserted.
+  auto create () -> Record { return Record(file_); }
+  auto get (size_t id) -> Record { return Record::get(file_, id); }
+  /// saves the record and adds it to all indexes. if an index throws, the record is not saved.
+  auto insert (Record &record) -> void {
+    record.save();
+    try {
+      forEachIndex_(
+        [&record] (IndexBase &index) { index.insert(record, record.id()); },
+        [&record] (IndexBase &index) { index.remove(record, record.id()); }
+      );
+    } catch (...) {
+      record.destroy();
+      throw;
+    }
+  }
+  /// saves the changes to a record, updating the indexes whose fields have changed.
+  auto update (Record &record) -> void {
+    Record old = get(record.id());
+    std::vector<IndexBase *> changed;
+    for (const auto &index : indexes_) if (index->differs(old, record)) changed.push_back(index.get());
+    size_t i = 0;
+    try {
+      for (; i < changed.size(); ++i) {
+        changed[i]->remove(old, record.id());
+        try {
+          changed[i]->insert(record, record.id());
+        } catch (...) {
+          changed[i]->insert(old, record.id());
+          throw;
+        }
+      }
+    } catch (...) {
+      while (i-- > 0) {
+        changed[i]->remove(record, record.id());
+        changed[i]->insert(old, record.id());
+      }
+      throw;
+    }
+    record.update();
+  }
+  /// removes a record from the indexes and destroys it.
+  auto destroy (Record &record) -> void {
+    Record old = get(record.id());
+    forEachIndex_(
+      [&old] (IndexBase &index) { index.remove(old, old.id()); },
+      [&old] (IndexBase &index) { index.insert(old, old.id()); }
+    );
+    record.destroy();
+  }
+
+  auto clearCache () -> void { file_.clearCache(); }
+};
+} // namespace ak::file
+
+#endif
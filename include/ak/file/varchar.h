@@ -1,50 +1,108 @@
 #ifndef AK_LIB_FILE_VARCHAR_H_
 #define AK_LIB_FILE_VARCHAR_H_
 
+#include <stdint.h>
 #include <string.h>
 
+#include <algorithm>
 #include <compare>
+#include <functional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 #include "ak/base.h"
+#include "ak/file/cell.h"
 
 namespace ak::file {
-/// a wrapper for const char * with utility functions and type conversions.
+/**
+ * a string of at most maxLength chars, stored inline, e.g. as the key of a BpTree.
+ * it keeps its length besides the null-terminated content, so that it is built, assigned and compared without strlen, strcmp or
+ * temporary std::strings: comparisons are a memcmp of the common prefix, and equality checks the lengths first.
+ *
+ * the length is stored after the content, so sizeof(Varchar) is greater than maxLength + 1. files that store Varchars by their
+ * memory layout, e.g. the record nodes of BpTree, Table records or the pages of HashIndex and LsmTree, are thus not readable if
+ * written by versions without the length: recreate them from their data.
+ */
 template <int maxLength>
 struct Varchar {
  private:
   template <int A>
   friend class Varchar;
+  friend struct std::hash<Varchar>;
+  friend struct Cell<Varchar>;
+  using Length = std::conditional_t<maxLength < 256, uint8_t, std::conditional_t<maxLength < 65536, uint16_t, uint32_t>>;
   char content[maxLength + 1];
- public:
-  Varchar () { content[0] = '\0'; }
-  Varchar (const std::string &s) {
-    if (s.length() > maxLength) throw Overflow("Varchar length overflow");
-    strcpy(content, s.c_str());
+  Length length_;
+  auto assign_ (const char *s, size_t length) -> void {
+    if (length > maxLength) throw Overflow("Varchar length overflow");
+    memcpy(content, s, length);
+    content[length] = '\0';
+    length_ = length;
   }
-  Varchar (const char *cstr) : Varchar(std::string(cstr)) {}
+ public:
+  Varchar () : length_(0) { content[0] = '\0'; }
+  Varchar (std::string_view s) { assign_(s.data(), s.length()); }
+  Varchar (const std::string &s) { assign_(s.data(), s.length()); }
+  Varchar (const char *cstr) { assign_(cstr, strlen(cstr)); }
   template<int A>
   Varchar (const Varchar<A> &that) { *this = that; }
-  operator std::string () const { return std::string(content); }
+  operator std::string () const { return std::string(content, length_); }
   [[nodiscard]] auto str () const -> std::string { return std::string(*this); }
+  /// the content, without copying it. it is valid as long as this Varchar is not changed.
+  [[nodiscard]] auto view () const -> std::string_view { return { content, length_ }; }
+  [[nodiscard]] auto length () const -> size_t { return length_; }
+  auto operator= (std::string_view s) -> Varchar & {
+    assign_(s.data(), s.length());
+    return *this;
+  }
+  auto operator= (const std::string &s) -> Varchar & { return *this = std::string_view(s); }
+  auto operator= (const char *cstr) -> Varchar & { return *this = std::string_view(cstr); }
   template <int A>
-  auto operator= (const Varchar<A> &that) -> Varchar {
-    if (that.str().length() > maxLength) throw Overflow("Varchar length overflow");
-    strcpy(content, that.content);
+  auto operator= (const Varchar<A> &that) -> Varchar & {
+    assign_(that.content, that.length_);
     return *this;
   }
   template <int A>
   auto operator<=> (const Varchar<A> &that) const -> std::weak_ordering {
-    int res = strcmp(content, that.content);
+    int res = memcmp(content, that.content, std::min<size_t>(length_, that.length_));
     if (res < 0) return std::weak_ordering::less;
     if (res > 0) return std::weak_ordering::greater;
-    return std::weak_ordering::equivalent;
+    return (size_t) length_ <=> (size_t) that.length_;
   }
   template <int A>
-  auto operator== (const Varchar<A> &that) const -> bool { return (*this <=> that) == std::weak_ordering::equivalent; };
+  auto operator== (const Varchar<A> &that) const -> bool {
+    return length_ == that.length_ && memcmp(content, that.content, length_) == 0;
+  }
   template <int A>
   auto operator!= (const Varchar<A> &that) const -> bool { return !(*this == that); }
 };
+
+/// a Varchar takes its length, then its content without the terminating null byte, in a cell, so that it may contain null bytes.
+template <int maxLength>
+struct Cell<Varchar<maxLength>> {
+  using Length = typename Varchar<maxLength>::Length;
+  static constexpr bool kVariable = true;
+  static constexpr size_t kMinSize = sizeof(Length);
+  static constexpr size_t kMaxSize = sizeof(Length) + maxLength;
+  static auto size (const Varchar<maxLength> &value) -> size_t { return sizeof(Length) + value.length_; }
+  static auto write (const Varchar<maxLength> &value, char *buf) -> size_t {
+    memcpy(buf, &value.length_, sizeof(Length));
+    memcpy(buf + sizeof(Length), value.content, value.length_);
+    return size(value);
+  }
+  static auto read (Varchar<maxLength> &value, const char *buf) -> size_t {
+    Length length;
+    memcpy(&length, buf, sizeof(Length));
+    value.assign_(buf + sizeof(Length), length);
+    return size(value);
+  }
+};
 } // namespace ak::file
 
+template <int maxLength>
+struct std::hash<ak::file::Varchar<maxLength>> {
+  auto operator() (const ak::file::Varchar<maxLength> &s) const -> size_t { return std::hash<std::string_view>()(s.view()); }
+};
+
 #endif
@@ -0,0 +1,74 @@
+/**
+ * losertree.h - a tournament tree for k-way merges.
+ */
+
+#ifndef AK_LIB_LOSERTREE_H_
+#define AK_LIB_LOSERTREE_H_
+
+#include <stddef.h>
+
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace ak {
+/**
+ * picks the least of the heads of k sources, e.g. of the sorted runs of a merge. each internal node keeps the loser of the match
+ * played there, so replacing the head of the winning source only replays the matches on its path to the root: log2(k)
+ * comparisons, about half of what a binary heap takes to pop the winner and push its successor.
+ *
+ * an exhausted source, of head nullopt, loses to all others. ties go to the source of the lower index, so merging the runs of a
+ * stable sort in order keeps it stable.
+ * @example LoserTree<int> tree({ 1, 3, std::nullopt }); tree.top() == 1; tree.replace(4); tree.top() == 3;
+ */
+template <typename T, typename Compare = std::less<T>>
+class LoserTree {
+ private:
+  std::vector<std::optional<T>> heads_;
+  /// losers_[i] is the source that lost the match at internal node i, and losers_[0] the overall winner.
+  std::vector<size_t> losers_;
+  Compare compare_;
+
+  /// whether source a wins against source b.
+  auto beats_ (size_t a, size_t b) const -> bool {
+    if (!heads_[b]) return true;
+    if (!heads_[a]) return false;
+    if (compare_(*heads_[b], *heads_[a])) return false;
+    return compare_(*heads_[a], *heads_[b]) || a < b;
+  }
+ public:
+  LoserTree (std::vector<std::optional<T>> heads, Compare compare = Compare()) : heads_(std::move(heads)), losers_(heads_.size()), compare_(compare) {
+    const size_t k = heads_.size();
+    if (k == 0) return;
+    // the winners of the matches, with the leaves at k + i.
+    std::vector<size_t> winners(2 * k);
+    for (size_t i = 0; i < k; ++i) winners[k + i] = i;
+    for (size_t i = k - 1; i > 0; --i) {
+      size_t lhs = winners[2 * i], rhs = winners[2 * i + 1];
+      bool lhsWins = beats_(lhs, rhs);
+      winners[i] = lhsWins ? lhs : rhs;
+      losers_[i] = lhsWins ? rhs : lhs;
+    }
+    losers_[0] = k == 1 ? 0 : winners[1];
+  }
+
+  /// whether all sources are exhausted.
+  auto empty () const -> bool { return heads_.empty() || !heads_[losers_[0]]; }
+  /// the least head. the tree must not be empty.
+  auto top () const -> const T & { return *heads_[losers_[0]]; }
+  /// the index of the source of top().
+  auto source () const -> size_t { return losers_[0]; }
+  /// replaces top() with the next head of its source, or nullopt if the source is exhausted.
+  auto replace (std::optional<T> next) -> void {
+    size_t winner = losers_[0];
+    heads_[winner] = std::move(next);
+    for (size_t i = (winner + heads_.size()) / 2; i > 0; i /= 2) {
+      if (beats_(losers_[i], winner)) std::swap(losers_[i], winner);
+    }
+    losers_[0] = winner;
+  }
+};
+} // namespace ak
+
+#endif
@@ -0,0 +1,175 @@
+/**
+ * setops.h - intersection, union and difference of sorted sequences.
+ */
+
+#ifndef AK_LIB_SETOPS_H_
+#define AK_LIB_SETOPS_H_
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <concepts>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+namespace ak {
+/**
+ * a position in a strictly increasing sequence, e.g. SpanCursor, or BpTree::Cursor over the values of a key.
+ * seek(value) moves forward to the first element not less than value, and may skip the elements in between without visiting
+ * them; seeking backwards does not move.
+ */
+template <typename C>
+concept SortedCursor = requires(C cursor, const typename C::value_type &value) {
+  { cursor.valid() } -> std::convertible_to<bool>;
+  { cursor.current() } -> std::convertible_to<const typename C::value_type &>;
+  cursor.next();
+  cursor.seek(value);
+};
+
+/// @returns the first element in [begin, end) not less than value, probing 1, 2, 4... elements from begin before a binary search.
+template <typename T, typename Compare = std::less<T>>
+auto gallop (const T *begin, const T *end, const T &value, const Compare &compare = Compare()) -> const T * {
+  size_t n = end - begin, bound = 1;
+  if (n == 0 || !compare(begin[0], value)) return begin;
+  while (bound < n && compare(begin[bound], value)) bound *= 2;
+  return std::lower_bound(begin + bound / 2 + 1, begin + std::min(bound, n), value, compare);
+}
+
+/// a SortedCursor over an array, e.g. the content of a Set or a std::vector, which seeks by gallop.
+template <typename T, typename Compare = std::less<T>>
+class SpanCursor {
+ private:
+  const T *pos_;
+  const T *end_;
+  Compare compare_;
+ public:
+  using value_type = T;
+  SpanCursor (const T *begin, const T *end, Compare compare = Compare()) : pos_(begin), end_(end), compare_(compare) {}
+  SpanCursor (const std::vector<T> &elements, Compare compare = Compare()) : SpanCursor(elements.data(), elements.data() + elements.size(), compare) {}
+  auto valid () const -> bool { return pos_ != end_; }
+  auto current () const -> const T & { return *pos_; }
+  auto next () -> void { ++pos_; }
+  auto seek (const T &value) -> void { pos_ = gallop(pos_, end_, value, compare_); }
+  /// the elements left, from current() on.
+  auto begin () const -> const T * { return pos_; }
+  auto end () const -> const T * { return end_; }
+};
+
+/**
+ * calls emit(element) on the elements of both a and b, in order. each step seeks the cursor behind to the element of the other,
+ * so that a cursor that gallops, as SpanCursor and BpTree::Cursor, is only read around the elements of the smaller input.
+ */
+template <SortedCursor A, SortedCursor B, typename Emit>
+auto intersect (A &a, B &b, const Emit &emit) -> void {
+  while (a.valid() && b.valid()) {
+    if (a.current() < b.current()) {
+      a.seek(b.current());
+    } else if (b.current() < a.current()) {
+      b.seek(a.current());
+    } else {
+      emit(a.current());
+      a.next();
+      b.next();
+    }
+  }
+}
+/**
+ * intersect for integers in arrays. inputs of similar lengths are compared a block of each at a time: every element of one block
+ * against every one of the other, which the compiler turns into SIMD compares, and the block with the lesser last element moves
+ * on. this needs no branch per element, which a merge mispredicts about every other element. skewed inputs gallop instead.
+ */
+template <std::integral T, typename Emit>
+auto intersect (SpanCursor<T> &a, SpanCursor<T> &b, const Emit &emit) -> void {
+  constexpr size_t kBlock = 8;
+  // beyond this ratio of lengths, galloping the larger input wins over reading it all.
+  constexpr size_t kSkew = 32;
+  const T *i = a.begin(), *j = b.begin();
+  const size_t na = a.end() - i, nb = b.end() - j;
+  if (na <= nb * kSkew && nb <= na * kSkew) {
+    while (size_t(a.end() - i) >= kBlock && size_t(b.end() - j) >= kBlock) {
+      T found[kBlock] = {};
+      for (size_t y = 0; y < kBlock; ++y) {
+        for (size_t x = 0; x < kBlock; ++x) found[x] |= i[x] == j[y];
+      }
+      for (size_t x = 0; x < kBlock; ++x) if (found[x]) emit(i[x]);
+      const T lastA = i[kBlock - 1], lastB = j[kBlock - 1];
+      if (lastA <= lastB) i += kBlock;
+      if (lastB <= lastA) j += kBlock;
+    }
+    a = SpanCursor<T>(i, a.end());
+    b = SpanCursor<T>(j, b.end());
+  }
+  // the rest, by the generic intersect.
+  intersect<SpanCursor<T>, SpanCursor<T>, Emit>(a, b, emit);
+}
+/// calls emit(element) on the elements of all cursors, in order, seeking each to the greatest current element of them in turn.
+template <SortedCursor C, typename Emit>
+auto intersectAll (std::vector<C> &cursors, const Emit &emit) -> void {
+  using T = typename C::value_type;
+  if (cursors.empty()) return;
+  while (true) {
+    for (const C &cursor : cursors) if (!cursor.valid()) return;
+    T target = cursors[0].current();
+    for (const C &cursor : cursors) if (target < cursor.current()) target = cursor.current();
+    bool all = true;
+    for (C &cursor : cursors) {
+      cursor.seek(target);
+      if (!cursor.valid()) return;
+      all = all && !(target < cursor.current());
+    }
+    if (!all) continue;
+    emit(target);
+    for (C &cursor : cursors) cursor.next();
+  }
+}
+/// calls emit(element) on the elements of a or b, in order, once each.
+template <SortedCursor A, SortedCursor B, typename Emit>
+auto unite (A &a, B &b, const Emit &emit) -> void {
+  while (a.valid() && b.valid()) {
+    if (a.current() < b.current()) {
+      emit(a.current());
+      a.next();
+    } else if (b.current() < a.current()) {
+      emit(b.current());
+      b.next();
+    } else {
+      emit(a.current());
+      a.next();
+      b.next();
+    }
+  }
+  for (; a.valid(); a.next()) emit(a.current());
+  for (; b.valid(); b.next()) emit(b.current());
+}
+/// calls emit(element) on the elements of a not in b, in order. b seeks to each element of a, so it is only read around them.
+template <SortedCursor A, SortedCursor B, typename Emit>
+auto difference (A &a, B &b, const Emit &emit) -> void {
+  for (; a.valid(); a.next()) {
+    b.seek(a.current());
+    if (!b.valid() || a.current() < b.current()) emit(a.current());
+  }
+}
+
+/// the results of the kernels above, collected into vectors.
+template <typename A, typename B> requires SortedCursor<std::remove_cvref_t<A>> && SortedCursor<std::remove_cvref_t<B>>
+auto intersect (A &&a, B &&b) -> std::vector<typename std::remove_cvref_t<A>::value_type> {
+  std::vector<typename std::remove_cvref_t<A>::value_type> res;
+  intersect(a, b, [&res] (const auto &element) { res.push_back(element); });
+  return res;
+}
+template <typename A, typename B> requires SortedCursor<std::remove_cvref_t<A>> && SortedCursor<std::remove_cvref_t<B>>
+auto unite (A &&a, B &&b) -> std::vector<typename std::remove_cvref_t<A>::value_type> {
+  std::vector<typename std::remove_cvref_t<A>::value_type> res;
+  unite(a, b, [&res] (const auto &element) { res.push_back(element); });
+  return res;
+}
+template <typename A, typename B> requires SortedCursor<std::remove_cvref_t<A>> && SortedCursor<std::remove_cvref_t<B>>
+auto difference (A &&a, B &&b) -> std::vector<typename std::remove_cvref_t<A>::value_type> {
+  std::vector<typename std::remove_cvref_t<A>::value_type> res;
+  difference(a, b, [&res] (const auto &element) { res.push_back(element); });
+  return res;
+}
+} // namespace ak
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ * threadpool.h - a fixed-size thread pool.
+ */
+
+#ifndef AK_LIB_THREADPOOL_H_
+#define AK_LIB_THREADPOOL_H_
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ak {
+/**
+ * runs submitted tasks on a fixed number of worker threads, in the order they are submitted.
+ * the destructor runs the tasks still queued, then joins the workers.
+ * @example ThreadPool pool(4); auto sum = pool.submit([] () { return 1 + 1; }); sum.get();
+ */
+class ThreadPool {
+ private:
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void ()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  bool stopping_ = false;
+
+  auto work_ () -> void {
+    while (true) {
+      std::function<void ()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] () { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) return;
+        task = std::move(tasks_.front());
+        tasks_.pop();
+      }
+      task();
+    }
+  }
+ public:
+  /// starts nThreads workers, or one per hardware thread if 0.
+  ThreadPool (size_t nThreads = 0) {
+    if (nThreads == 0) nThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    workers_.reserve(nThreads);
+    for (size_t i = 0; i < nThreads; ++i) workers_.emplace_back([this] () { work_(); });
+  }
+  ThreadPool (const ThreadPool &) = delete;
+  auto operator= (const ThreadPool &) -> ThreadPool & = delete;
+  ~ThreadPool () {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    changed_.notify_all();
+    for (std::thread &worker : workers_) worker.join();
+  }
+
+  /// @returns a future of the result of task, which rethrows what task throws.
+  template <typename F>
+  auto submit (F &&task) -> std::future<std::invoke_result_t<F>> {
+    // std::function needs a copyable callable, so the move-only packaged_task is shared.
+    auto packaged = std::make_shared<std::packaged_task<std::invoke_result_t<F> ()>>(std::forward<F>(task));
+    std::future<std::invoke_result_t<F>> res = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.emplace([packaged] () { (*packaged)(); });
+    }
+    changed_.notify_one();
+    return res;
+  }
+  /// runs task(i) for each i in [0, n) on the workers, and waits for them all. the first exception thrown is rethrown.
+  auto parallelFor (size_t n, const std::function<void (size_t i)> &task) -> void {
+    std::vector<std::future<void>> futures;
+    futures.reserve(n);
+    for (size_t i = 0; i < n; ++i) futures.push_back(submit([&task, i] () { task(i); }));
+    // wait for all of them before rethrowing, as the tasks refer to task and whatever it captures.
+    for (std::future<void> &future : futures) future.wait();
+    for (std::future<void> &future : futures) future.get();
+  }
+  auto size () const -> size_t { return workers_.size(); }
+};
+} // namespace ak
+
+#endif
@@ -3,6 +3,8 @@
 
 #include "ak/validator/base.h"
 #include "ak/validator/expect.h"
+#include "ak/validator/pattern.h"
+#include "ak/validator/schema.h"
 #include "ak/validator/_internals/common.h"
 #include "ak/validator/_internals/string.h"
 
@@ -47,9 +47,11 @@ class Validator<std::string> {
   auto toBeConsistedOf (const std::string &chars) const -> const Validator &;
   /// expect(std::string("Hello World")).toMatch(R"(Hel+o\s\w+)")
   auto toMatch (const std::regex &pattern) const -> const Validator &;
+  /// the pattern is compiled once per process, see Pattern.
   auto toMatch (const std::string &pattern) const -> const Validator &;
   /// expect(std::string("Hello World")).toPartiallyMatch(R"(Hel+o)")
   auto toPartiallyMatch (const std::regex &pattern) const -> const Validator &;
+  /// the pattern is compiled once per process, see Pattern.
   auto toPartiallyMatch (const std::string &pattern) const -> const Validator &;
   /// expect(std::string("Hello World")).toBeOfLength(11);
   auto toBeOfLength (size_t length) const -> const Validator &;
@@ -0,0 +1,55 @@
+/**
+ * validator/pattern.h - compiled patterns for toMatch and toPartiallyMatch.
+ */
+
+#ifndef AK_LIB_VALIDATOR_PATTERN_H_
+#define AK_LIB_VALIDATOR_PATTERN_H_
+
+#include <memory>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+
+namespace ak::validator {
+
+/**
+ * a regular expression in the ECMAScript syntax of std::regex, compiled once to be matched many times.
+ *
+ * patterns of the regular subset of the syntax, i.e. without backreferences, lookaheads or word boundaries, run on automata of
+ * their own, whose matching takes time linear in the length of the input and does not backtrack: a DFA built up front, or if
+ * that would have too many states, a simulation of the NFA. the others fall back to std::regex. either way, the results are
+ * those of std::regex_match and std::regex_search; chars are matched as bytes, as std::regex does for std::string.
+ *
+ * patterns are immutable once compiled, so they can be matched from several threads at once.
+ * @example Pattern::cached(R"(\d{4}-\d{2}-\d{2})")->match("2024-01-31");
+ */
+class Pattern {
+ public:
+  class Automaton;
+
+  /// throws std::regex_error as std::regex does if the pattern is invalid.
+  explicit Pattern (const std::string &pattern);
+  Pattern (const Pattern &) = delete;
+  auto operator= (const Pattern &) -> Pattern & = delete;
+  ~Pattern ();
+
+  /// the pattern compiled by a process-wide cache, which compiles each pattern string once. thread-safe.
+  static auto cached (const std::string &pattern) -> std::shared_ptr<const Pattern>;
+
+  /// whether the pattern matches the whole of s, as std::regex_match.
+  [[nodiscard]] auto match (std::string_view s) const -> bool;
+  /// whether the pattern matches some part of s, as std::regex_search.
+  [[nodiscard]] auto search (std::string_view s) const -> bool;
+  /// whether the pattern runs on the automata rather than on std::regex.
+  [[nodiscard]] auto native () const -> bool { return matcher_ != nullptr; }
+
+ private:
+  std::unique_ptr<const Automaton> matcher_;
+  std::unique_ptr<const Automaton> searcher_;
+  std::optional<std::regex> regex_;
+};
+
+} // namespace ak::validator
+
+#endif
@@ -0,0 +1,179 @@
+/**
+ * validator/schema.h - precompiled validators of records.
+ *
+ * a schema holds the rules of the fields of a record type, in the vocabulary of expect, and checks records against all of them
+ * without throwing: it returns the rules that failed as a bitmask, which report turns into messages.
+ * @example
+ * Schema<User> schema;
+ * schema.field("name", &User::name).toMatch(R"(\w+)").toBeShorterThan(64);
+ * schema.field("role", &User::role).toBeOneOf({ "admin", "user" });
+ * if (Failures failures = schema.check(user)) for (const auto &message : schema.report(failures)) ...
+ */
+
+#ifndef AK_LIB_VALIDATOR_SCHEMA_H_
+#define AK_LIB_VALIDATOR_SCHEMA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bitset>
+#include <concepts>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ak/base.h"
+#include "ak/compare.h"
+#include "ak/validator/base.h"
+#include "ak/validator/pattern.h"
+
+namespace ak::validator {
+
+/// the rules of a Schema that a record failed, bit i for the i-th rule added.
+using Failures = uint64_t;
+
+template <typename Record>
+class Schema {
+ public:
+  /// the most rules of a schema, one per bit of Failures.
+  static constexpr size_t kMaxRules = 64;
+
+  /**
+   * adds the rules of a field to a schema, as Validator checks a value. Not and butNot negate the rules added after them.
+   * the field is projection applied to the record, e.g. a pointer to a member, or a callable.
+   */
+  template <typename Projection>
+  class Field {
+   public:
+    using T = std::remove_cvref_t<std::invoke_result_t<const Projection &, const Record &>>;
+   private:
+    Schema *schema_;
+    std::string name_;
+    Projection projection_;
+    bool inverse_ = false;
+
+    template <typename Test>
+    auto add_ (std::string description, Test test) const -> const Field & {
+      schema_->add_(name_, std::move(description), [projection = projection_, test = std::move(test)] (const Record &record) {
+        return test(std::invoke(projection, record));
+      }, inverse_);
+      return *this;
+    }
+    static auto view_ (const T &value) -> std::string_view { return value; }
+   public:
+    Field (Schema *schema, std::string name, Projection projection) : schema_(schema), name_(std::move(name)), projection_(std::move(projection)) {}
+
+    auto toBe (const T &value) const -> const Field & {
+      return add_("toBe", [value] (const T &field) { return equals(field, value); });
+    }
+    auto toBeOneOf (const std::initializer_list<T> &list) const -> const Field & {
+      return add_("toBeOneOf", [values = std::vector<T>(list)] (const T &field) {
+        for (const T &value : values) if (equals(field, value)) return true;
+        return false;
+      });
+    }
+    auto toBeLessThan (const T &value) const -> const Field & {
+      return add_("toBeLessThan", [value] (const T &field) { return field < value; });
+    }
+    auto toBeGreaterThan (const T &value) const -> const Field & {
+      return add_("toBeGreaterThan", [value] (const T &field) { return value < field; });
+    }
+
+    auto toInclude (const std::string &substr) const -> const Field & requires std::convertible_to<const T &, std::string_view> {
+      return add_("toInclude(" + substr + ")", [substr] (const T &field) { return view_(field).find(substr) != std::string_view::npos; });
+    }
+    auto toBeConsistedOf (const std::string &chars) const -> const Field & requires std::convertible_to<const T &, std::string_view> {
+      std::bitset<256> allowed;
+      for (char c : chars) allowed.set((unsigned char) c);
+      return add_("toBeConsistedOf(" + chars + ")", [allowed] (const T &field) {
+        for (char c : view_(field)) if (!allowed[(unsigned char) c]) return false;
+        return true;
+      });
+    }
+    auto toMatch (const std::string &pattern) const -> const Field & requires std::convertible_to<const T &, std::string_view> {
+      return add_("toMatch(" + pattern + ")", [compiled = Pattern::cached(pattern)] (const T &field) { return compiled->match(view_(field)); });
+    }
+    auto toPartiallyMatch (const std::string &pattern) const -> const Field & requires std::convertible_to<const T &, std::string_view> {
+      return add_("toPartiallyMatch(" + pattern + ")", [compiled = Pattern::cached(pattern)] (const T &field) { return compiled->search(view_(field)); });
+    }
+    auto toBeOfLength (size_t length) const -> const Field & requires std::convertible_to<const T &, std::string_view> {
+      return add_("toBeOfLength(" + std::to_string(length) + ")", [length] (const T &field) { return view_(field).length() == length; });
+    }
+    auto toBeShorterThan (size_t length) const -> const Field & requires std::convertible_to<const T &, std::string_view> {
+      return add_("toBeShorterThan(" + std::to_string(length) + ")", [length] (const T &field) { return view_(field).length() < length; });
+    }
+    auto toBeLongerThan (size_t length) const -> const Field & requires std::convertible_to<const T &, std::string_view> {
+      return add_("toBeLongerThan(" + std::to_string(length) + ")", [length] (const T &field) { return view_(field).length() > length; });
+    }
+
+    /// schema.field("age", &User::age).Not().toBe(0)
+    auto Not () const -> Field {
+      Field res = *this;
+      res.inverse_ = true;
+      return res;
+    }
+    auto butNot () const -> Field { return Not(); }
+  };
+
+ private:
+  struct Rule {
+    std::string field;
+    std::string description;
+    std::function<bool (const Record &)> test;
+    bool inverse;
+  };
+  std::vector<Rule> rules_;
+
+  auto add_ (std::string field, std::string description, std::function<bool (const Record &)> test, bool inverse) -> void {
+    if (rules_.size() == kMaxRules) throw Overflow("Schema: too many rules");
+    rules_.push_back({ std::move(field), std::move(description), std::move(test), inverse });
+  }
+
+ public:
+  /// starts the rules of the field name, the result of projection on records. throws std::regex_error on invalid patterns.
+  template <typename Projection>
+  auto field (std::string name, Projection projection) -> Field<Projection> { return { this, std::move(name), std::move(projection) }; }
+
+  /// @returns the rules record fails, none if 0. all rules are checked, so all failures are reported.
+  auto check (const Record &record) const -> Failures {
+    Failures res = 0;
+    for (size_t i = 0; i < rules_.size(); ++i) {
+      if (rules_[i].test(record) == rules_[i].inverse) res |= Failures(1) << i;
+    }
+    return res;
+  }
+  auto checkAll (const std::vector<Record> &records) const -> std::vector<Failures> {
+    std::vector<Failures> res;
+    res.reserve(records.size());
+    for (const Record &record : records) res.push_back(check(record));
+    return res;
+  }
+  /// throws ValidationException if record fails any rule, as expect does.
+  auto validate (const Record &record) const -> void {
+    if (check(record) != 0) throw ValidationException();
+  }
+  /// a message per rule in failures, e.g. "name: not toMatch(\w+)".
+  auto report (Failures failures) const -> std::vector<std::string> {
+    std::vector<std::string> res;
+    for (size_t i = 0; i < rules_.size(); ++i) {
+      if (failures >> i & 1) res.push_back(rules_[i].field + ": " + (rules_[i].inverse ? "not " : "") + rules_[i].description);
+    }
+    return res;
+  }
+  /// the rules of field name, e.g. to tell whether a field failed by failures & schema.rulesOf("name").
+  auto rulesOf (std::string_view name) const -> Failures {
+    Failures res = 0;
+    for (size_t i = 0; i < rules_.size(); ++i) if (rules_[i].field == name) res |= Failures(1) << i;
+    return res;
+  }
+  auto size () const -> size_t { return rules_.size(); }
+};
+
+} // namespace ak::validator
+
+#endif
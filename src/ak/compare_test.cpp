@@ -2,14 +2,33 @@
 
 #include <assert.h>
 
+#include <compare>
+#include <string>
+
 struct S {
   auto operator< (const S &that) const -> bool {
     return false;
   }
 };
 
+/// counts the comparisons it takes.
+struct Counted {
+  int x;
+  static inline int comparisons = 0;
+  auto operator<=> (const Counted &that) const -> std::strong_ordering {
+    ++comparisons;
+    return x <=> that.x;
+  }
+};
+
 auto main () -> int {
   assert(ak::equals(233, 233));
   assert(!ak::equals(1926, 817));
   assert(ak::equals(S(), S()));
+  assert(ak::compare(S(), S()) == 0);
+  assert(ak::compare(1, 2) < 0 && ak::compare(2.5, 1.0) > 0);
+  assert(ak::compare(std::string("b"), std::string("a")) > 0);
+  static_assert(ak::ThreeWayComparable<Counted> && !ak::ThreeWayComparable<S>);
+  assert(ak::equals(Counted{ 1 }, Counted{ 1 }) && Counted::comparisons == 1);
+  assert(ak::compare(Counted{ 1 }, Counted{ 2 }) < 0 && Counted::comparisons == 2);
 }
@@ -0,0 +1,70 @@
+#include "ak/file/array.h"
+
+#include <assert.h>
+
+#include "ak/base.h"
+#include "ak/file/set.h"
+
+using ak::NotFound;
+using ak::OutOfBounds;
+using ak::Overflow;
+using ak::file::Array;
+using ak::file::CheckPolicy;
+using ak::file::npos;
+using ak::file::Set;
+
+template <typename E, typename F>
+auto throws (const F &f) -> bool {
+  try {
+    f();
+  } catch (const E &) {
+    return true;
+  }
+  return false;
+}
+
+auto testArray () -> void {
+  Array<int, 4> array;
+  for (int x : { 3, 1, 4 }) array.push(x);
+  assert(array.find(4) == 2 && array.find(5) == npos);
+  assert(array.indexOf(1) == 1 && array.includes(3) && !array.includes(5));
+  assert(array.get(0) == 3 && !array.get(3));
+  assert(throws<NotFound>([&] () { array.indexOf(5); }));
+  assert(throws<OutOfBounds>([&] () { array[3]; }));
+  array.push(1);
+  assert(throws<Overflow>([&] () { array.push(5); }));
+  assert(array.length == 4);
+}
+
+auto testSet () -> void {
+  Set<int, 4> set;
+  for (int x : { 3, 1, 4 }) set.insert(x);
+  assert(set.find(3) == 1 && set.find(2) == npos && set.find(5) == npos);
+  assert(set.indexOf(4) == 2 && set.includes(1) && !set.includes(0));
+  assert(set.get(2) == 4 && !set.get(3));
+  assert(throws<NotFound>([&] () { set.indexOf(2); }));
+  assert(throws<OutOfBounds>([&] () { set[3]; }));
+}
+
+auto testUnchecked () -> void {
+  // no checks, so that an index within the capacity reads whatever is there.
+  Array<int, 4, CheckPolicy::UNCHECKED> array;
+  array.push(7);
+  array.content[1] = 8;
+  assert(array[1] == 8);
+  assert(!array.get(1));
+  Set<int, 4, CheckPolicy::DEBUG> set;
+  set.insert(2);
+  set.insert(1);
+  assert(set[0] == 1 && set.find(2) == 1);
+#ifndef AK_DEBUG
+  assert(!throws<OutOfBounds>([&] () { set[2]; }));
+#endif
+}
+
+auto main () -> int {
+  testArray();
+  testSet();
+  testUnchecked();
+  return 0;
+}
@@ -0,0 +1,432 @@
+/**
+ * bptree_bench.cpp - benchmarks for BpTree, HashIndex, LsmTree and File.
+ *
+ * usage: akcpp_bench [-n ops] [-s seed] [filter...]
+ * every workload runs with integer and Varchar keys and several chunk sizes. a row is run if its name contains any filter.
+ * @example akcpp_bench -n 100000 ycsb varchar32/4096
+ *
+ * workloads are seeded, so a run is reproducible given the same ops and seed.
+ * latencies are per operation; bytes read and written are the disk I/O of the measured operations, excluding cache hits.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <filesystem>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "ak/file/bloom.h"
+#include "ak/file/bptree.h"
+#include "ak/file/hashindex.h"
+#include "ak/file/lsm.h"
+#include "ak/file/sharded.h"
+#include "ak/file/varchar.h"
+#include "ak/threadpool.h"
+
+using ak::ThreadPool;
+using ak::file::BpTree;
+using ak::file::HashIndex;
+using ak::file::LsmTree;
+using ak::file::ShardedBpTree;
+using ak::file::BptKeyPolicy;
+using ak::file::BptRecordFormat;
+using ak::file::Varchar;
+
+namespace {
+
+constexpr const char *kFilename = "akcpp_bench.db";
+/// the write buffer of the buffered workloads, in messages.
+constexpr size_t kWriteBufferCapacity = 4096;
+/// the keys per call of the batched lookup workload. its rows are per call, not per key.
+constexpr size_t kLookupBatch = 1024;
+/// the shards of the sharded workloads.
+constexpr size_t kShards = 4;
+/// the entries per call of the batched insert workloads. their rows are per call, not per entry.
+constexpr size_t kInsertBatch = 4096;
+/// the calls of the full scan workloads.
+constexpr size_t kScans = 10;
+
+struct Options {
+  size_t ops = 20000;
+  uint64_t seed = 42;
+  std::vector<std::string> filters;
+};
+
+template <typename Key>
+auto makeKey (uint64_t id) -> Key;
+template <>
+auto makeKey<int64_t> (uint64_t id) -> int64_t { return (int64_t) id; }
+template <>
+auto makeKey<Varchar<32>> (uint64_t id) -> Varchar<32> {
+  char buf[33];
+  snprintf(buf, sizeof(buf), "user%020llu", (unsigned long long) id);
+  return buf;
+}
+
+/// the record format of the trees of Key: packed for integers, slotted for strings.
+template <typename Key>
+constexpr BptRecordFormat kRecordFormat = std::integral<Key> ? BptRecordFormat::PACKED : BptRecordFormat::SLOTTED;
+
+template <typename Key>
+auto keyName () -> std::string;
+template <>
+auto keyName<int64_t> () -> std::string { return "int64"; }
+template <>
+auto keyName<Varchar<32>> () -> std::string { return "varchar32"; }
+
+/// zipfian ids in [0, n), following Gray et al., "Quickly Generating Billion-Record Synthetic Databases", as YCSB does.
+/// popular ids are scattered over the key space rather than clustered at 0.
+class Zipfian {
+ private:
+  uint64_t n_;
+  double theta_, alpha_, zetan_, eta_;
+  static auto zeta_ (uint64_t n, double theta) -> double {
+    double res = 0;
+    for (uint64_t i = 1; i <= n; ++i) res += 1 / std::pow((double) i, theta);
+    return res;
+  }
+ public:
+  Zipfian (uint64_t n, double theta = 0.99) : n_(n), theta_(theta), alpha_(1 / (1 - theta)), zetan_(zeta_(n, theta)) {
+    eta_ = (1 - std::pow(2.0 / (double) n, 1 - theta)) / (1 - zeta_(2, theta) / zetan_);
+  }
+  /// @returns the rank of the drawn item, 0 being the most popular.
+  auto rank (std::mt19937_64 &rng) const -> uint64_t {
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    double uz = u * zetan_;
+    if (uz < 1) return 0;
+    if (uz < 1 + std::pow(0.5, theta_)) return 1;
+    return std::min<uint64_t>(n_ - 1, (uint64_t) ((double) n_ * std::pow(eta_ * u - eta_ + 1, alpha_)));
+  }
+  auto operator() (std::mt19937_64 &rng) const -> uint64_t { return ak::file::mixHash(rank(rng)) % n_; }
+};
+
+struct IoStats {
+  size_t bytesRead = 0;
+  size_t bytesWritten = 0;
+};
+
+/// measures ops calls of op, recording per-call latencies.
+class Run {
+ private:
+  std::vector<uint64_t> latencies_;
+  double seconds_ = 0;
+  IoStats io_;
+ public:
+  template <typename Tree>
+  auto measure (Tree &tree, size_t ops, const std::function<void (size_t i)> &op) -> void {
+    using Clock = std::chrono::steady_clock;
+    latencies_.reserve(ops);
+    auto before = tree.fileStats();
+    auto start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+      auto t0 = Clock::now();
+      op(i);
+      latencies_.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+    }
+    seconds_ = std::chrono::duration<double>(Clock::now() - start).count();
+    io_.bytesRead = tree.fileStats().bytesRead - before.bytesRead;
+    io_.bytesWritten = tree.fileStats().bytesWritten - before.bytesWritten;
+  }
+  auto report (const std::string &name) -> void {
+    std::sort(latencies_.begin(), latencies_.end());
+    auto percentile = [this] (double p) -> double {
+      if (latencies_.empty()) return 0;
+      return (double) latencies_[std::min(latencies_.size() - 1, (size_t) (p * (double) latencies_.size()))] / 1000;
+    };
+    double ops = (double) latencies_.size();
+    printf(
+      "%-36s %10.0f %9.2f %9.2f %9.2f %9.2f %12.1f %12.1f\n",
+      name.c_str(), ops / seconds_, percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999),
+      (double) io_.bytesRead / ops, (double) io_.bytesWritten / ops
+    );
+    fflush(stdout);
+  }
+};
+
+/// removes kFilename, and the files named after it, as LsmTree uses it as a prefix.
+auto removeFiles () -> void {
+  for (const auto &entry : std::filesystem::directory_iterator(".")) {
+    if (entry.path().filename().string().starts_with(kFilename)) std::filesystem::remove(entry.path());
+  }
+}
+
+template <typename Tree>
+auto withTree (const std::function<void (Tree &tree)> &callback) -> void {
+  removeFiles();
+  {
+    Tree tree(kFilename);
+    callback(tree);
+  }
+  removeFiles();
+}
+
+auto shuffledIds (size_t n, std::mt19937_64 &rng) -> std::vector<uint64_t> {
+  std::vector<uint64_t> ids(n);
+  std::iota(ids.begin(), ids.end(), 0);
+  std::shuffle(ids.begin(), ids.end(), rng);
+  return ids;
+}
+
+template <typename Key, size_t szChunk>
+class Suite {
+ private:
+  using Tree = BpTree<Key, int64_t, szChunk, BptKeyPolicy::DUPLICATE, kRecordFormat<Key>>;
+  using Map = BpTree<Key, int64_t, szChunk, BptKeyPolicy::UNIQUE, kRecordFormat<Key>>;
+  using Hash = HashIndex<Key, int64_t, szChunk>;
+  using Lsm = LsmTree<Key, int64_t, szChunk>;
+  /// hash sharded across kShards shards, and constructible from a filename as the other trees.
+  class Sharded : public ShardedBpTree<Key, int64_t, szChunk, BptKeyPolicy::DUPLICATE, kRecordFormat<Key>> {
+   public:
+    Sharded (const char *prefix) : ShardedBpTree<Key, int64_t, szChunk, BptKeyPolicy::DUPLICATE, kRecordFormat<Key>>(prefix, kShards) {}
+  };
+  const Options &options_;
+  size_t n_;
+  std::string label_;
+
+  auto enabled_ (const std::string &name) -> bool {
+    if (options_.filters.empty()) return true;
+    return std::any_of(options_.filters.begin(), options_.filters.end(), [&name] (const std::string &f) { return name.find(f) != name.npos; });
+  }
+  /// runs body with a fresh tree and rng if the workload is enabled.
+  template <typename T>
+  auto run_ (const std::string &workload, const std::function<void (T &tree, std::mt19937_64 &rng, Run &run)> &body) -> void {
+    std::string name = workload + " " + label_;
+    if (!enabled_(name)) return;
+    std::mt19937_64 rng(options_.seed);
+    Run run;
+    withTree<T>([&] (T &tree) { body(tree, rng, run); });
+    run.report(name);
+  }
+  template <typename T>
+  auto load_ (T &tree, std::mt19937_64 &rng) -> void {
+    for (uint64_t id : shuffledIds(n_, rng)) tree.insert(makeKey<Key>(id), (int64_t) id);
+  }
+
+  auto basic_ () -> void {
+    run_<Tree>("seq-insert", [this] (Tree &tree, std::mt19937_64 &, Run &run) {
+      run.measure(tree, n_, [&] (size_t i) { tree.insert(makeKey<Key>(i), (int64_t) i); });
+    });
+    run_<Tree>("rand-insert", [this] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      std::vector<uint64_t> ids = shuffledIds(n_, rng);
+      run.measure(tree, n_, [&] (size_t i) { tree.insert(makeKey<Key>(ids[i]), (int64_t) ids[i]); });
+    });
+    run_<Tree>("rand-insert-buffered", [this] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      std::vector<uint64_t> ids = shuffledIds(n_, rng);
+      tree.setWriteBuffer(kWriteBufferCapacity);
+      run.measure(tree, n_, [&] (size_t i) {
+        tree.insert(makeKey<Key>(ids[i]), (int64_t) ids[i]);
+        if (i + 1 == n_) tree.flush();
+      });
+    });
+    run_<Tree>("lookup-hit", [this] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      load_(tree, rng);
+      run.measure(tree, options_.ops, [&] (size_t) { tree.findOne(makeKey<Key>(rng() % n_)); });
+    });
+    run_<Tree>("lookup-miss", [this] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      load_(tree, rng);
+      run.measure(tree, options_.ops, [&] (size_t) { tree.findOne(makeKey<Key>(n_ + rng() % n_)); });
+    });
+    run_<Tree>("lookup-batch-1024", [this] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      load_(tree, rng);
+      std::vector<Key> keys(kLookupBatch);
+      run.measure(tree, std::max<size_t>(1, options_.ops / kLookupBatch), [&] (size_t) {
+        for (Key &key : keys) key = makeKey<Key>(rng() % n_);
+        tree.findOneBatch(keys);
+      });
+    });
+    run_<Tree>("find-many-x16", [this] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      size_t distinct = std::max<size_t>(1, n_ / 16);
+      for (uint64_t id : shuffledIds(n_, rng)) tree.insert(makeKey<Key>(id % distinct), (int64_t) id);
+      run.measure(tree, options_.ops, [&] (size_t) { tree.findMany(makeKey<Key>(rng() % distinct)); });
+    });
+    run_<Tree>("range-scan-100", [this] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      load_(tree, rng);
+      run.measure(tree, options_.ops, [&] (size_t) {
+        auto snapshot = tree.snapshot();
+        snapshot.findPage(tree.rank(makeKey<Key>(rng() % n_)), 100);
+      });
+    });
+    run_<Tree>("delete-churn", [this] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      std::vector<uint64_t> live = shuffledIds(n_, rng);
+      for (uint64_t id : live) tree.insert(makeKey<Key>(id), (int64_t) id);
+      uint64_t nextId = n_;
+      run.measure(tree, options_.ops, [&] (size_t) {
+        size_t ix = rng() % live.size();
+        tree.remove(makeKey<Key>(live[ix]), (int64_t) live[ix]);
+        live[ix] = nextId++;
+        tree.insert(makeKey<Key>(live[ix]), (int64_t) live[ix]);
+      });
+    });
+  }
+
+  /// the point lookups of basic_ on a HashIndex instead.
+  auto hash_ () -> void {
+    run_<Hash>("hash-rand-insert", [this] (Hash &index, std::mt19937_64 &rng, Run &run) {
+      std::vector<uint64_t> ids = shuffledIds(n_, rng);
+      run.measure(index, n_, [&] (size_t i) { index.insert(makeKey<Key>(ids[i]), (int64_t) ids[i]); });
+    });
+    run_<Hash>("hash-lookup-hit", [this] (Hash &index, std::mt19937_64 &rng, Run &run) {
+      load_(index, rng);
+      run.measure(index, options_.ops, [&] (size_t) { index.findOne(makeKey<Key>(rng() % n_)); });
+    });
+    run_<Hash>("hash-lookup-miss", [this] (Hash &index, std::mt19937_64 &rng, Run &run) {
+      load_(index, rng);
+      run.measure(index, options_.ops, [&] (size_t) { index.findOne(makeKey<Key>(n_ + rng() % n_)); });
+    });
+  }
+
+  /// the inserts and point lookups of basic_ on an LsmTree, with compaction included in the inserts.
+  auto lsm_ () -> void {
+    run_<Lsm>("lsm-rand-insert", [this] (Lsm &tree, std::mt19937_64 &rng, Run &run) {
+      std::vector<uint64_t> ids = shuffledIds(n_, rng);
+      run.measure(tree, n_, [&] (size_t i) {
+        tree.insert(makeKey<Key>(ids[i]), (int64_t) ids[i]);
+        if (i + 1 == n_) tree.waitForCompaction();
+      });
+    });
+    run_<Lsm>("lsm-lookup-hit", [this] (Lsm &tree, std::mt19937_64 &rng, Run &run) {
+      load_(tree, rng);
+      tree.waitForCompaction();
+      run.measure(tree, options_.ops, [&] (size_t) { tree.findOne(makeKey<Key>(rng() % n_)); });
+    });
+    run_<Lsm>("lsm-lookup-miss", [this] (Lsm &tree, std::mt19937_64 &rng, Run &run) {
+      load_(tree, rng);
+      tree.waitForCompaction();
+      run.measure(tree, options_.ops, [&] (size_t) { tree.findOne(makeKey<Key>(n_ + rng() % n_)); });
+    });
+  }
+
+  /// full scans and batched inserts on a BpTree, then in parallel: a scan split across threads, and a ShardedBpTree.
+  auto sharded_ () -> void {
+    auto batches = [this] (std::mt19937_64 &rng) {
+      std::vector<uint64_t> ids = shuffledIds(n_, rng);
+      std::vector<std::vector<std::pair<Key, int64_t>>> res;
+      for (size_t i = 0; i < n_; i += kInsertBatch) {
+        res.emplace_back();
+        for (size_t j = i; j < std::min(n_, i + kInsertBatch); ++j) res.back().emplace_back(makeKey<Key>(ids[j]), (int64_t) ids[j]);
+      }
+      return res;
+    };
+    run_<Tree>("insert-batch-4096", [&] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      auto entries = batches(rng);
+      run.measure(tree, entries.size(), [&] (size_t i) {
+        for (const auto &[ key, value ] : entries[i]) tree.insert(key, value);
+      });
+    });
+    run_<Sharded>("sharded-insert-batch-4096", [&] (Sharded &tree, std::mt19937_64 &rng, Run &run) {
+      auto entries = batches(rng);
+      run.measure(tree, entries.size(), [&] (size_t i) { tree.insertBatch(entries[i]); });
+    });
+    run_<Tree>("find-all", [this] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      load_(tree, rng);
+      run.measure(tree, kScans, [&] (size_t) { tree.findAll(); });
+    });
+    run_<Tree>("parallel-sum", [this] (Tree &tree, std::mt19937_64 &rng, Run &run) {
+      load_(tree, rng);
+      ThreadPool pool;
+      run.measure(tree, kScans, [&] (size_t) {
+        tree.parallelReduce(pool, (int64_t) 0, [] (int64_t &sum, const Key &, int64_t value) { sum += value; }, std::plus<int64_t>());
+      });
+    });
+    run_<Sharded>("sharded-find-all", [this] (Sharded &tree, std::mt19937_64 &rng, Run &run) {
+      load_(tree, rng);
+      run.measure(tree, kScans, [&] (size_t) { tree.findAll(); });
+    });
+  }
+
+  /// YCSB core workloads A-F on a unique-key tree, where updates are upserts.
+  auto ycsb_ () -> void {
+    struct Mix {
+      const char *name;
+      double read, update, insert, scan, readModifyWrite;
+      bool latest;
+    };
+    const Mix mixes[] = {
+      { "ycsb-a", 0.5, 0.5, 0, 0, 0, false },
+      { "ycsb-b", 0.95, 0.05, 0, 0, 0, false },
+      { "ycsb-c", 1, 0, 0, 0, 0, false },
+      { "ycsb-d", 0.95, 0, 0.05, 0, 0, true },
+      { "ycsb-e", 0, 0, 0.05, 0.95, 0, false },
+      { "ycsb-f", 0.5, 0, 0, 0, 0.5, false },
+    };
+    for (const Mix &mix : mixes) {
+      run_<Map>(mix.name, [this, &mix] (Map &tree, std::mt19937_64 &rng, Run &run) {
+        load_(tree, rng);
+        uint64_t records = n_;
+        Zipfian zipfian(n_);
+        std::uniform_real_distribution<double> dice(0, 1);
+        auto chooseId = [&] () -> uint64_t {
+          if (mix.latest) return records - 1 - std::min<uint64_t>(records - 1, zipfian.rank(rng));
+          return zipfian(rng) % records;
+        };
+        run.measure(tree, options_.ops, [&] (size_t) {
+          double x = dice(rng);
+          if ((x -= mix.read) < 0) {
+            tree.findOne(makeKey<Key>(chooseId()));
+          } else if ((x -= mix.update) < 0) {
+            uint64_t id = chooseId();
+            tree.insert(makeKey<Key>(id), (int64_t) rng());
+          } else if ((x -= mix.insert) < 0) {
+            tree.insert(makeKey<Key>(records), (int64_t) records);
+            ++records;
+          } else if ((x -= mix.scan) < 0) {
+            auto snapshot = tree.snapshot();
+            snapshot.findPage(tree.rank(makeKey<Key>(chooseId())), 1 + rng() % 100);
+          } else {
+            Key key = makeKey<Key>(chooseId());
+            std::optional<int64_t> value = tree.findOne(key);
+            tree.insert(key, value.value_or(0) + 1);
+          }
+        });
+      });
+    }
+  }
+ public:
+  Suite (const Options &options) : options_(options), n_(options.ops), label_(keyName<Key>() + "/" + std::to_string(szChunk)) {}
+  auto run () -> void {
+    basic_();
+    hash_();
+    lsm_();
+    sharded_();
+    ycsb_();
+  }
+};
+
+template <typename Key>
+auto runAllChunkSizes (const Options &options) -> void {
+  Suite<Key, 1024>(options).run();
+  Suite<Key, 4096>(options).run();
+  Suite<Key, 16384>(options).run();
+}
+
+} // namespace
+
+auto main (int argc, char **argv) -> int {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      options.ops = std::max(1UL, strtoul(argv[++i], nullptr, 10));
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      options.seed = strtoull(argv[++i], nullptr, 10);
+    } else {
+      options.filters.emplace_back(argv[i]);
+    }
+  }
+  printf("ops = %zu, seed = %llu\n", options.ops, (unsigned long long) options.seed);
+  printf(
+    "%-36s %10s %9s %9s %9s %9s %12s %12s\n",
+    "workload", "ops/s", "p50(us)", "p90(us)", "p99(us)", "p999(us)", "read(B/op)", "write(B/op)"
+  );
+  runAllChunkSizes<int64_t>(options);
+  runAllChunkSizes<Varchar<32>>(options);
+}
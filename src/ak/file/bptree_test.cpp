@@ -0,0 +1,472 @@
+#include "ak/file/bptree.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ak/file/varchar.h"
+#include "ak/setops.h"
+#include "ak/threadpool.h"
+
+using ak::NotFound;
+using ak::ThreadPool;
+using ak::file::BpTree;
+using ak::file::BptKeyPolicy;
+using ak::file::BptRecordFormat;
+using ak::file::Varchar;
+
+auto testOrderStatistics () -> void {
+  remove("bptree_test_os.db");
+  BpTree<int, int, 512> tree("bptree_test_os.db");
+  for (int i = 0; i < 1000; ++i) tree.insert(i % 100, i);
+  assert(tree.size() == 1000);
+  assert(tree.count(42) == 10);
+  assert(tree.count(100) == 0);
+  assert(tree.rank(0) == 0);
+  assert(tree.rank(42) == 420);
+  assert(tree.rank(1000) == 1000);
+  assert(tree.countRange(10, 20) == 100);
+  assert(tree.countRange(20, 10) == 0);
+  assert(tree.select(425)->first == 42);
+  assert(tree.select(425)->second == 542);
+  assert(!tree.select(1000));
+  for (int i = 0; i < 1000; i += 2) tree.remove(i % 100, i);
+  assert(tree.size() == 500);
+  assert(tree.count(42) == 0);
+  assert(tree.count(43) == 10);
+  assert(tree.rank(43) == 210);
+  remove("bptree_test_os.db");
+}
+
+auto testBloomFilter () -> void {
+  remove("bptree_test_bf.db");
+  remove("bptree_test_bf.bloom");
+  {
+    BpTree<int, int> tree("bptree_test_bf.db");
+    for (int i = 0; i < 100; ++i) tree.insert(i, i);
+  }
+  BpTree<int, int> tree("bptree_test_bf.db", "bptree_test_bf.bloom", 10, 1000);
+  for (int i = 100; i < 1000; ++i) tree.insert(i, i);
+  for (int i = 0; i < 1000; ++i) assert(tree.findOne(i) == i);
+  for (int i = 1000; i < 11000; ++i) assert(!tree.findOne(i));
+  assert(tree.bloomFilterStats().lookups == 11000);
+  assert(tree.bloomFilterStats().falsePositiveRate() < 0.05);
+  for (int i = 0; i < 1000; i += 2) tree.remove(i, i);
+  tree.rebuildBloomFilter();
+  for (int i = 0; i < 1000; ++i) assert(tree.includes(i, i) == (i % 2 == 1));
+  assert(tree.bloomFilterEstimatedFalsePositiveRate() < 0.05);
+  remove("bptree_test_bf.db");
+  remove("bptree_test_bf.bloom");
+}
+
+struct Incomparable {
+  int x;
+};
+
+auto testUniqueKeys () -> void {
+  remove("bptree_test_uk.db");
+  BpTree<Varchar<20>, Incomparable, 512, BptKeyPolicy::UNIQUE> tree("bptree_test_uk.db");
+  for (int i = 0; i < 1000; ++i) tree.insert(std::to_string(i), { i });
+  for (int i = 0; i < 1000; ++i) tree.insert(std::to_string(i), { -i });
+  assert(tree.size() == 1000);
+  assert(tree.findOne("42")->x == -42);
+  assert(tree.findMany("42").size() == 1);
+  assert(!tree.findOne("1000"));
+  assert(tree.includes("999"));
+  for (int i = 0; i < 1000; i += 2) tree.remove(std::to_string(i));
+  assert(tree.size() == 500);
+  assert(!tree.includes("42"));
+  assert(tree.findOne("43")->x == -43);
+  // removals find the entry by its key alone.
+  bool thrown = false;
+  try {
+    tree.remove("42");
+  } catch (const NotFound &) {
+    thrown = true;
+  }
+  assert(thrown && tree.size() == 500);
+  remove("bptree_test_uk.db");
+}
+
+auto testSnapshot () -> void {
+  remove("bptree_test_ss.db");
+  BpTree<int, int, 512> tree("bptree_test_ss.db");
+  for (int i = 0; i < 1000; ++i) tree.insert(i, i);
+  {
+    auto snapshot = tree.snapshot();
+    std::vector<std::pair<int, int>> page = snapshot.findPage(0, 100);
+    for (int i = 0; i < 1000; i += 2) tree.remove(i, i);
+    for (int i = 1000; i < 2000; ++i) tree.insert(i, i);
+    for (size_t offset = 100; offset < 1000; offset += 100) {
+      std::vector<std::pair<int, int>> next = snapshot.findPage(offset, 100);
+      page.insert(page.end(), next.begin(), next.end());
+    }
+    assert(page.size() == 1000);
+    for (int i = 0; i < 1000; ++i) assert(page[i].first == i);
+    assert(snapshot.findAll() == page);
+    assert(snapshot.size() == 1000);
+    assert(snapshot.findOne(42) == 42);
+    assert(!snapshot.findOne(1042));
+    assert(tree.size() == 1500);
+    assert(!tree.findOne(42));
+    assert(tree.findOne(1042) == 1042);
+  }
+  for (int i = 1; i < 1000; i += 2) tree.remove(i, i);
+  assert(tree.findAll().size() == 1000);
+  remove("bptree_test_ss.db");
+}
+
+auto testLazyRemoval () -> void {
+  remove("bptree_test_lr.db");
+  BpTree<int, int, 512> tree("bptree_test_lr.db");
+  tree.setMinFill(0);
+  for (int i = 0; i < 2000; ++i) tree.insert(i, i);
+  for (int i = 0; i < 2000; ++i) if (i % 10 != 0) tree.remove(i, i);
+  assert(tree.size() == 200);
+  assert(tree.rank(1000) == 100);
+  tree.rebalance();
+  std::vector<std::pair<int, int>> all = tree.findAll();
+  assert(all.size() == 200);
+  for (int i = 0; i < 200; ++i) assert(all[i].first == i * 10);
+  for (int i = 0; i < 2000; i += 10) tree.remove(i, i);
+  assert(tree.findAll().empty());
+  tree.insert(1, 1);
+  assert(tree.findOne(1) == 1);
+  remove("bptree_test_lr.db");
+}
+
+auto testWriteBuffer () -> void {
+  remove("bptree_test_wb.db");
+  {
+    BpTree<int, int, 512> tree("bptree_test_wb.db");
+    tree.setWriteBuffer(100);
+    for (int i = 0; i < 1000; ++i) tree.insert(i * 7 % 1000, i);
+    for (int i = 0; i < 1000; i += 2) tree.remove(i * 7 % 1000, i);
+    // removals are buffered blindly, so removing what is not there does nothing.
+    tree.remove(0, 0);
+    tree.remove(5000, 0);
+    // the last writes are still buffered here, and size and count take them into account without applying them.
+    const size_t writes = tree.fileStats().writes;
+    assert(tree.findOne(7 * 999 % 1000) == 999);
+    assert(!tree.includes(7 * 998 % 1000, 998));
+    assert(tree.size() == 500);
+    assert(tree.count(7 * 999 % 1000) == 1 && tree.count(7 * 998 % 1000) == 0 && tree.count(5000) == 0);
+    assert(tree.fileStats().writes == writes);
+    // the removed keys are looked up once, and inserts into duplicate trees are counted as they are buffered.
+    tree.insert(3000, 0);
+    const size_t reads = tree.stats().nodesRead;
+    assert(tree.size() == 501 && tree.stats().nodesRead == reads + 1);
+    for (int i = 0; i < 49; ++i) tree.insert(2000, i);
+  }
+  BpTree<int, int, 512> tree("bptree_test_wb.db");
+  assert(tree.findMany(2000).size() == 49);
+  assert(tree.size() == 550);
+  remove("bptree_test_wb.db");
+
+  remove("bptree_test_wbu.db");
+  {
+    BpTree<int, int, 512, BptKeyPolicy::UNIQUE> unique("bptree_test_wbu.db");
+    for (int i = 0; i < 100; ++i) unique.insert(i, i);
+    unique.setWriteBuffer(1000);
+    unique.insert(5, -5);
+    unique.insert(200, 200);
+    unique.remove(7);
+    unique.remove(300);
+    assert(unique.size() == 100);
+    assert(unique.count(5) == 1 && unique.count(7) == 0 && unique.count(200) == 1);
+    unique.flush();
+    assert(unique.size() == 100);
+    assert(unique.findOne(5) == -5 && !unique.includes(7) && unique.includes(200));
+    // turning buffering off drops the buffer node, which opening the tree then reads nothing of.
+    unique.setWriteBuffer(0);
+  }
+  BpTree<int, int, 512, BptKeyPolicy::UNIQUE> unique("bptree_test_wbu.db");
+  assert(unique.stats().nodesRead == 1 && unique.size() == 100);
+  remove("bptree_test_wbu.db");
+}
+
+auto testSlottedRecords () -> void {
+  using Slotted = BpTree<Varchar<64>, int, ak::file::kDefaultSzChunk, BptKeyPolicy::DUPLICATE, BptRecordFormat::SLOTTED>;
+  remove("bptree_test_sr.db");
+  {
+    Slotted tree("bptree_test_sr.db");
+    for (int i = 0; i < 10000; ++i) tree.insert("k" + std::to_string(i * 7 % 10000), i);
+    for (int i = 0; i < 10000; i += 2) tree.remove("k" + std::to_string(i * 7 % 10000), i);
+    tree.insert(std::string(64, 'z'), -1);
+  }
+  // fixed-size records of Varchar<64> fit fewer than 60 entries in a chunk, even if full.
+  assert(std::filesystem::file_size("bptree_test_sr.db") < 5000 / 60 * 4096);
+  // the root records the format, so the file is not misread as another one.
+  bool thrown = false;
+  try {
+    BpTree<Varchar<64>, int> plain("bptree_test_sr.db");
+  } catch (const ak::Exception &) {
+    thrown = true;
+  }
+  assert(thrown);
+  Slotted tree("bptree_test_sr.db");
+  assert(tree.size() == 5001);
+  assert(tree.findOne("k7") == 1);
+  assert(!tree.findOne("k0"));
+  assert(tree.findOne(std::string(64, 'z')) == -1);
+  std::vector<std::pair<Varchar<64>, int>> all = tree.findAll();
+  for (size_t i = 1; i < all.size(); ++i) assert(all[i - 1].first < all[i].first);
+  remove("bptree_test_sr.db");
+}
+
+auto testPackedRecords () -> void {
+  using Packed = BpTree<long, int, ak::file::kDefaultSzChunk, BptKeyPolicy::DUPLICATE, BptRecordFormat::PACKED>;
+  remove("bptree_test_pr.db");
+  const long kBase = 1700000000000;
+  {
+    Packed tree("bptree_test_pr.db");
+    for (long i = 0; i < 20000; ++i) tree.insert(kBase + i * 3, i);
+    // keys far from the others widen the keys of their nodes.
+    tree.insert(-1, -1);
+    tree.insert(std::numeric_limits<long>::max(), -2);
+    tree.insert(std::numeric_limits<long>::min(), -3);
+    for (long i = 0; i < 20000; i += 2) tree.remove(kBase + i * 3, i);
+  }
+  // fixed-size records of long and int fit 255 entries in a chunk, even if full.
+  assert(std::filesystem::file_size("bptree_test_pr.db") < 20000 / 255 * 4096);
+  {
+    Packed tree("bptree_test_pr.db");
+    assert(tree.size() == 10003);
+    assert(tree.findOne(kBase + 3) == 1);
+    assert(!tree.findOne(kBase));
+    assert(tree.findOne(std::numeric_limits<long>::min()) == -3);
+    assert(tree.findOne(std::numeric_limits<long>::max()) == -2);
+    assert(tree.rank(kBase) == 2);
+    std::vector<std::pair<long, int>> all = tree.findAll();
+    assert(all.size() == 10003);
+    for (size_t i = 1; i < all.size(); ++i) assert(all[i - 1] < all[i]);
+  }
+  remove("bptree_test_pr.db");
+
+  remove("bptree_test_pru.db");
+  BpTree<unsigned long, char, 512, BptKeyPolicy::UNIQUE, BptRecordFormat::PACKED> unique("bptree_test_pru.db");
+  for (unsigned long i = 0; i < 2000; ++i) unique.insert(i * 0x9e3779b97f4a7c15, i % 128);
+  for (unsigned long i = 0; i < 2000; ++i) assert(unique.findOne(i * 0x9e3779b97f4a7c15) == char(i % 128));
+  assert(unique.size() == 2000);
+  remove("bptree_test_pru.db");
+}
+
+auto testStats () -> void {
+  remove("bptree_test_st.db");
+  remove("bptree_test_st_seq.db");
+  using Tree = BpTree<int, int, 512>;
+  Tree tree("bptree_test_st.db");
+  assert(tree.analyze().height() == 1);
+  for (int i = 0; i < 5000; ++i) tree.insert(i * 7919 % 5000, i);
+  Tree::Stats stats = tree.stats();
+  assert(stats.splits > 0 && stats.rootSplits > 0 && stats.merges == 0);
+  Tree::Shape shape = tree.analyze();
+  // a root split adds a level to the root and its record nodes.
+  assert(shape.height() == 2 + stats.rootSplits);
+  assert(shape.levels.front().nodes == 1);
+  assert(shape.levels.back().length == 5000);
+  for (size_t i = 0; i < shape.height(); ++i) {
+    if (i + 1 < shape.height()) assert(shape.levels[i + 1].nodes == shape.levels[i].length);
+    size_t histogram = 0;
+    for (size_t count : shape.levels[i].fillHistogram) histogram += count;
+    assert(histogram == shape.levels[i].nodes);
+  }
+  assert(shape.levels.back().meanFill > 0.5);
+  tree.findOne(42);
+  assert(tree.stats().nodesRead - stats.nodesRead >= shape.height());
+
+  for (int i = 0; i < 4900; ++i) tree.remove(i * 7919 % 5000, i);
+  assert(tree.stats().merges > 0 && tree.stats().collapses > 0);
+  assert(tree.analyze().height() == 2 + tree.stats().rootSplits - tree.stats().collapses);
+
+  // appends lay out the record nodes in key order, where random inserts scatter them.
+  Tree seq("bptree_test_st_seq.db");
+  for (int i = 0; i < 5000; ++i) seq.insert(i, i);
+  assert(seq.analyze().leafAdjacency > 0.9);
+  assert(shape.leafAdjacency < seq.analyze().leafAdjacency);
+  remove("bptree_test_st.db");
+  remove("bptree_test_st_seq.db");
+}
+
+auto testAppends () -> void {
+  remove("bptree_test_ap.db");
+  remove("bptree_test_ap_half.db");
+  {
+    BpTree<int, int, 512> tree("bptree_test_ap.db");
+    BpTree<int, int, 512> half("bptree_test_ap_half.db");
+    half.setAppendFill(0.5);
+    for (int i = 0; i < 5000; ++i) {
+      tree.insert(i, i);
+      half.insert(i, i);
+    }
+    assert(tree.size() == 5000);
+    assert(tree.rank(2500) == 2500);
+    assert(tree.select(4999)->first == 4999);
+    // a key in the middle drops the cached path, and the appends after it pick it up again.
+    tree.insert(42, -42);
+    tree.remove(100, 100);
+    for (int i = 5000; i < 6000; ++i) tree.insert(i, i);
+    assert(tree.size() == 6000);
+    assert(tree.count(42) == 2);
+    assert(!tree.includes(100, 100));
+    std::vector<std::pair<int, int>> all = tree.findAll();
+    assert(all.size() == 6000);
+    for (size_t i = 1; i < all.size(); ++i) assert(all[i - 1] <= all[i]);
+  }
+  // nodes filled by appends are left fuller than half.
+  assert(std::filesystem::file_size("bptree_test_ap.db") < std::filesystem::file_size("bptree_test_ap_half.db"));
+  remove("bptree_test_ap.db");
+  remove("bptree_test_ap_half.db");
+
+  remove("bptree_test_apu.db");
+  BpTree<int, int, 512, BptKeyPolicy::UNIQUE> unique("bptree_test_apu.db");
+  for (int i = 0; i < 1000; ++i) unique.insert(i, i);
+  unique.insert(999, -1);
+  assert(unique.size() == 1000);
+  assert(unique.findOne(999) == -1);
+  remove("bptree_test_apu.db");
+}
+
+auto testBatchLookup () -> void {
+  remove("bptree_test_bl.db");
+  BpTree<int, int, 512> tree("bptree_test_bl.db");
+  for (int i = 0; i < 3000; ++i) tree.insert(i % 1000 * 2, i);
+  std::vector<int> keys;
+  for (int i = 2100; i-- > -100;) keys.push_back(i * 7 % 2100);
+  std::vector<std::optional<int>> ones = tree.findOneBatch(keys);
+  std::vector<std::vector<int>> manys = tree.findManyBatch(keys);
+  assert(ones.size() == keys.size() && manys.size() == keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    assert(ones[i] == tree.findOne(keys[i]));
+    assert(manys[i] == tree.findMany(keys[i]));
+  }
+  assert(tree.findOneBatch({ 42, 43 })[0] == 21);
+  assert(tree.findManyBatch({ 42 })[0] == std::vector<int>({ 21, 1021, 2021 }));
+  // buffered writes show up in the batches too.
+  tree.setWriteBuffer(16);
+  tree.insert(43, -1);
+  tree.remove(42, 1021);
+  assert(tree.findOneBatch({ 43 })[0] == -1);
+  assert(tree.findManyBatch({ 42 })[0] == std::vector<int>({ 21, 2021 }));
+  assert(tree.findOneBatch({}).empty());
+  remove("bptree_test_bl.db");
+
+  remove("bptree_test_blu.db");
+  BpTree<Varchar<20>, int, 512, BptKeyPolicy::UNIQUE> unique("bptree_test_blu.db");
+  for (int i = 0; i < 1000; ++i) unique.insert(std::to_string(i), i);
+  std::vector<Varchar<20>> strings = { "999", "0", "1000", "42", "42" };
+  std::vector<std::optional<int>> found = unique.findOneBatch(strings);
+  assert(found[0] == 999 && found[1] == 0 && !found[2] && found[3] == 42 && found[4] == 42);
+  remove("bptree_test_blu.db");
+}
+
+auto testParallelScan () -> void {
+  remove("bptree_test_ps.db");
+  ThreadPool pool(3);
+  BpTree<int, int, 512> tree("bptree_test_ps.db");
+  assert(tree.parallelReduce(pool, 0L, [] (long &sum, int, int value) { sum += value; }, std::plus<long>()) == 0);
+  for (int i = 0; i < 20000; ++i) tree.insert(i * 7 % 20000, i);
+  for (int i = 0; i < 20000; i += 3) tree.remove(i * 7 % 20000, i);
+  // buffered writes are applied first.
+  tree.setWriteBuffer(16);
+  tree.insert(-1, 1);
+  std::vector<std::pair<int, int>> all = tree.findAll();
+  long expected = 0;
+  for (const auto &[ _, value ] : all) expected += value;
+  assert(tree.parallelReduce(pool, 0L, [] (long &sum, int, int value) { sum += value; }, std::plus<long>()) == expected);
+  // parts are contiguous and in key order, so concatenating them gives all entries in order.
+  std::vector<std::vector<std::pair<int, int>>> parts(8);
+  size_t nParts = tree.parallelForEach(pool, [&parts] (size_t part, int key, int value) { parts[part].emplace_back(key, value); }, 8);
+  assert(nParts > 1 && nParts <= 8);
+  std::vector<std::pair<int, int>> concatenated;
+  for (size_t i = 0; i < parts.size(); ++i) {
+    assert(parts[i].empty() == (i >= nParts));
+    concatenated.insert(concatenated.end(), parts[i].begin(), parts[i].end());
+  }
+  assert(concatenated == all);
+  std::vector<std::pair<int, int>> firsts = tree.parallelReduce(
+    pool,
+    std::vector<std::pair<int, int>>(),
+    [] (std::vector<std::pair<int, int>> &acc, int key, int value) { if (acc.empty()) acc.emplace_back(key, value); },
+    [] (std::vector<std::pair<int, int>> lhs, const std::vector<std::pair<int, int>> &rhs) {
+      lhs.insert(lhs.end(), rhs.begin(), rhs.end());
+      return lhs;
+    }
+  );
+  assert(firsts.front() == all.front());
+  for (size_t i = 1; i < firsts.size(); ++i) assert(firsts[i - 1] < firsts[i]);
+  remove("bptree_test_ps.db");
+}
+
+auto testCursor () -> void {
+  remove("bptree_test_cur.db");
+  BpTree<int, int, 512> tree("bptree_test_cur.db");
+  // the posting lists of keys 2 to 5 hold the multiples of the key, and that of key 1 a few values.
+  for (int k = 2; k <= 5; ++k) {
+    for (int i = 0; i < 20000; i += k) tree.insert(k, i);
+  }
+  std::vector<int> sparse = { 7, 300, 4200, 9000, 9001, 19999 };
+  for (int i : sparse) tree.insert(1, i);
+  tree.insert(6, 0);
+
+  std::vector<int> values;
+  for (auto cursor = tree.cursor(1); cursor.valid(); cursor.next()) values.push_back(cursor.current());
+  assert(values == sparse);
+  assert(!tree.cursor(0).valid() && !tree.cursor(7).valid());
+  auto cursor = tree.cursor(2);
+  cursor.seek(4001);
+  assert(cursor.current() == 4002);
+  cursor.seek(10);
+  assert(cursor.current() == 4002);
+  cursor.seek(19999);
+  assert(!cursor.valid());
+
+  // the small list seeks through the large one, reading a few of its nodes only.
+  size_t nodesRead = tree.stats().nodesRead;
+  assert(ak::intersect(tree.cursor(2), tree.cursor(1)) == std::vector<int>({ 300, 4200, 9000 }));
+  assert(tree.stats().nodesRead - nodesRead < tree.count(2) / 100);
+  assert(ak::difference(tree.cursor(1), tree.cursor(3)) == std::vector<int>({ 7, 9001, 19999 }));
+  assert(ak::unite(tree.cursor(1), ak::SpanCursor(std::vector<int>({ 1, 300 }))).size() == 7);
+  std::vector<BpTree<int, int, 512>::Cursor> cursors;
+  for (int k = 3; k <= 5; ++k) cursors.push_back(tree.cursor(k));
+  std::vector<int> multiples;
+  ak::intersectAll(cursors, [&multiples] (int i) { multiples.push_back(i); });
+  assert(multiples.size() == 334 && multiples[1] == 60 && multiples.back() == 19980);
+  remove("bptree_test_cur.db");
+}
+
+auto main () -> int {
+  remove("bptree_test.db");
+  BpTree<Varchar<20>, int> tree("bptree_test.db");
+  tree.insert("hello", 1);
+  tree.insert("world", 2);
+  tree.insert("hello", 3);
+  assert(tree.findOne("hello") == 1);
+  assert(tree.findMany("hello").size() == 2);
+  assert(!tree.findOne("foo"));
+  assert(tree.includes("world", 2));
+  tree.remove("hello", 1);
+  assert(tree.findOne("hello") == 3);
+  assert(tree.findAll().size() == 2);
+  remove("bptree_test.db");
+
+  testOrderStatistics();
+  testBloomFilter();
+  testUniqueKeys();
+  testSnapshot();
+  testLazyRemoval();
+  testWriteBuffer();
+  testSlottedRecords();
+  testPackedRecords();
+  testStats();
+  testAppends();
+  testBatchLookup();
+  testParallelScan();
+  testCursor();
+}
@@ -0,0 +1,124 @@
+#include "ak/file/dictionary.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ak/base.h"
+#include "ak/file/bptree.h"
+
+using ak::NotFound;
+using ak::Overflow;
+using ak::file::BpTree;
+using ak::file::DictVarchar;
+using ak::file::StringDictionary;
+
+auto testEncode () -> void {
+  remove("dictionary_test.dict");
+  std::vector<std::string> strings = { "pending", "active", "zombie", "banned", "closed", "active", "a", "zz" };
+  std::vector<DictVarchar<16>> codes;
+  {
+    StringDictionary<16> dict("dictionary_test.dict");
+    for (const std::string &s : strings) codes.push_back(dict.encode(s));
+    assert(dict.size() == 7);
+    assert(codes[1] == codes[5]);
+    assert(dict.decode(codes[2]).view() == "zombie");
+    assert(dict.encode("") == DictVarchar<16>() && dict.decode(DictVarchar<16>()).view().empty());
+    assert(!dict.find("missing"));
+    bool thrown = false;
+    try {
+      dict.encode("longer than sixteen");
+    } catch (const Overflow &) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  StringDictionary<16> dict("dictionary_test.dict");
+  assert(dict.size() == 7);
+  // the codes are in the order of the strings, and kept when reopened.
+  for (size_t i = 0; i < strings.size(); ++i) {
+    assert(dict.find(strings[i]) == codes[i]);
+    assert(dict.decode(codes[i]).view() == strings[i]);
+    for (size_t j = 0; j < strings.size(); ++j) assert((strings[i] < strings[j]) == (codes[i] < codes[j]));
+  }
+  assert(dict.lowerBound("b") == codes[3]);
+  assert(dict.lowerBound("zzz") > codes[7]);
+  bool thrown = false;
+  try {
+    dict.decode(dict.lowerBound("zzz"));
+  } catch (const NotFound &) {
+    thrown = true;
+  }
+  assert(thrown);
+  remove("dictionary_test.dict");
+}
+
+auto testEncodeAll () -> void {
+  remove("dictionary_test_p.dict");
+  std::vector<std::string> strings;
+  for (int i = 0; i < 1000; ++i) strings.push_back("value" + std::to_string(i));
+  std::mt19937 rng(42);
+  std::shuffle(strings.begin(), strings.end(), rng);
+  {
+    StringDictionary<16, uint32_t, 512> dict("dictionary_test_p.dict");
+    std::vector<std::string> batch(strings.begin(), strings.begin() + 800);
+    batch.push_back(batch[0]);
+    std::vector<DictVarchar<16, uint32_t>> codes = dict.encodeAll(batch);
+    assert(codes.size() == 801 && codes[800] == codes[0]);
+    assert(dict.decode(codes[42]).view() == batch[42]);
+    for (size_t i = 800; i < strings.size(); ++i) dict.encode(strings[i]);
+  }
+  StringDictionary<16, uint32_t, 512> dict("dictionary_test_p.dict");
+  assert(dict.size() == 1000);
+  std::sort(strings.begin(), strings.end());
+  for (size_t i = 1; i < strings.size(); ++i) assert(*dict.find(strings[i - 1]) < *dict.find(strings[i]));
+  remove("dictionary_test_p.dict");
+}
+
+auto testCodesRunOut () -> void {
+  remove("dictionary_test_o.dict");
+  StringDictionary<4, uint8_t> dict("dictionary_test_o.dict");
+  bool thrown = false;
+  try {
+    for (char c = 'a'; c <= 'z'; ++c) dict.encode(std::string(1, c));
+  } catch (const Overflow &) {
+    thrown = true;
+  }
+  assert(thrown);
+  // the strings before the overflow are kept.
+  assert(dict.size() > 8 && dict.decode(*dict.find("a")).view() == "a");
+  remove("dictionary_test_o.dict");
+}
+
+auto testBpTreeRange () -> void {
+  remove("dictionary_test_t.dict");
+  remove("dictionary_test_t.db");
+  StringDictionary<16> regions("dictionary_test_t.dict");
+  BpTree<DictVarchar<16>, int, 512> tree("dictionary_test_t.db");
+  std::vector<std::string> names = { "us-west", "eu-north", "ap-south", "us-east", "eu-west", "sa-east" };
+  for (int i = 0; i < 600; ++i) tree.insert(regions.encode(names[i % names.size()]), i);
+  // the regions from "eu" on and before "us".
+  std::vector<std::pair<DictVarchar<16>, int>> range = tree.findRange(regions.lowerBound("eu"), regions.lowerBound("us"));
+  assert(range.size() == 300);
+  for (const auto &[ region, _ ] : range) {
+    std::string_view name = regions.decode(region).view();
+    assert(name >= "eu" && name < "us");
+  }
+  assert(tree.count(*regions.find("sa-east")) == 100);
+  remove("dictionary_test_t.dict");
+  remove("dictionary_test_t.db");
+}
+
+auto main () -> int {
+  testEncode();
+  testEncodeAll();
+  testCodesRunOut();
+  testBpTreeRange();
+  return 0;
+}
@@ -0,0 +1,66 @@
+#include "ak/file/hashindex.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "ak/file/varchar.h"
+
+using ak::NotFound;
+using ak::file::BptKeyPolicy;
+using ak::file::HashIndex;
+using ak::file::Varchar;
+
+auto testDuplicateKeys () -> void {
+  remove("hashindex_test.db");
+  {
+    HashIndex<int, int, 512> index("hashindex_test.db");
+    for (int i = 0; i < 3000; ++i) index.insert(i % 1000, i);
+    // a key with more entries than a bucket holds goes to overflow pages
+    for (int i = 0; i < 100; ++i) index.insert(-1, 100 - i);
+    assert(index.size() == 3100);
+    assert(index.globalDepth() > 0);
+    for (int i = 0; i < 3000; i += 2) index.remove(i % 1000, i);
+    bool thrown = false;
+    try {
+      index.remove(0, 0);
+    } catch (const NotFound &) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  HashIndex<int, int, 512> index("hashindex_test.db");
+  assert(index.size() == 1600);
+  assert(index.findMany(1) == std::vector<int>({ 1, 1001, 2001 }));
+  assert(index.findMany(2).empty());
+  assert(index.findOne(3) == 3);
+  assert(!index.findOne(1000));
+  assert(index.includes(5, 2005));
+  assert(!index.includes(5, 2004));
+  assert(index.findMany(-1).size() == 100);
+  assert(index.findOne(-1) == 1);
+  for (int i = 1; i <= 100; ++i) index.remove(-1, i);
+  assert(!index.includes(-1));
+  remove("hashindex_test.db");
+}
+
+auto testUniqueKeys () -> void {
+  remove("hashindex_test_uk.db");
+  HashIndex<Varchar<16>, int, 4096, BptKeyPolicy::UNIQUE> index("hashindex_test_uk.db");
+  for (int i = 0; i < 1000; ++i) index.insert(std::to_string(i), i);
+  for (int i = 0; i < 1000; i += 3) index.insert(std::to_string(i), -i);
+  assert(index.size() == 1000);
+  assert(index.findOne("3") == -3);
+  assert(index.findOne("4") == 4);
+  index.remove("4");
+  assert(!index.includes("4"));
+  assert(index.findMany("5") == std::vector<int>({ 5 }));
+  remove("hashindex_test_uk.db");
+}
+
+auto main () -> int {
+  testDuplicateKeys();
+  testUniqueKeys();
+}
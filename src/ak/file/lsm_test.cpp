@@ -0,0 +1,86 @@
+#include "ak/file/lsm.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <concepts>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ak/file/varchar.h"
+
+using ak::file::BptKeyPolicy;
+using ak::file::LsmTree;
+using ak::file::Varchar;
+
+auto removeFiles (const std::string &prefix) -> void {
+  remove((prefix + ".manifest").c_str());
+  remove((prefix + ".log").c_str());
+  for (int i = 0; i < 1000; ++i) remove((prefix + "." + std::to_string(i) + ".run").c_str());
+}
+
+auto testDuplicateKeys () -> void {
+  removeFiles("lsm_test");
+  {
+    LsmTree<int, int, 512> tree("lsm_test");
+    tree.setMemtableCapacity(100);
+    for (int i = 0; i < 3000; ++i) tree.insert(i % 1000, i);
+    for (int i = 0; i < 3000; i += 2) tree.remove(i % 1000, i);
+    // removing an absent entry is not an error
+    tree.remove(-1, 0);
+    tree.waitForCompaction();
+    assert(tree.levels().size() > 1);
+    assert((tree.levels()[0] < LsmTree<int, int, 512>::kRunsPerLevel));
+    tree.insert(0, 0);
+  }
+  // the last writes are replayed from the log
+  LsmTree<int, int, 512> tree("lsm_test");
+  assert(tree.findMany(1) == std::vector<int>({ 1, 1001, 2001 }));
+  assert(tree.findMany(2).empty());
+  assert(tree.findMany(0) == std::vector<int>({ 0 }));
+  assert(tree.findOne(3) == 3);
+  assert(!tree.findOne(1000));
+  assert(tree.includes(5, 2005));
+  assert(!tree.includes(5, 2004));
+  std::vector<std::pair<int, int>> all = tree.findAll();
+  assert(all.size() == 1501);
+  assert(all[0] == std::make_pair(0, 0));
+  assert(all[1] == std::make_pair(1, 1));
+  removeFiles("lsm_test");
+}
+
+/// a value without a default constructor, of which the tombstone of a key alone cannot be made.
+struct Score {
+  int x;
+  Score (int x) : x(x) {}
+};
+template <typename Tree>
+concept RemovableByKey = requires (Tree &tree) { tree.remove(0); };
+
+auto testUniqueKeys () -> void {
+  removeFiles("lsm_test_uk");
+  {
+    LsmTree<Varchar<16>, int, 4096, BptKeyPolicy::UNIQUE> tree("lsm_test_uk");
+    tree.setMemtableCapacity(64);
+    for (int i = 0; i < 1000; ++i) tree.insert(std::to_string(i), i);
+    for (int i = 0; i < 1000; i += 3) tree.insert(std::to_string(i), -i);
+    tree.remove("4");
+    assert(tree.findOne("3") == -3);
+    assert(!tree.includes("4"));
+  }
+  LsmTree<Varchar<16>, int, 4096, BptKeyPolicy::UNIQUE> tree("lsm_test_uk");
+  assert(tree.findOne("3") == -3);
+  assert(tree.findOne("5") == 5);
+  assert(!tree.includes("4"));
+  assert(tree.findMany("6") == std::vector<int>({ -6 }));
+  assert(tree.findAll().size() == 999);
+  removeFiles("lsm_test_uk");
+  static_assert(RemovableByKey<LsmTree<int, int, 4096, BptKeyPolicy::UNIQUE>>);
+  static_assert(!RemovableByKey<LsmTree<int, Score, 4096, BptKeyPolicy::UNIQUE>>);
+}
+
+auto main () -> int {
+  testDuplicateKeys();
+  testUniqueKeys();
+}
@@ -0,0 +1,93 @@
+#include "ak/file/sharded.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ak/file/varchar.h"
+#include "ak/threadpool.h"
+
+using ak::ThreadPool;
+using ak::file::BptKeyPolicy;
+using ak::file::ShardedBpTree;
+using ak::file::Varchar;
+
+auto removeShards (const char *prefix, size_t nShards) -> void {
+  for (size_t i = 0; i < nShards; ++i) remove((std::string(prefix) + "." + std::to_string(i) + ".shard").c_str());
+}
+
+auto testThreadPool () -> void {
+  ThreadPool pool(3);
+  assert(pool.size() == 3);
+  assert(pool.submit([] () { return 42; }).get() == 42);
+  std::atomic<int> sum = 0;
+  pool.parallelFor(100, [&sum] (size_t i) { sum += i; });
+  assert(sum == 4950);
+  bool thrown = false;
+  try {
+    pool.parallelFor(4, [] (size_t i) { if (i == 2) throw std::runtime_error("2"); });
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+auto testHashSharding () -> void {
+  removeShards("sharded_test_h", 4);
+  {
+    ShardedBpTree<int, int, 512> tree("sharded_test_h", 4);
+    std::vector<std::pair<int, int>> entries;
+    for (int i = 0; i < 3000; ++i) entries.emplace_back(i % 1000, i);
+    tree.insertBatch(entries);
+    tree.insert(-1, -1);
+    assert(tree.size() == 3001);
+    for (size_t i = 0; i < tree.shards(); ++i) assert(tree.shard(i).size() > 0);
+    assert(tree.findMany(42) == std::vector<int>({ 42, 1042, 2042 }));
+    assert(tree.count(42) == 3);
+    tree.remove(42, 1042);
+    assert(!tree.includes(42, 1042));
+    assert(tree.findOne(-1) == -1);
+  }
+  ShardedBpTree<int, int, 512> tree("sharded_test_h", 4);
+  std::vector<std::pair<int, int>> all = tree.findAll();
+  assert(all.size() == 3000);
+  for (size_t i = 1; i < all.size(); ++i) assert(all[i - 1] < all[i]);
+  std::vector<std::pair<int, int>> range = tree.findRange(10, 20);
+  assert(range.size() == 30);
+  assert(range.front() == std::make_pair(10, 10) && range.back() == std::make_pair(19, 2019));
+  assert(tree.countRange(10, 20) == 30);
+  removeShards("sharded_test_h", 4);
+}
+
+auto testRangeSharding () -> void {
+  removeShards("sharded_test_r", 3);
+  ShardedBpTree<Varchar<8>, int, 512, BptKeyPolicy::UNIQUE> tree("sharded_test_r", { "b", "a" });
+  assert(tree.shards() == 3);
+  for (int i = 0; i < 26; ++i) tree.insert(std::string(1, 'a' + i) + "x", i);
+  tree.insert("0", -1);
+  tree.insert("0", -2);
+  assert(tree.shard(0).size() == 1);
+  assert(tree.shard(1).size() == 1);
+  assert(tree.shard(2).size() == 25);
+  assert(tree.findOne("0") == -2);
+  std::vector<std::pair<Varchar<8>, int>> all = tree.findAll();
+  assert(all.size() == 27);
+  for (size_t i = 1; i < all.size(); ++i) assert(all[i - 1].first < all[i].first);
+  assert(tree.findRange("0", "c").size() == 3);
+  assert(tree.countRange("ax", "bx") == 1);
+  tree.remove("ax");
+  assert(!tree.includes("ax"));
+  removeShards("sharded_test_r", 3);
+}
+
+auto main () -> int {
+  testThreadPool();
+  testHashSharding();
+  testRangeSharding();
+  return 0;
+}
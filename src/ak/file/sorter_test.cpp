@@ -0,0 +1,120 @@
+#include "ak/file/sorter.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "ak/file/bptree.h"
+#include "ak/losertree.h"
+
+using ak::LoserTree;
+using ak::file::BpTree;
+using ak::file::ExternalSorter;
+
+auto testLoserTree () -> void {
+  LoserTree<int> empty({});
+  assert(empty.empty());
+  LoserTree<int> tree({ 3, std::nullopt, 1, 2, 1 });
+  std::vector<int> tops, sources;
+  for (; !tree.empty(); tree.replace(std::nullopt)) {
+    tops.push_back(tree.top());
+    sources.push_back(tree.source());
+  }
+  assert(tops == std::vector<int>({ 1, 1, 2, 3 }));
+  // ties go to the lower source.
+  assert(sources == std::vector<int>({ 2, 4, 3, 0 }));
+}
+
+struct Record {
+  int key;
+  int value;
+  auto operator< (const Record &that) const -> bool { return key < that.key; }
+};
+
+auto testInMemory () -> void {
+  ExternalSorter<int> sorter("sorter_test_m");
+  for (int i = 0; i < 1000; ++i) sorter.push(i * 7 % 1000);
+  std::vector<int> sorted;
+  for (int x : sorter) sorted.push_back(x);
+  assert(sorter.runs() == 0);
+  assert(sorted.size() == 1000);
+  for (int i = 0; i < 1000; ++i) assert(sorted[i] == i);
+  ExternalSorter<int> none("sorter_test_m");
+  assert(none.begin() == none.end());
+}
+
+auto testExternal () -> void {
+  std::mt19937 rng(42);
+  std::vector<Record> records;
+  for (int i = 0; i < 100000; ++i) records.push_back({ (int) (rng() % 50000), i });
+  {
+    // 16 KiB buffers of 2048 records, and 4 runs merged at a time: 49 runs, merged in 2 passes before the final merge.
+    ExternalSorter<Record, 4096> sorter("sorter_test_e", 16384 * 2);
+    for (const Record &record : records) sorter.push(record);
+    assert(sorter.size() == records.size());
+    assert(sorter.runs() == 48);
+    std::vector<Record> sorted;
+    for (const Record &record : sorter) sorted.push_back(record);
+    assert(!std::filesystem::exists("sorter_test_e.0.run"));
+    assert(sorted.size() == records.size());
+    for (size_t i = 1; i < sorted.size(); ++i) assert(!(sorted[i] < sorted[i - 1]));
+    long sum = 0;
+    for (const Record &record : sorted) sum += record.value;
+    assert(sum == 100000L * 99999 / 2);
+  }
+  for (const auto &entry : std::filesystem::directory_iterator(".")) assert(!entry.path().filename().string().starts_with("sorter_test_e"));
+}
+
+auto testManyRuns () -> void {
+  // with 64 file descriptors, 16 runs are merged at a time, although the budget would allow 64.
+  rlimit limit, lowered;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  lowered = limit;
+  lowered.rlim_cur = 64;
+  setrlimit(RLIMIT_NOFILE, &lowered);
+  {
+    ExternalSorter<int, 512> sorter("sorter_test_m", 512 * 2 * 64);
+    assert(sorter.fanIn() == 16);
+    const int n = 8192 * 100;
+    for (int i = 0; i < n; ++i) sorter.push((int) ((i * 7919L) % n));
+    assert(sorter.runs() == 100);
+    int expected = 0;
+    for (int record : sorter) assert(record == expected++);
+    assert(expected == n);
+  }
+  setrlimit(RLIMIT_NOFILE, &limit);
+  using Sorter = ExternalSorter<int, 512>;
+  Sorter unlimited("sorter_test_m", 1 << 30);
+  assert(unlimited.fanIn() <= Sorter::kMaxFanIn);
+}
+
+auto testFeedBpTree () -> void {
+  remove("sorter_test_bpt.db");
+  ExternalSorter<int, 512, std::greater<int>> sorter("sorter_test_f", 4096);
+  for (int i = 0; i < 5000; ++i) sorter.push(i * 13 % 5000);
+  BpTree<int, int, 512> tree("sorter_test_bpt.db");
+  int previous = 5000;
+  for (int key : sorter) {
+    assert(key < previous);
+    previous = key;
+    tree.insert(-key, key);
+  }
+  assert(tree.size() == 5000);
+  assert(tree.findOne(-42) == 42);
+  remove("sorter_test_bpt.db");
+}
+
+auto main () -> int {
+  testLoserTree();
+  testInMemory();
+  testExternal();
+  testManyRuns();
+  testFeedBpTree();
+  return 0;
+}
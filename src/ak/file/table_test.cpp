@@ -0,0 +1,62 @@
+#include "ak/file/table.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "ak/file/varchar.h"
+
+using ak::file::File;
+using ak::file::ManagedObject;
+using ak::file::Table;
+using ak::file::Varchar;
+
+struct User : public ManagedObject<User> {
+  char _start[0];
+  Varchar<32> name;
+  int age;
+  char _end[0];
+  User (File<> &file) : ManagedObject<User>(file) {}
+};
+
+auto cleanup () -> void {
+  remove("table_test.records");
+  remove("table_test.name.index");
+  remove("table_test.age.index");
+}
+
+auto main () -> int {
+  cleanup();
+  Table<User> users("table_test");
+  auto &byName = users.addIndex<Varchar<32>>("name", [] (const User &user) { return user.name; });
+  auto &byAge = users.addIndex<int, Varchar<32>>("age", [] (const User &user) { return user.age; }, [] (const User &user) { return user.name; });
+
+  User alice = users.create();
+  alice.name = "alice";
+  alice.age = 20;
+  users.insert(alice);
+  User bob = users.create();
+  bob.name = "bob";
+  bob.age = 20;
+  users.insert(bob);
+
+  assert(byName.findOne("alice")->age == 20);
+  assert(byName.findIds("bob") == std::vector<size_t>{ bob.id() });
+  assert(byAge.count(20) == 2);
+  auto covered = byAge.findCovered(20);
+  assert(covered.size() == 2);
+  assert(covered[0].second == Varchar<32>("alice"));
+
+  bob.age = 30;
+  bob.name = "robert";
+  users.update(bob);
+  assert(!byName.findOne("bob"));
+  assert(byName.findOne("robert")->age == 30);
+  assert(byAge.findMany(20).size() == 1);
+  assert(byAge.findCovered(30)[0].second == Varchar<32>("robert"));
+
+  users.destroy(alice);
+  assert(!byName.findOne("alice"));
+  assert(byAge.count(20) == 0);
+  assert(users.get(bob.id()).age == 30);
+  cleanup();
+}
@@ -0,0 +1,120 @@
+#include "ak/file/varchar.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <string>
+#include <string_view>
+
+#include "ak/base.h"
+#include "ak/file/bptree.h"
+
+using ak::Overflow;
+using ak::file::BpTree;
+using ak::file::BptKeyPolicy;
+using ak::file::BptRecordFormat;
+using ak::file::Cell;
+using ak::file::Varchar;
+
+auto testConstruct () -> void {
+  Varchar<8> empty;
+  assert(empty.length() == 0 && empty.view().empty());
+  Varchar<8> a("abc"), b(std::string("abc")), c(std::string_view("abcdef", 3));
+  assert(a.length() == 3 && a.view() == "abc");
+  assert(a == b && b == c);
+  assert(a.str() == "abc" && std::string(c) == "abc");
+  Varchar<8> full("12345678");
+  assert(full.length() == 8);
+  bool thrown = false;
+  try {
+    Varchar<8> overflow("123456789");
+  } catch (const Overflow &) {
+    thrown = true;
+  }
+  assert(thrown);
+}
+
+auto testAssign () -> void {
+  Varchar<8> s;
+  s = "hello";
+  assert(s.view() == "hello");
+  s = std::string_view("hi there", 2);
+  assert(s.view() == "hi" && s.length() == 2);
+  s = std::string("bye");
+  assert(s.view() == "bye");
+  Varchar<16> wide("wide");
+  s = wide;
+  assert(s.view() == "wide" && s == wide);
+  Varchar<16> copied(s);
+  assert(copied.length() == 4);
+  bool thrown = false;
+  try {
+    s = Varchar<16>("much too long");
+  } catch (const Overflow &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(s.view() == "wide");
+}
+
+auto testCompare () -> void {
+  Varchar<32> ab("ab"), abc("abc"), abd("abd"), b("b");
+  assert(ab < abc && abc < abd && abd < b);
+  assert(!(abc < ab) && ab != abc);
+  assert((abc <=> Varchar<8>("abc")) == 0);
+  // bytes compare as unsigned, as with strcmp.
+  assert(Varchar<8>("a") < Varchar<8>("\xff"));
+  std::string longer(32, 'x'), shorter(31, 'x');
+  assert(Varchar<32>(shorter) < Varchar<32>(longer));
+  assert(std::hash<Varchar<32>>()(abc) == std::hash<std::string_view>()("abc"));
+}
+
+auto testCell () -> void {
+  using VarcharCell = Cell<Varchar<8>>;
+  char buf[16];
+  Varchar<8> s("cell"), read;
+  assert(VarcharCell::size(s) == 5);
+  assert(VarcharCell::write(s, buf) == 5);
+  assert(VarcharCell::read(read, buf) == 5);
+  assert(read == s && read.length() == 4);
+  // the length is stored, so null bytes read back too.
+  Varchar<8> nul(std::string_view("a\0b", 3));
+  assert(VarcharCell::write(nul, buf) == 4);
+  assert(VarcharCell::read(read, buf) == 4);
+  assert(read == nul && read.length() == 3);
+}
+
+auto testBpTree () -> void {
+  // slotted record nodes store keys as cells.
+  using Tree = BpTree<Varchar<16>, int, ak::file::kDefaultSzChunk, BptKeyPolicy::DUPLICATE, BptRecordFormat::SLOTTED>;
+  const char *filename = "/tmp/varchar-bptree-test";
+  remove(filename);
+  const std::string nul("a\0b", 3), nuls("\0\0", 2);
+  {
+    Tree tree(filename);
+    tree.insert(nul, 1);
+    tree.insert("a", 2);
+    tree.insert(nuls, 3);
+    for (int i = 0; i < 1000; ++i) tree.insert(std::string("k\0") + std::to_string(i), i);
+  }
+  Tree tree(filename);
+  assert(tree.findOne(nul) == 1);
+  assert(tree.findOne("a") == 2);
+  assert(tree.findOne(nuls) == 3);
+  assert(tree.findMany(std::string("a\0", 2)).empty());
+  for (int i = 0; i < 1000; ++i) assert(tree.findOne(std::string("k\0") + std::to_string(i)) == i);
+  auto all = tree.findAll();
+  assert(all.size() == 1003);
+  assert(all[0].first.view() == nuls && all[0].second == 3);
+  assert(all[1].first.view() == "a" && all[2].first.view() == nul);
+  remove(filename);
+}
+
+auto main () -> int {
+  testConstruct();
+  testAssign();
+  testCompare();
+  testCell();
+  testBpTree();
+  return 0;
+}
@@ -0,0 +1,81 @@
+#include "ak/setops.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ak/file/set.h"
+
+using ak::SpanCursor;
+using ak::file::Set;
+
+/// a sorted sample of n distinct values below range.
+auto sample (std::mt19937 &rng, size_t n, int range) -> std::vector<int> {
+  std::set<int> values;
+  while (values.size() < n) values.insert(rng() % range);
+  return std::vector<int>(values.begin(), values.end());
+}
+
+auto testGallop () -> void {
+  std::vector<int> v = { 1, 3, 5, 7, 9, 11, 13 };
+  for (int x = 0; x <= 14; ++x) assert(ak::gallop(v.data(), v.data() + v.size(), x) == std::lower_bound(v.data(), v.data() + v.size(), x));
+  assert(ak::gallop(v.data(), v.data(), 5) == v.data());
+}
+
+auto testKernels () -> void {
+  std::mt19937 rng(42);
+  // similar lengths take the block kernel, skewed ones the galloping one.
+  for (auto [ na, nb ] : { std::pair(1000, 1200), std::pair(5, 3000), std::pair(0, 10), std::pair(17, 9) }) {
+    std::vector<int> a = sample(rng, na, 4000), b = sample(rng, nb, 4000);
+    std::vector<int> both, either, only;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(both));
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(either));
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(only));
+    assert(ak::intersect(SpanCursor(a), SpanCursor(b)) == both);
+    assert(ak::intersect(SpanCursor(b), SpanCursor(a)) == both);
+    assert(ak::unite(SpanCursor(a), SpanCursor(b)) == either);
+    assert(ak::difference(SpanCursor(a), SpanCursor(b)) == only);
+  }
+  std::vector<std::string> a = { "a", "c", "d", "f" }, b = { "b", "c", "f", "g" };
+  assert(ak::intersect(SpanCursor(a), SpanCursor(b)) == std::vector<std::string>({ "c", "f" }));
+}
+
+auto testIntersectAll () -> void {
+  std::mt19937 rng(7);
+  std::vector<std::vector<int>> lists = { sample(rng, 2000, 5000), sample(rng, 3000, 5000), sample(rng, 50, 5000) };
+  std::vector<int> expected = lists[0];
+  for (size_t i = 1; i < lists.size(); ++i) {
+    std::vector<int> next;
+    std::set_intersection(expected.begin(), expected.end(), lists[i].begin(), lists[i].end(), std::back_inserter(next));
+    expected = next;
+  }
+  std::vector<SpanCursor<int>> cursors;
+  for (const std::vector<int> &list : lists) cursors.emplace_back(list);
+  std::vector<int> res;
+  ak::intersectAll(cursors, [&res] (int x) { res.push_back(x); });
+  assert(res == expected);
+}
+
+auto testSet () -> void {
+  Set<int, 16> a;
+  Set<int, 8> b;
+  for (int x : { 9, 1, 4, 7 }) a.insert(x);
+  for (int x : { 4, 2, 9 }) b.insert(x);
+  assert(a.intersect(b) == std::vector<int>({ 4, 9 }));
+  assert(a.unite(b) == std::vector<int>({ 1, 2, 4, 7, 9 }));
+  assert(a.difference(b) == std::vector<int>({ 1, 7 }));
+  assert(b.difference(a) == std::vector<int>({ 2 }));
+}
+
+auto main () -> int {
+  testGallop();
+  testKernels();
+  testIntersectAll();
+  testSet();
+  return 0;
+}
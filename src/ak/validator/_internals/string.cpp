@@ -1,5 +1,7 @@
 #include "ak/validator/_internals/string.h"
 
+#include "ak/validator/pattern.h"
+
 namespace ak::validator::_internals {
 
 Validator<std::string>::Validator (const T &value) : value_(value) {}
@@ -54,7 +56,8 @@ auto Validator<std::string>::toMatch (const std::regex &pattern) const -> const
   return *this;
 }
 auto Validator<std::string>::toMatch (const std::string &pattern) const -> const Validator<std::string> & {
-  return toMatch(std::regex(pattern));
+  validate(Pattern::cached(pattern)->match(value_), inverse_);
+  return *this;
 }
 
 auto Validator<std::string>::toPartiallyMatch (const std::regex &pattern) const -> const Validator<std::string> & {
@@ -62,7 +65,8 @@ auto Validator<std::string>::toPartiallyMatch (const std::regex &pattern) const
   return *this;
 }
 auto Validator<std::string>::toPartiallyMatch (const std::string &pattern) const -> const Validator<std::string> & {
-  return toPartiallyMatch(std::regex(pattern));
+  validate(Pattern::cached(pattern)->search(value_), inverse_);
+  return *this;
 }
 
 auto Validator<std::string>::toBeOfLength (size_t length) const -> const Validator<std::string> & {
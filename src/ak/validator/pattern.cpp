@@ -0,0 +1,504 @@
+#include "ak/validator/pattern.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ak::validator {
+
+namespace {
+
+using ByteSet = std::bitset<256>;
+
+/// thrown by the parser for what the automata do not support, or do not accept, so that std::regex takes over.
+struct Unsupported {};
+
+/// the syntax tree of a pattern. max is -1 for unbounded repeats.
+struct Ast {
+  enum Type { EMPTY, SET, CONCAT, ALT, REPEAT, BOL, EOL } type = EMPTY;
+  ByteSet set;
+  std::vector<Ast> children;
+  int min = 0;
+  int max = -1;
+};
+
+/// the most a counted repeat may repeat, and the most states an NFA may have, before the pattern is left to std::regex.
+constexpr int kMaxRepeat = 1000;
+constexpr size_t kMaxNfaStates = 20000;
+/// a DFA with more states falls back to simulating the NFA.
+constexpr size_t kMaxDfaStates = 2048;
+
+auto rangeOf (unsigned char lo, unsigned char hi) -> ByteSet {
+  ByteSet res;
+  for (int c = lo; c <= hi; ++c) res.set(c);
+  return res;
+}
+auto digits () -> ByteSet { return rangeOf('0', '9'); }
+auto wordChars () -> ByteSet { return rangeOf('a', 'z') | rangeOf('A', 'Z') | digits() | rangeOf('_', '_'); }
+auto spaces () -> ByteSet { return rangeOf('\t', '\r') | rangeOf(' ', ' '); }
+auto anyChar () -> ByteSet { return ~(rangeOf('\n', '\n') | rangeOf('\r', '\r')); }
+
+/// a recursive descent parser of the regular subset of the ECMAScript syntax.
+class Parser {
+ private:
+  std::string_view s_;
+  size_t pos_ = 0;
+
+  auto peek_ () const -> int { return pos_ < s_.length() ? (unsigned char) s_[pos_] : -1; }
+  auto get_ () -> int {
+    if (pos_ >= s_.length()) throw Unsupported();
+    return (unsigned char) s_[pos_++];
+  }
+  static auto hexValue_ (int c) -> int {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    throw Unsupported();
+  }
+  auto hex_ (int n) -> int {
+    int res = 0;
+    for (int i = 0; i < n; ++i) res = res * 16 + hexValue_(get_());
+    return res;
+  }
+  auto number_ () -> int {
+    if (peek_() < '0' || peek_() > '9') throw Unsupported();
+    int res = 0;
+    while (peek_() >= '0' && peek_() <= '9') {
+      res = res * 10 + get_() - '0';
+      if (res > kMaxRepeat) throw Unsupported();
+    }
+    return res;
+  }
+  /// the set of an escape after the backslash, or of its single char. inClass tells \b, a backspace in classes only, apart.
+  auto escape_ (bool inClass, bool &single) -> ByteSet {
+    int c = get_();
+    single = false;
+    switch (c) {
+      case 'd': return digits();
+      case 'D': return ~digits();
+      case 'w': return wordChars();
+      case 'W': return ~wordChars();
+      case 's': return spaces();
+      case 'S': return ~spaces();
+      default: break;
+    }
+    single = true;
+    switch (c) {
+      case 't': return rangeOf('\t', '\t');
+      case 'n': return rangeOf('\n', '\n');
+      case 'r': return rangeOf('\r', '\r');
+      case 'f': return rangeOf('\f', '\f');
+      case 'v': return rangeOf('\v', '\v');
+      case 'x': {
+        int value = hex_(2);
+        return rangeOf(value, value);
+      }
+      case 'u': {
+        int value = hex_(4);
+        if (value > 0x7f) throw Unsupported();
+        return rangeOf(value, value);
+      }
+      case '0':
+        if (peek_() >= '0' && peek_() <= '9') throw Unsupported();
+        return rangeOf(0, 0);
+      case 'b':
+        if (!inClass) throw Unsupported();
+        return rangeOf('\b', '\b');
+      default: break;
+    }
+    // backreferences, \B, \c and other escapes of letters or digits are not regular, or not worth it.
+    if (c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) throw Unsupported();
+    return rangeOf(c, c);
+  }
+  auto class_ () -> ByteSet {
+    bool negated = peek_() == '^';
+    if (negated) ++pos_;
+    // [] and [^] differ between dialects.
+    if (peek_() == ']') throw Unsupported();
+    ByteSet res;
+    while (peek_() != ']') {
+      bool single = true;
+      ByteSet lo = classAtom_(single);
+      if (peek_() == '-' && pos_ + 1 < s_.length() && s_[pos_ + 1] != ']') {
+        ++pos_;
+        bool singleHi = true;
+        ByteSet hi = classAtom_(singleHi);
+        if (!single || !singleHi) throw Unsupported();
+        int from = firstOf_(lo), to = firstOf_(hi);
+        if (from > to) throw Unsupported();
+        res |= rangeOf(from, to);
+      } else {
+        res |= lo;
+      }
+    }
+    ++pos_;
+    return negated ? ~res : res;
+  }
+  auto classAtom_ (bool &single) -> ByteSet {
+    int c = get_();
+    single = true;
+    if (c == '\\') return escape_(true, single);
+    // character classes, equivalence classes and collating elements.
+    if (c == '[' && (peek_() == ':' || peek_() == '.' || peek_() == '=')) throw Unsupported();
+    if (c >= 0x80) throw Unsupported();
+    return rangeOf(c, c);
+  }
+  static auto firstOf_ (const ByteSet &set) -> int {
+    for (int c = 0; c < 256; ++c) if (set[c]) return c;
+    throw Unsupported();
+  }
+  auto atom_ () -> Ast {
+    int c = get_();
+    Ast res;
+    switch (c) {
+      case '(':
+        if (peek_() == '?') {
+          ++pos_;
+          if (get_() != ':') throw Unsupported();
+        }
+        res = alternation_();
+        if (get_() != ')') throw Unsupported();
+        return res;
+      case '[':
+        res.type = Ast::SET;
+        res.set = class_();
+        return res;
+      case '.':
+        res.type = Ast::SET;
+        res.set = anyChar();
+        return res;
+      case '^':
+        res.type = Ast::BOL;
+        return res;
+      case '$':
+        res.type = Ast::EOL;
+        return res;
+      case '\\': {
+        bool single;
+        res.type = Ast::SET;
+        res.set = escape_(false, single);
+        return res;
+      }
+      case ')': case '*': case '+': case '?': case '{': case '}': case ']': case '|':
+        throw Unsupported();
+      default:
+        if (c >= 0x80) throw Unsupported();
+        res.type = Ast::SET;
+        res.set = rangeOf(c, c);
+        return res;
+    }
+  }
+  /// parses a quantifier, if any, into min and max.
+  auto quantifier_ (int &min, int &max) -> bool {
+    switch (peek_()) {
+      case '*': min = 0; max = -1; break;
+      case '+': min = 1; max = -1; break;
+      case '?': min = 0; max = 1; break;
+      case '{':
+        ++pos_;
+        min = max = number_();
+        if (peek_() == ',') {
+          ++pos_;
+          max = peek_() == '}' ? -1 : number_();
+        }
+        if (peek_() != '}' || (max != -1 && max < min)) throw Unsupported();
+        break;
+      default: return false;
+    }
+    ++pos_;
+    // lazy quantifiers match the same strings, only in another order.
+    if (peek_() == '?') ++pos_;
+    return true;
+  }
+  auto repeat_ () -> Ast {
+    Ast atom = atom_();
+    int min, max;
+    if (!quantifier_(min, max)) return atom;
+    if (atom.type == Ast::BOL || atom.type == Ast::EOL) throw Unsupported();
+    int next = peek_();
+    if (next == '*' || next == '+' || next == '?' || next == '{') throw Unsupported();
+    Ast res;
+    res.type = Ast::REPEAT;
+    res.min = min;
+    res.max = max;
+    res.children.push_back(std::move(atom));
+    return res;
+  }
+  auto concatenation_ () -> Ast {
+    Ast res;
+    res.type = Ast::CONCAT;
+    while (peek_() != -1 && peek_() != '|' && peek_() != ')') res.children.push_back(repeat_());
+    return res;
+  }
+  auto alternation_ () -> Ast {
+    Ast res;
+    res.type = Ast::ALT;
+    res.children.push_back(concatenation_());
+    while (peek_() == '|') {
+      ++pos_;
+      res.children.push_back(concatenation_());
+    }
+    return res;
+  }
+
+ public:
+  explicit Parser (std::string_view s) : s_(s) {}
+  auto parse () -> Ast {
+    Ast res = alternation_();
+    if (pos_ != s_.length()) throw Unsupported();
+    return res;
+  }
+};
+
+/// a Thompson NFA. SPLIT and EPS states are free moves, BOL and EOL ones only at the beginning and the end of the input.
+struct Nfa {
+  struct State {
+    enum Kind { SET, SPLIT, EPS, BOL, EOL, MATCH } kind;
+    int out = -1;
+    int out1 = -1;
+    int set = -1;
+  };
+  std::vector<State> states;
+  std::vector<ByteSet> sets;
+
+  auto add (State state) -> int {
+    if (states.size() == kMaxNfaStates) throw Unsupported();
+    states.push_back(state);
+    return states.size() - 1;
+  }
+  /// compiles ast to states that go on to next when ast matches, and @returns the first of them.
+  auto compile (const Ast &ast, int next) -> int {
+    switch (ast.type) {
+      case Ast::EMPTY: return next;
+      case Ast::SET:
+        sets.push_back(ast.set);
+        return add({ .kind = State::SET, .out = next, .set = int(sets.size() - 1) });
+      case Ast::BOL: return add({ .kind = State::BOL, .out = next });
+      case Ast::EOL: return add({ .kind = State::EOL, .out = next });
+      case Ast::CONCAT:
+        for (size_t i = ast.children.size(); i-- > 0;) next = compile(ast.children[i], next);
+        return next;
+      case Ast::ALT: {
+        int res = compile(ast.children.back(), next);
+        for (size_t i = ast.children.size() - 1; i-- > 0;) res = add({ .kind = State::SPLIT, .out = compile(ast.children[i], next), .out1 = res });
+        return res;
+      }
+      case Ast::REPEAT: {
+        const Ast &child = ast.children[0];
+        int res = next;
+        if (ast.max == -1) {
+          int loop = add({ .kind = State::SPLIT, .out1 = next });
+          states[loop].out = compile(child, loop);
+          res = loop;
+        } else {
+          for (int i = ast.min; i < ast.max; ++i) res = add({ .kind = State::SPLIT, .out = compile(child, res), .out1 = next });
+        }
+        for (int i = 0; i < ast.min; ++i) res = compile(child, res);
+        return res;
+      }
+    }
+    return next;
+  }
+
+  /**
+   * the states reached from seeds by free moves, of those that consume input or end the match. EOL states are kept if not atEnd,
+   * so that endAccepts can tell whether the input may end there.
+   */
+  auto closure (const std::vector<int> &seeds, bool atStart, bool atEnd) const -> std::vector<int> {
+    std::vector<int> res, stack(seeds.rbegin(), seeds.rend());
+    std::vector<bool> seen(states.size());
+    while (!stack.empty()) {
+      int id = stack.back();
+      stack.pop_back();
+      if (seen[id]) continue;
+      seen[id] = true;
+      const State &state = states[id];
+      switch (state.kind) {
+        case State::SET: case State::MATCH: res.push_back(id); break;
+        case State::SPLIT: stack.push_back(state.out1); stack.push_back(state.out); break;
+        case State::EPS: stack.push_back(state.out); break;
+        case State::BOL: if (atStart) stack.push_back(state.out); break;
+        case State::EOL:
+          if (atEnd) stack.push_back(state.out);
+          else res.push_back(id);
+          break;
+      }
+    }
+    std::sort(res.begin(), res.end());
+    return res;
+  }
+  auto accepts (const std::vector<int> &set) const -> bool {
+    for (int id : set) if (states[id].kind == State::MATCH) return true;
+    return false;
+  }
+  /// whether the input may end at set, atStart if nothing has been read.
+  auto endAccepts (const std::vector<int> &set, bool atStart) const -> bool {
+    std::vector<int> eols;
+    for (int id : set) {
+      if (states[id].kind == State::MATCH) return true;
+      if (states[id].kind == State::EOL) eols.push_back(id);
+    }
+    return !eols.empty() && accepts(closure(eols, atStart, true));
+  }
+  /// the states after reading c from set.
+  auto step (const std::vector<int> &set, unsigned char c) const -> std::vector<int> {
+    std::vector<int> seeds;
+    for (int id : set) {
+      if (states[id].kind == State::SET && sets[states[id].set][c]) seeds.push_back(states[id].out);
+    }
+    return closure(seeds, false, false);
+  }
+};
+
+} // namespace
+
+/**
+ * runs an NFA from a start state, on a DFA of its state sets if it has few enough of them. the bytes are mapped to classes first,
+ * the bytes of a class being in the same sets of the NFA, so that the DFA has a transition per class rather than per byte.
+ */
+class Pattern::Automaton {
+ private:
+  std::shared_ptr<const Nfa> nfa_;
+  int start_;
+  bool search_;
+  uint8_t classOf_[256];
+  size_t numClasses_ = 0;
+  // the DFA: transitions_[state * numClasses_ + class], with kDead for no state left. state 0 is the start.
+  static constexpr int32_t kDead = -1;
+  std::vector<int32_t> transitions_;
+  std::vector<bool> accepts_;
+  std::vector<bool> endAccepts_;
+  bool useDfa_ = false;
+
+  auto classify_ () -> void {
+    std::map<std::vector<bool>, uint8_t> classes;
+    for (int c = 0; c < 256; ++c) {
+      std::vector<bool> signature;
+      for (const ByteSet &set : nfa_->sets) signature.push_back(set[c]);
+      auto [ it, _ ] = classes.emplace(std::move(signature), classes.size());
+      classOf_[c] = it->second;
+    }
+    numClasses_ = classes.size();
+  }
+  /// builds the DFA by the subset construction. @returns false if it would have more than kMaxDfaStates states.
+  auto buildDfa_ () -> bool {
+    std::vector<unsigned char> representatives(numClasses_);
+    for (int c = 255; c >= 0; --c) representatives[classOf_[c]] = c;
+    // the start state is apart from any later one of the same NFA states, as BOL only holds there.
+    std::map<std::pair<std::vector<int>, bool>, int32_t> ids;
+    std::vector<std::vector<int>> sets;
+    auto idOf = [&] (std::vector<int> &&set, bool atStart) -> int32_t {
+      if (set.empty()) return kDead;
+      auto [ it, added ] = ids.emplace(std::make_pair(set, atStart), sets.size());
+      if (added) {
+        accepts_.push_back(nfa_->accepts(set));
+        endAccepts_.push_back(nfa_->endAccepts(set, atStart));
+        sets.push_back(std::move(set));
+      }
+      return it->second;
+    };
+    idOf(nfa_->closure({ start_ }, true, false), true);
+    if (sets.empty()) {
+      // nothing matches, not even at the start: a start state of no NFA states.
+      sets.emplace_back();
+      accepts_.push_back(false);
+      endAccepts_.push_back(false);
+    }
+    for (size_t i = 0; i < sets.size(); ++i) {
+      if (sets.size() > kMaxDfaStates) return false;
+      for (size_t cls = 0; cls < numClasses_; ++cls) {
+        // sets may grow meanwhile, so its elements are not referred to across idOf.
+        std::vector<int> next = nfa_->step(sets[i], representatives[cls]);
+        transitions_.push_back(idOf(std::move(next), false));
+      }
+    }
+    return true;
+  }
+
+ public:
+  Automaton (std::shared_ptr<const Nfa> nfa, int start, bool search) : nfa_(std::move(nfa)), start_(start), search_(search) {
+    classify_();
+    useDfa_ = buildDfa_();
+    if (!useDfa_) {
+      transitions_.clear();
+      accepts_.clear();
+      endAccepts_.clear();
+    }
+  }
+
+  /// whether the input is accepted, or for searches, whether any prefix of it is.
+  auto run (std::string_view s) const -> bool {
+    if (useDfa_) {
+      int32_t state = 0;
+      if (search_ && accepts_[state]) return true;
+      for (char c : s) {
+        state = transitions_[state * numClasses_ + classOf_[(unsigned char) c]];
+        if (state == kDead) return false;
+        if (search_ && accepts_[state]) return true;
+      }
+      return endAccepts_[state];
+    }
+    std::vector<int> set = nfa_->closure({ start_ }, true, false);
+    if (search_ && nfa_->accepts(set)) return true;
+    for (char c : s) {
+      set = nfa_->step(set, c);
+      if (set.empty()) return false;
+      if (search_ && nfa_->accepts(set)) return true;
+    }
+    return nfa_->endAccepts(set, s.empty());
+  }
+};
+
+Pattern::Pattern (const std::string &pattern) {
+  try {
+    Ast ast = Parser(pattern).parse();
+    auto nfa = std::make_shared<Nfa>();
+    int match = nfa->add({ .kind = Nfa::State::MATCH });
+    int start = nfa->compile(ast, match);
+    // a search is a match that may skip any chars first, and may stop once the pattern is matched.
+    int searchStart = nfa->add({ .kind = Nfa::State::SPLIT, .out = start });
+    nfa->sets.push_back(~ByteSet());
+    nfa->states[searchStart].out1 = nfa->add({ .kind = Nfa::State::SET, .out = searchStart, .set = int(nfa->sets.size() - 1) });
+    matcher_ = std::make_unique<Automaton>(nfa, start, false);
+    searcher_ = std::make_unique<Automaton>(nfa, searchStart, true);
+  } catch (const Unsupported &) {
+    regex_.emplace(pattern);
+  }
+}
+
+Pattern::~Pattern () = default;
+
+auto Pattern::cached (const std::string &pattern) -> std::shared_ptr<const Pattern> {
+  // patterns usually come from a fixed set in the code. beyond this many, new ones are compiled on every call instead.
+  constexpr size_t kMaxCached = 4096;
+  static std::shared_mutex mutex;
+  static std::unordered_map<std::string, std::shared_ptr<const Pattern>> cache;
+  {
+    std::shared_lock lock(mutex);
+    auto it = cache.find(pattern);
+    if (it != cache.end()) return it->second;
+  }
+  auto res = std::make_shared<const Pattern>(pattern);
+  std::unique_lock lock(mutex);
+  if (cache.size() < kMaxCached) cache.emplace(pattern, res);
+  return res;
+}
+
+auto Pattern::match (std::string_view s) const -> bool {
+  if (matcher_) return matcher_->run(s);
+  return std::regex_match(s.begin(), s.end(), *regex_);
+}
+
+auto Pattern::search (std::string_view s) const -> bool {
+  if (searcher_) return searcher_->run(s);
+  return std::regex_search(s.begin(), s.end(), *regex_);
+}
+
+} // namespace ak::validator
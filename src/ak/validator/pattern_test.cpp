@@ -0,0 +1,134 @@
+#include "ak/validator/pattern.h"
+
+#include <assert.h>
+
+#include <random>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ak/validator.h"
+
+using ak::validator::Pattern;
+
+/// patterns the automata run, with the chars the random strings are made of.
+const std::vector<std::pair<std::string, std::string>> kNative = {
+  { "", "ab" },
+  { "abc", "abc" },
+  { "a*b+c?", "abc" },
+  { "a*?b+?", "ab" },
+  { "(ab|a)(bc|c)*", "abc" },
+  { "(?:ab)+|ba", "ab" },
+  { "a{2}", "ab" },
+  { "a{2,}b", "ab" },
+  { "(a|b){1,3}c", "abc" },
+  { "[a-c]+[^a-c]", "abcd\n" },
+  { "[-a]+", "a-b" },
+  { "[a-]+", "a-b" },
+  { ".+", "ab\n\r" },
+  { "a.c", "abc\n" },
+  { "\\d{4}-\\d{2}-\\d{2}", "12-" },
+  { "\\w+\\s\\W", "a1_ \t!" },
+  { "[\\d_]+\\S", "1_ x" },
+  { "\\D\\s\\S", "a1 \n" },
+  { "\\x41\\t\\n", "A\t\n" },
+  { "\\.\\*\\(\\)", ".*()a" },
+  { "^ab", "ab" },
+  { "ab$", "ab" },
+  { "^(a|b)*$", "ab\n" },
+  { "a^b|a", "ab" },
+  { "a$|b", "ab" },
+  { "(a*)*b", "ab" },
+  { "(a|)+b", "ab" },
+  { "((a|b)*c){2}", "abc" },
+  { "x(a|b)*a(a|b){5}", "abx" },
+  { "[^\\n]*\\n", "a\n" },
+  { "colou?r", "colur" },
+  { "(a+)+$", "ab" },
+};
+/// patterns left to std::regex.
+const std::vector<std::string> kFallback = { "(a)\\1", "\\bab", "a(?=b)", "a(?!b)", "[[:alpha:]]+", "\\B", "a**" };
+
+auto randomString (std::mt19937 &rng, const std::string &chars) -> std::string {
+  std::string res;
+  for (size_t n = rng() % 12; n > 0; --n) res.push_back(chars[rng() % chars.size()]);
+  return res;
+}
+
+auto testAgainstRegex () -> void {
+  std::mt19937 rng(2024);
+  for (const auto &[ pattern, chars ] : kNative) {
+    Pattern compiled(pattern);
+    assert(compiled.native());
+    std::regex regex(pattern);
+    for (int i = 0; i < 2000; ++i) {
+      std::string s = randomString(rng, chars);
+      assert(compiled.match(s) == std::regex_match(s, regex));
+      assert(compiled.search(s) == std::regex_search(s, regex));
+    }
+  }
+  for (const std::string &pattern : kFallback) {
+    Pattern compiled(pattern);
+    assert(!compiled.native());
+    std::regex regex(pattern);
+    for (int i = 0; i < 500; ++i) {
+      std::string s = randomString(rng, "ab ");
+      assert(compiled.match(s) == std::regex_match(s, regex));
+      assert(compiled.search(s) == std::regex_search(s, regex));
+    }
+  }
+}
+
+auto testInvalid () -> void {
+  for (const char *pattern : { "(a", "a)", "[a", "a{2,1}", "*a" }) {
+    bool thrown = false;
+    try {
+      Pattern compiled(pattern);
+    } catch (const std::regex_error &) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+}
+
+auto testLarge () -> void {
+  // too many states for a DFA: matched on the NFA.
+  Pattern compiled("(a|b)*a(a|b){14}");
+  assert(compiled.native());
+  std::string s(20, 'b');
+  s[3] = 'a';
+  assert(!compiled.match(s));
+  s[5] = 'a';
+  assert(compiled.match(s));
+  assert(compiled.search("xx" + s));
+  // backtracking would take exponential time on this.
+  Pattern nested("(a+)+b");
+  assert(!nested.match(std::string(10000, 'a')));
+  assert(nested.search(std::string(10000, 'a') + "b"));
+}
+
+auto testCached () -> void {
+  auto a = Pattern::cached("a+b");
+  assert(a == Pattern::cached("a+b"));
+  assert(a != Pattern::cached("a*b"));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < 1000; ++i) {
+        assert(Pattern::cached("x" + std::to_string(i % 50))->match("x" + std::to_string(i % 50)));
+        assert(!Pattern::cached("[0-9]+")->match("x" + std::to_string(t)));
+      }
+    });
+  }
+  for (std::thread &thread : threads) thread.join();
+  ak::validator::expect(std::string("2024-01-31")).toMatch(R"(\d{4}-\d{2}-\d{2})").butNot().toMatch(R"(\d{4})");
+  ak::validator::expect(std::string("Hello World")).toPartiallyMatch(R"(W\w+$)").butNot().toPartiallyMatch("^World");
+}
+
+auto main () -> int {
+  testAgainstRegex();
+  testInvalid();
+  testLarge();
+  testCached();
+}
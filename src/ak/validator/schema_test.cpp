@@ -0,0 +1,85 @@
+#include "ak/validator/schema.h"
+
+#include <assert.h>
+
+#include <string>
+#include <vector>
+
+using ak::validator::Failures;
+using ak::validator::Schema;
+
+struct User {
+  std::string name;
+  std::string role;
+  std::string email;
+  int age;
+};
+
+auto makeSchema () -> Schema<User> {
+  Schema<User> schema;
+  schema.field("name", &User::name).toMatch(R"(\w+)").toBeShorterThan(16).butNot().toBe("root");
+  schema.field("role", &User::role).toBeOneOf({ "admin", "user" });
+  schema.field("email", &User::email).toPartiallyMatch("@").toBeConsistedOf("abcdefghijklmnopqrstuvwxyz.@");
+  schema.field("age", &User::age).toBeGreaterThan(0).toBeLessThan(150);
+  schema.field("initial", [] (const User &user) { return user.name.substr(0, 1); }).toBeOfLength(1);
+  return schema;
+}
+
+auto testCheck () -> void {
+  Schema<User> schema = makeSchema();
+  assert(schema.size() == 9);
+  User good{ "alice", "admin", "alice@example.com", 30 };
+  assert(schema.check(good) == 0);
+  schema.validate(good);
+
+  User bad{ "root", "guest", "Root.example.com", 0 };
+  Failures failures = schema.check(bad);
+  // every failed rule is reported, not only the first.
+  assert(failures == ((Failures(1) << 2) | (Failures(1) << 3) | (Failures(1) << 4) | (Failures(1) << 5) | (Failures(1) << 6)));
+  assert((failures & schema.rulesOf("name")) == Failures(1) << 2);
+  assert((failures & schema.rulesOf("initial")) == 0);
+  std::vector<std::string> report = schema.report(failures);
+  assert(report.size() == 5);
+  assert(report[0] == "name: not toBe");
+  assert(report[1] == "role: toBeOneOf");
+  assert(report[2] == "email: toPartiallyMatch(@)");
+  assert(report[4] == "age: toBeGreaterThan");
+  bool thrown = false;
+  try {
+    schema.validate(bad);
+  } catch (const ak::validator::ValidationException &) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  assert(schema.check({ "", "user", "a@b", 1 }) == ((Failures(1) << 0) | (Failures(1) << 8)));
+}
+
+auto testCheckAll () -> void {
+  Schema<User> schema = makeSchema();
+  std::vector<User> users;
+  for (int i = 0; i < 1000; ++i) users.push_back({ "user" + std::to_string(i), i % 3 ? "user" : "guest", "u@example.com", i % 200 });
+  std::vector<Failures> failures = schema.checkAll(users);
+  assert(failures.size() == users.size());
+  for (size_t i = 0; i < users.size(); ++i) assert(failures[i] == schema.check(users[i]));
+  assert(failures[3] == schema.rulesOf("role"));
+}
+
+auto testTooManyRules () -> void {
+  Schema<User> schema;
+  for (size_t i = 0; i < Schema<User>::kMaxRules; ++i) schema.field("age", &User::age).toBeLessThan(int(i));
+  bool thrown = false;
+  try {
+    schema.field("age", &User::age).toBe(0);
+  } catch (const ak::Overflow &) {
+    thrown = true;
+  }
+  assert(thrown);
+  assert(schema.check({ "", "", "", 100 }) == ~Failures(0));
+}
+
+auto main () -> int {
+  testCheck();
+  testCheckAll();
+  testTooManyRules();
+}